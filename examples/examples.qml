@@ -279,7 +279,12 @@ ApplicationWindow {
                             anchors.left: parent.left
                             anchors.verticalCenter: parent.verticalCenter
                             anchors.margins: 2
-                            source: itemValue[itemValue.length - 1] === '/' ? 'folder.png' : 'object.png'
+                            asynchronous: true
+                            sourceSize.width: 19
+                            sourceSize.height: 19
+                            source: itemValue[itemValue.length - 1] === '/' ? 'folder.png'
+                                  : /\.(jpe?g|png|gif|bmp)$/i.test(itemValue) ? 'image://s3/' + bucket.name + '/' + encodeURIComponent(itemValue)
+                                  : 'object.png'
                         }
                     }
                 }
@@ -25,11 +25,37 @@
  */
 
 #include <QtQml/QQmlExtensionPlugin>
+#include <QtQml/QQmlEngine>
 #include <QtQml/qqml.h>
 
 #include <QtAmazonS3/QAccount>
 #include <QtAmazonS3/QService>
 #include <QtAmazonS3/QBucket>
+#include <QtAmazonS3/QS3Sync>
+#include <QtAmazonS3/QS3Download>
+#include <QtAmazonS3/QS3Upload>
+#include <QtAmazonS3/QS3UploadJanitor>
+#include <QtAmazonS3/QS3Presigner>
+#include <QtAmazonS3/QS3Object>
+#include <QtAmazonS3/QS3Select>
+#include <QtAmazonS3/QS3Inventory>
+#include <QtAmazonS3/QS3Metrics>
+#include <QtAmazonS3/QS3SparseBucket>
+#include <QtAmazonS3/QS3SortFilterProxyModel>
+#include <QtAmazonS3/QS3TreeModel>
+#include <QtAmazonS3/QS3SearchModel>
+#include <QtAmazonS3/QS3Usage>
+#include <QtAmazonS3/QS3FederatedModel>
+
+#include "qs3imageprovider.h"
+
+static QObject *metrics(QQmlEngine *engine, QJSEngine *scriptEngine)
+{
+    Q_UNUSED(scriptEngine)
+    QS3Metrics *ret = &QS3Metrics::instance();
+    engine->setObjectOwnership(ret, QQmlEngine::CppOwnership);
+    return ret;
+}
 
 class QmlAmazonS3Plugin : public QQmlExtensionPlugin
 {
@@ -44,6 +70,28 @@ public:
         qmlRegisterType<QAccount>(uri, 0, 1, "Account");
         qmlRegisterType<QService>(uri, 0, 1, "Service");
         qmlRegisterType<QBucket>(uri, 0, 1, "Bucket");
+        qmlRegisterType<QS3Sync>(uri, 0, 1, "Sync");
+        qmlRegisterType<QS3Download>(uri, 0, 1, "Download");
+        qmlRegisterType<QS3Upload>(uri, 0, 1, "Upload");
+        qmlRegisterType<QS3UploadJanitor>(uri, 0, 1, "UploadJanitor");
+        qmlRegisterType<QS3Presigner>(uri, 0, 1, "Presigner");
+        qmlRegisterType<QS3Object>(uri, 0, 1, "Object");
+        qmlRegisterType<QS3Select>(uri, 0, 1, "Select");
+        qmlRegisterType<QS3Inventory>(uri, 0, 1, "Inventory");
+        qmlRegisterType<QS3SparseBucket>(uri, 0, 1, "SparseBucket");
+        qmlRegisterType<QS3SortFilterProxyModel>(uri, 0, 1, "SortFilterProxyModel");
+        qmlRegisterType<QS3TreeModel>(uri, 0, 1, "TreeModel");
+        qmlRegisterType<QS3SearchModel>(uri, 0, 1, "SearchModel");
+        qmlRegisterType<QS3Usage>(uri, 0, 1, "Usage");
+        qmlRegisterType<QS3FederatedModel>(uri, 0, 1, "FederatedModel");
+        qmlRegisterSingletonType<QS3Metrics>(uri, 0, 1, "Metrics", metrics);
+    }
+
+    virtual void initializeEngine(QQmlEngine *engine, const char *uri)
+    {
+        Q_UNUSED(uri)
+        // image://s3/<bucket>/<key>
+        engine->addImageProvider(QStringLiteral("s3"), new QS3ImageProvider);
     }
 };
 
@@ -0,0 +1,197 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3imageprovider.h"
+
+#include <QtAmazonS3/QAccount>
+#include <QtAmazonS3/QS3NetworkAccessManager>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QBuffer>
+#include <QtCore/QCache>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QPointer>
+#include <QtCore/QUrl>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtGui/QImageReader>
+#include <QtNetwork/QNetworkReply>
+
+// decoded thumbnails, in KiB
+static QCache<QString, QImage> cache(64 * 1024);
+
+static QImage decode(const QByteArray &data, const QSize &requestedSize)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+
+    // let the codec scale while decoding, JPEG only decodes the DCT blocks it needs that way
+    QSize size = reader.size();
+    if (size.isValid() && (requestedSize.width() > 0 || requestedSize.height() > 0)) {
+        QSize bounds(requestedSize.width() > 0 ? requestedSize.width() : size.width()
+                     , requestedSize.height() > 0 ? requestedSize.height() : size.height());
+        if (size.width() > bounds.width() || size.height() > bounds.height()) {
+            size.scale(bounds, Qt::KeepAspectRatio);
+            reader.setScaledSize(size);
+        }
+    }
+    return reader.read();
+}
+
+class QS3ImageResponse : public QQuickImageResponse
+{
+    Q_OBJECT
+public:
+    QS3ImageResponse(const QString &id, const QSize &requestedSize);
+
+    virtual QQuickTextureFactory *textureFactory() const;
+    virtual QString errorString() const;
+
+public slots:
+    virtual void cancel();
+
+private slots:
+    void start();
+    void abort();
+
+private:
+    void fail(const QString &errorString);
+
+    QString id;
+    QSize requestedSize;
+    QString cacheKey;
+    QPointer<QNetworkReply> reply;
+    QAtomicInt cancelled;
+    QImage image;
+    QString error;
+};
+
+QS3ImageResponse::QS3ImageResponse(const QString &id, const QSize &requestedSize)
+    : id(id)
+    , requestedSize(requestedSize)
+    , cacheKey(QStringLiteral("%1@%2x%3").arg(id).arg(requestedSize.width()).arg(requestedSize.height()))
+{
+    // requested from the pixmap reader thread, the network and the cache live in the gui thread
+    moveToThread(QS3NetworkAccessManager::instance().thread());
+    QMetaObject::invokeMethod(this, "start", Qt::QueuedConnection);
+}
+
+QQuickTextureFactory *QS3ImageResponse::textureFactory() const
+{
+    return QQuickTextureFactory::textureFactoryForImage(image);
+}
+
+QString QS3ImageResponse::errorString() const
+{
+    return error;
+}
+
+void QS3ImageResponse::cancel()
+{
+    // called from the pixmap reader thread, reply belongs to the gui thread and is only touched there
+    cancelled.store(1);
+    QMetaObject::invokeMethod(this, "abort", Qt::QueuedConnection);
+}
+
+void QS3ImageResponse::abort()
+{
+    if (reply)
+        reply->abort();
+}
+
+void QS3ImageResponse::start()
+{
+    if (cancelled.load()) {
+        fail(QStringLiteral("canceled"));
+        return;
+    }
+
+    QImage *cached = cache.object(cacheKey);
+    if (cached) {
+        image = *cached;
+        emit finished();
+        return;
+    }
+
+    QAccount *account = QAccount::defaultAccount();
+    int slash = id.indexOf(QLatin1Char('/'));
+    if (!account) {
+        fail(QStringLiteral("no account"));
+        return;
+    }
+    if (slash < 1) {
+        fail(QStringLiteral("expected image://s3/<bucket>/<key>"));
+        return;
+    }
+
+    QNetworkRequest request(account->url(id.left(slash), id.mid(slash + 1)));
+    request.setPriority(QNetworkRequest::HighPriority);
+    reply = QS3NetworkAccessManager::instance().send(account, request, QNetworkAccessManager::GetOperation);
+    connect(reply, &QNetworkReply::finished, this, [this]() {
+        reply->deleteLater();
+        if (reply->error() != QNetworkReply::NoError) {
+            fail(reply->errorString());
+            return;
+        }
+        // an error document is not an image
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode != 200) {
+            fail(QStringLiteral("HTTP %1").arg(httpStatusCode));
+            return;
+        }
+
+        QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+        connect(watcher, &QFutureWatcher<QImage>::finished, [this, watcher]() {
+            image = watcher->result();
+            if (image.isNull()) {
+                fail(QStringLiteral("unsupported image format"));
+                return;
+            }
+            cache.insert(cacheKey, new QImage(image), qMax(1, image.byteCount() / 1024));
+            emit finished();
+        });
+        watcher->setFuture(QtConcurrent::run(decode, reply->readAll(), requestedSize));
+    });
+}
+
+void QS3ImageResponse::fail(const QString &errorString)
+{
+    error = errorString;
+    emit finished();
+}
+
+QS3ImageProvider::QS3ImageProvider()
+    : QQuickAsyncImageProvider()
+{
+}
+
+QQuickImageResponse *QS3ImageProvider::requestImageResponse(const QString &id, const QSize &requestedSize)
+{
+    return new QS3ImageResponse(QUrl::fromPercentEncoding(id.toUtf8()), requestedSize);
+}
+
+#include "qs3imageprovider.moc"
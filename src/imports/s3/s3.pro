@@ -1,9 +1,10 @@
 IMPORT_VERSION = 0.1
 TARGET = amazons3
-QT = qml amazons3
+QT = qml quick concurrent amazons3
 LIBS += -L$$QT.amazons3.libs
 
-SOURCES += main.cpp
+SOURCES += main.cpp qs3imageprovider.cpp
+HEADERS += qs3imageprovider.h
 
 load(qml_plugin)
 
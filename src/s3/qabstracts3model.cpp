@@ -2,13 +2,9 @@
 
 #include "qaccount.h"
 #include "qs3networkaccessmanager.h"
+#include "qs3trace.h"
 
-#include <QtCore/QCryptographicHash>
-#include <QtCore/QMessageAuthenticationCode>
 #include <QtCore/QDebug>
-#include <QtCore/QDateTime>
-#include <QtCore/QLocale>
-#include <QtCore/QRegularExpression>
 #include <QtNetwork/QNetworkRequest>
 #include <QtNetwork/QNetworkReply>
 
@@ -18,12 +14,7 @@ class QAbstractS3Model::Private
 public:
     Private(QAbstractS3Model *parent);
 
-    void start(const QUrl &url, QNetworkAccessManager::Operation operation, const QByteArray &data = QByteArray());
-
-private:
-    QByteArray toString(const QDateTime &dt) const;
-    QByteArray toString(QNetworkAccessManager::Operation operation) const;
-    QByteArray toString(const QUrl &url) const;
+    void start(QNetworkRequest request, QNetworkAccessManager::Operation operation, const QByteArray &data = QByteArray());
 
 private:
     QAbstractS3Model *q;
@@ -44,140 +35,43 @@ QAbstractS3Model::Private::Private(QAbstractS3Model *parent)
 {
 }
 
-QByteArray QAbstractS3Model::Private::toString(const QDateTime &dt) const
-{
-    QDateTime utc(dt);
-    utc.setTimeSpec(Qt::UTC);
-    int timezoneSeconds = dt.secsTo(utc);
-    QChar sign = (timezoneSeconds >=0 ? QLatin1Char('+') : QLatin1Char('-'));
-    if (timezoneSeconds < 0)
-        timezoneSeconds = -timezoneSeconds;
-    int timezoneMinutes = (timezoneSeconds % 3600) / 60;
-    int timezoneHours = (timezoneSeconds / 3600);
-
-    QLocale locale(QStringLiteral("C"));
-    return QStringLiteral("%1 %2%3").arg(locale.toString(dt, QStringLiteral("ddd, dd MMM yyyy hh:mm:ss"))).arg(sign).arg(timezoneHours * 100 + timezoneMinutes, 4, 10, QLatin1Char('0')).toLatin1();
-}
-
-QByteArray QAbstractS3Model::Private::toString(QNetworkAccessManager::Operation operation) const
-{
-    static QMap<QNetworkAccessManager::Operation, QByteArray> map;
-    if (map.isEmpty()) {
-        map.insert(QNetworkAccessManager::HeadOperation, "HEAD");
-        map.insert(QNetworkAccessManager::GetOperation, "GET");
-        map.insert(QNetworkAccessManager::PostOperation, "POST");
-        map.insert(QNetworkAccessManager::PutOperation, "PUT");
-        map.insert(QNetworkAccessManager::DeleteOperation, "DELETE");
-    }
-    return map.value(operation);
-}
-
-QByteArray QAbstractS3Model::Private::toString(const QUrl &url) const
-{
-//    qDebug() << Q_FUNC_INFO << __LINE__ << url;
-    QByteArray ret;
-    QRegularExpression bucket(QStringLiteral("^([a-z0-9\\-]+)\\.s3[a-z0-9\\-]*\\.amazonaws\\.com$"));
-    QRegularExpressionMatch match = bucket.match(url.host());
-    if (match.hasMatch()) {
-        ret.append("/");
-        ret.append(match.captured(1).toUtf8());
-    }
-    ret.append(url.path().toUtf8());
-//    QString query = url.query();
-//    if (query.indexOf('&') < query.indexOf('=')) {
-//        ret.append(QStringLiteral("?%1").arg(query.left(query.indexOf(QStringLiteral("&")))).toUtf8());
-//    }
-//    qDebug() << Q_FUNC_INFO << __LINE__ << ret;
-    return ret;
-}
-
-void QAbstractS3Model::Private::start(const QUrl &url, QNetworkAccessManager::Operation operation, const QByteArray &data)
+void QAbstractS3Model::Private::start(QNetworkRequest request, QNetworkAccessManager::Operation operation, const QByteArray &data)
 {
     if (!account) return;
     if (account->awsAccessKeyId().isEmpty()) return;
     if (account->awsSecretAccessKey().isEmpty()) return;
 
     q->setLoading(true);
-    QNetworkReply *reply = 0;
-
-    QByteArray httpVerb = toString(operation);
-    QByteArray contentMd5;
-    if (!data.isEmpty())
-        contentMd5 = QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex();
-//    qDebug() << Q_FUNC_INFO << __LINE__ << contentMd5;
-    QNetworkRequest request(url);
-    QByteArray contentType = request.header(QNetworkRequest::ContentTypeHeader).toByteArray();
-//    qDebug() << Q_FUNC_INFO << __LINE__ << contentType;
-    QByteArray date = toString(QDateTime::currentDateTime());
-//    qDebug() << Q_FUNC_INFO << __LINE__ << date;
-//    QMap<QString, QString> xamzHeaders;
-//    foreach (const QString &key, qSort(xamzHeaders.keys())) {
-
-//    }
-    QByteArray canonicalizedAmzHeaders;
-    QByteArray canonicalizedResource = toString(request.url());
-//    qDebug() << Q_FUNC_INFO << __LINE__ << canonicalizedResource;
-
-    QByteArray stringToSign = httpVerb + "\n"
-            + contentMd5 + "\n"
-            + contentType + "\n"
-            + date + "\n"
-            + canonicalizedAmzHeaders
-            + canonicalizedResource;
-//    qDebug() << q;
-//    qDebug() << Q_FUNC_INFO << __LINE__ << account->awsSecretAccessKey() << stringToSign;
-    QByteArray signature = QMessageAuthenticationCode::hash(stringToSign, account->awsSecretAccessKey(), QCryptographicHash::Sha1);
-    signature = signature.toBase64();
-    QByteArray authorization("AWS ");
-    authorization.append(account->awsAccessKeyId());
-    authorization.append(":");
-    authorization.append(signature);
-
-    request.setRawHeader("Date", date);
-    request.setRawHeader("Authorization", authorization);
-
-    switch (operation) {
-    case QNetworkAccessManager::HeadOperation:
-        reply = QS3NetworkAccessManager::instance().head(request);
-        break;
-    case QNetworkAccessManager::GetOperation:
-        reply = QS3NetworkAccessManager::instance().get(request);
-        break;
-    case QNetworkAccessManager::PostOperation:
-        reply = QS3NetworkAccessManager::instance().post(request, data);
-        break;
-    case QNetworkAccessManager::PutOperation:
-        reply = QS3NetworkAccessManager::instance().put(request, data);
-        break;
-    case QNetworkAccessManager::DeleteOperation:
-        reply = QS3NetworkAccessManager::instance().deleteResource(request);
-        break;
-    default:
-        break;
-    }
-
+    // listings back the UI, they are shaped in the interactive bandwidth class
+    request.setPriority(QNetworkRequest::HighPriority);
     q->setProgress(0);
 
-    connect(reply, &QNetworkReply::finished, [this, reply]() {
+    // every hop of a redirect streams into the model the same way
+    auto track = [this](QNetworkReply *reply, bool inFlight) {
+        if (!inFlight) return;
+        connect(reply, &QNetworkReply::readyRead, [this, reply]() {
+            if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 200)
+                q->received(reply);
+        });
+        connect(reply, static_cast<void (QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::error), [this, reply](QNetworkReply::NetworkError error) {
+            qDebug() << Q_FUNC_INFO << __LINE__ << error << reply->errorString();
+            qDebug() << Q_FUNC_INFO << __LINE__ << reply->readAll();
+        });
+        connect(reply, &QNetworkReply::downloadProgress, [this](qint64 bytesReceived, qint64 bytesTotal) {
+            if (bytesTotal > 0)
+                q->setProgress(bytesReceived * 100 / bytesTotal);
+        });
+    };
+    QS3NetworkAccessManager::instance().follow(account, request, operation, data, q, track, [this](QNetworkReply *reply) {
         int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        switch (httpStatusCode) {
-        case 200:
+        if (httpStatusCode == 200) {
             q->finished(reply);
             q->setLoading(false);
-            break;
-        case 307:
-            start(reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl(), reply->operation());
-            break;
+        } else {
+            // before loading drops, so that nobody takes the end of loading for the end of the listing
+            emit q->failed(httpStatusCode);
+            q->setLoading(false);
         }
-        reply->deleteLater();
-    });
-    connect(reply, static_cast<void (QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::error), [this, reply](QNetworkReply::NetworkError error) {
-        qDebug() << Q_FUNC_INFO << __LINE__ << error << reply->errorString();
-        qDebug() << Q_FUNC_INFO << __LINE__ << reply->readAll();
-    });
-    connect(reply, &QNetworkReply::downloadProgress, [this](qint64 bytesReceived, qint64 bytesTotal) {
-        if (bytesTotal > 0)
-            q->setProgress(bytesReceived * 100 / bytesTotal);
     });
 }
 
@@ -256,14 +150,52 @@ int QAbstractS3Model::count() const
 
 void QAbstractS3Model::start(const QUrl &url, QNetworkAccessManager::Operation operation, const QByteArray &data)
 {
-    d->start(url, operation, data);
+    d->start(QNetworkRequest(url), operation, data);
+}
+
+void QAbstractS3Model::start(const QNetworkRequest &request, QNetworkAccessManager::Operation operation, const QByteArray &data)
+{
+    d->start(request, operation, data);
+}
+
+void QAbstractS3Model::received(QIODevice *io)
+{
+    Q_UNUSED(io)
 }
 
 void QAbstractS3Model::append(const QList<QVariantMap> &data)
 {
     if (data.isEmpty()) return;
+    QS3_TRACE_SCOPE("model", "append");
     beginInsertRows(QModelIndex(), d->data.length(), d->data.length() + data.length() - 1);
     d->data.append(data);
     endInsertRows();
     emit countChanged(d->data.count());
 }
+
+void QAbstractS3Model::update(int row, const QVariantMap &data)
+{
+    if (row < 0 || row >= d->data.count()) return;
+    QVariantMap &current = d->data[row];
+    QHash<int, QByteArray> roleNames = this->roleNames();
+    QVector<int> roles;
+    foreach (const QString &key, data.keys()) {
+        if (current.value(key) == data.value(key)) continue;
+        current.insert(key, data.value(key));
+        int role = roleNames.key(key.toUtf8(), -1);
+        if (role > -1)
+            roles.append(role);
+    }
+    if (roles.isEmpty()) return;
+    QModelIndex index = this->index(row);
+    emit dataChanged(index, index, roles);
+}
+
+void QAbstractS3Model::clear()
+{
+    if (d->data.isEmpty()) return;
+    beginResetModel();
+    d->data.clear();
+    endResetModel();
+    emit countChanged(0);
+}
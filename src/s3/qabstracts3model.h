@@ -6,6 +6,7 @@
 #include <QtCore/QAbstractListModel>
 #include <QtCore/QUrl>
 #include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkRequest>
 
 class QAccount;
 
@@ -41,11 +42,16 @@ signals:
     void loadingChanged(bool loading);
     void progressChanged(int progress);
     void countChanged(int count);
+    void failed(int httpStatusCode);
 
 protected:
     void start(const QUrl &url, QNetworkAccessManager::Operation method, const QByteArray &data = QByteArray());
+    void start(const QNetworkRequest &request, QNetworkAccessManager::Operation method, const QByteArray &data = QByteArray());
+    virtual void received(QIODevice *io);
     virtual void finished(QIODevice *io) = 0;
     void append(const QList<QVariantMap> &data);
+    void update(int row, const QVariantMap &data);
+    void clear();
 
 private:
     class Private;
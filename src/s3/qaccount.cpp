@@ -27,23 +27,52 @@
 #include "qaccount.h"
 
 #include <QtCore/QDebug>
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+
+static QPointer<QAccount> defaultInstance;
 
 class QAccount::Private
 {
 public:
     Private(QAccount *parent);
 
+    void measure();
+
 private:
     QAccount *q;
 
 public:
     QByteArray awsAccessKeyId;
     QByteArray awsSecretAccessKey;
+    QUrl endpoint;
+    QS3TokenBucket buckets[2];
+    qint64 rates[2];
+    QTimer meter;
 };
 
 QAccount::Private::Private(QAccount *parent)
     : q(parent)
 {
+    rates[QS3TokenBucket::Download] = 0;
+    rates[QS3TokenBucket::Upload] = 0;
+    meter.setInterval(1000);
+    connect(&meter, &QTimer::timeout, [this]() { measure(); });
+    meter.start();
+}
+
+void QAccount::Private::measure()
+{
+    qint64 downloadRate = buckets[QS3TokenBucket::Download].throughput();
+    if (rates[QS3TokenBucket::Download] != downloadRate) {
+        rates[QS3TokenBucket::Download] = downloadRate;
+        emit q->downloadRateChanged(downloadRate);
+    }
+    qint64 uploadRate = buckets[QS3TokenBucket::Upload].throughput();
+    if (rates[QS3TokenBucket::Upload] != uploadRate) {
+        rates[QS3TokenBucket::Upload] = uploadRate;
+        emit q->uploadRateChanged(uploadRate);
+    }
 }
 
 QAccount::QAccount(QObject *parent)
@@ -51,6 +80,9 @@ QAccount::QAccount(QObject *parent)
     , d(new Private(this))
 {
     connect(this, &QAccount::destroyed, [d]() { delete d; });
+    // the first account is the one used where none can be passed, e.g. by image://s3
+    if (!defaultInstance)
+        defaultInstance = this;
 }
 
 const QByteArray &QAccount::awsAccessKeyId() const
@@ -63,6 +95,71 @@ const QByteArray &QAccount::awsSecretAccessKey() const
     return d->awsSecretAccessKey;
 }
 
+const QUrl &QAccount::endpoint() const
+{
+    return d->endpoint;
+}
+
+qint64 QAccount::maxDownloadRate() const
+{
+    return d->buckets[QS3TokenBucket::Download].rate();
+}
+
+qint64 QAccount::maxUploadRate() const
+{
+    return d->buckets[QS3TokenBucket::Upload].rate();
+}
+
+qint64 QAccount::downloadRate() const
+{
+    return d->rates[QS3TokenBucket::Download];
+}
+
+qint64 QAccount::uploadRate() const
+{
+    return d->rates[QS3TokenBucket::Upload];
+}
+
+QS3TokenBucket *QAccount::tokenBucket(QS3TokenBucket::Direction direction) const
+{
+    return &d->buckets[direction];
+}
+
+QAccount *QAccount::defaultAccount()
+{
+    return defaultInstance;
+}
+
+void QAccount::setDefaultAccount(QAccount *account)
+{
+    defaultInstance = account;
+}
+
+QUrl QAccount::url(const QString &bucket, const QString &key) const
+{
+    if (d->endpoint.isValid()) {
+        // path-style, for S3 compatible servers that do not resolve bucket subdomains
+        QUrl ret(d->endpoint);
+        QString path = ret.path();
+        if (!path.endsWith(QLatin1Char('/')))
+            path.append(QLatin1Char('/'));
+        if (!bucket.isEmpty()) {
+            path.append(bucket);
+            if (!key.isEmpty())
+                path.append(QLatin1Char('/') + key);
+        }
+        ret.setPath(path);
+        return ret;
+    }
+
+    QUrl ret(QStringLiteral("http://s3.amazonaws.com/"));
+    if (!bucket.isEmpty())
+        ret.setHost(QStringLiteral("%1.s3.amazonaws.com").arg(bucket));
+    if (!key.isEmpty())
+        ret.setPath(QLatin1Char('/') + key);
+    return ret;
+}
+
 void QAccount::setAwsAccessKeyId(const QByteArray &awsAccessKeyId)
 {
     if (d->awsAccessKeyId == awsAccessKeyId) return;
@@ -77,3 +174,23 @@ void QAccount::setAwsSecretAccessKey(const QByteArray &awsSecretAccessKey)
     emit awsSecretAccessKeyChanged(awsSecretAccessKey);
 }
 
+void QAccount::setEndpoint(const QUrl &endpoint)
+{
+    if (d->endpoint == endpoint) return;
+    d->endpoint = endpoint;
+    emit endpointChanged(endpoint);
+}
+
+void QAccount::setMaxDownloadRate(qint64 maxDownloadRate)
+{
+    if (d->buckets[QS3TokenBucket::Download].rate() == maxDownloadRate) return;
+    d->buckets[QS3TokenBucket::Download].setRate(maxDownloadRate);
+    emit maxDownloadRateChanged(maxDownloadRate);
+}
+
+void QAccount::setMaxUploadRate(qint64 maxUploadRate)
+{
+    if (d->buckets[QS3TokenBucket::Upload].rate() == maxUploadRate) return;
+    d->buckets[QS3TokenBucket::Upload].setRate(maxUploadRate);
+    emit maxUploadRateChanged(maxUploadRate);
+}
@@ -28,8 +28,10 @@
 #define QACCOUNT_H
 
 #include "s3_global.h"
+#include "qs3tokenbucket.h"
 
 #include <QtCore/QObject>
+#include <QtCore/QUrl>
 
 class S3_EXPORT QAccount : public QObject
 {
@@ -37,20 +39,45 @@ class S3_EXPORT QAccount : public QObject
 
     Q_PROPERTY(QByteArray awsAccessKeyId READ awsAccessKeyId WRITE setAwsAccessKeyId NOTIFY awsAccessKeyIdChanged)
     Q_PROPERTY(QByteArray awsSecretAccessKey READ awsSecretAccessKey WRITE setAwsSecretAccessKey NOTIFY awsSecretAccessKeyChanged)
+    Q_PROPERTY(QUrl endpoint READ endpoint WRITE setEndpoint NOTIFY endpointChanged)
+    Q_PROPERTY(qint64 maxDownloadRate READ maxDownloadRate WRITE setMaxDownloadRate NOTIFY maxDownloadRateChanged)
+    Q_PROPERTY(qint64 maxUploadRate READ maxUploadRate WRITE setMaxUploadRate NOTIFY maxUploadRateChanged)
+    Q_PROPERTY(qint64 downloadRate READ downloadRate NOTIFY downloadRateChanged)
+    Q_PROPERTY(qint64 uploadRate READ uploadRate NOTIFY uploadRateChanged)
 
 public:
     explicit QAccount(QObject *parent = 0);
 
     const QByteArray &awsAccessKeyId() const;
     const QByteArray &awsSecretAccessKey() const;
+    const QUrl &endpoint() const;
+    qint64 maxDownloadRate() const;
+    qint64 maxUploadRate() const;
+    qint64 downloadRate() const;
+    qint64 uploadRate() const;
+
+    QS3TokenBucket *tokenBucket(QS3TokenBucket::Direction direction) const;
+
+    static QAccount *defaultAccount();
+    static void setDefaultAccount(QAccount *account);
+
+    Q_INVOKABLE QUrl url(const QString &bucket = QString(), const QString &key = QString()) const;
 
 public slots:
     void setAwsAccessKeyId(const QByteArray &awsAccessKeyId);
     void setAwsSecretAccessKey(const QByteArray &awsSecretAccessKey);
+    void setEndpoint(const QUrl &endpoint);
+    void setMaxDownloadRate(qint64 maxDownloadRate);
+    void setMaxUploadRate(qint64 maxUploadRate);
 
 signals:
     void awsAccessKeyIdChanged(const QByteArray &awsAccessKeyId);
     void awsSecretAccessKeyChanged(const QByteArray &awsSecretAccessKey);
+    void endpointChanged(const QUrl &endpoint);
+    void maxDownloadRateChanged(qint64 maxDownloadRate);
+    void maxUploadRateChanged(qint64 maxUploadRate);
+    void downloadRateChanged(qint64 downloadRate);
+    void uploadRateChanged(qint64 uploadRate);
 
 private:
     class Private;
@@ -27,34 +27,58 @@
 #include "qbucket.h"
 
 #include <QtCore/QDebug>
-#include <QtCore/QDateTime>
+#include <QtCore/QCache>
+#include <QtCore/QSet>
 #include <QtCore/QTimer>
 #include <QtCore/QUrlQuery>
-#include <QtCore/QXmlStreamReader>
+#include <QtNetwork/QNetworkReply>
 
 #include "qaccount.h"
+#include "qs3listbucketresult.h"
+#include "qs3networkaccessmanager.h"
+#include "qs3trace.h"
 
 class QBucket::Private
 {
 public:
     Private(QBucket *parent);
 
+    void enqueueMetadata(int row);
+    void fetchMetadata();
+
+private:
+    QBucket *q;
+
+public:
     QString name;
     QString delimiter;
     QString marker;
     int maxKeys;
     QString prefix;
     bool truncated;
+    bool autoFetchMetadata;
+    int metadataConcurrency;
 
     static QHash<int, QByteArray> roleNames;
     QTimer timer;
+
+    static QCache<QString, QVariantMap> metadataCache;
+    QList<int> metadataQueue;
+    QSet<int> metadataRequested;
+    int metadataRunning;
+    QTimer metadataTimer;
 };
 
 QHash<int, QByteArray> QBucket::Private::roleNames;
+QCache<QString, QVariantMap> QBucket::Private::metadataCache(10000);
 
 QBucket::Private::Private(QBucket *parent)
-    : maxKeys(0)
+    : q(parent)
+    , maxKeys(0)
     , truncated(false)
+    , autoFetchMetadata(false)
+    , metadataConcurrency(4)
+    , metadataRunning(0)
 {
     timer.setInterval(0);
     timer.setSingleShot(true);
@@ -62,6 +86,82 @@ QBucket::Private::Private(QBucket *parent)
 
     connect(parent, &QBucket::accountChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
     connect(parent, &QBucket::nameChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+    metadataTimer.setInterval(0);
+    metadataTimer.setSingleShot(true);
+    connect(&metadataTimer, &QTimer::timeout, [this]() { fetchMetadata(); });
+    connect(&QS3NetworkAccessManager::instance(), &QS3NetworkAccessManager::windowAvailable, parent, [this]() {
+        if (!metadataQueue.isEmpty())
+            metadataTimer.start();
+    });
+    // rows are numbered afresh after a reset, what was requested for them no longer applies
+    connect(parent, &QBucket::modelReset, [this]() {
+        metadataQueue.clear();
+        metadataRequested.clear();
+    });
+}
+
+void QBucket::Private::enqueueMetadata(int row)
+{
+    if (metadataRequested.contains(row)) return;
+    metadataRequested.insert(row);
+    metadataQueue.append(row);
+    metadataTimer.start();
+}
+
+void QBucket::Private::fetchMetadata()
+{
+    QAccount *account = q->account();
+    if (!account) return;
+
+    while (metadataRunning < metadataConcurrency && !metadataQueue.isEmpty()) {
+        // the rows requested last are the ones currently on screen
+        int row = metadataQueue.takeLast();
+        QVariantMap content = q->get(row);
+        if (!content.contains(QStringLiteral("eTag"))) continue;
+
+        QString key = content.value(QStringLiteral("key")).toString();
+        QString eTag = content.value(QStringLiteral("eTag")).toString();
+        QString cacheKey = name + QLatin1Char('/') + key;
+        QVariantMap *cached = metadataCache.object(cacheKey);
+        if (cached && cached->value(QStringLiteral("eTag")).toString() == eTag) {
+            q->update(row, *cached);
+            continue;
+        }
+
+        QNetworkRequest request(account->url(name, key));
+        if (QS3NetworkAccessManager::instance().isSaturated(request.url())) {
+            metadataQueue.append(row);
+            break;
+        }
+        metadataRunning++;
+        request.setPriority(QNetworkRequest::HighPriority);
+        QNetworkReply *reply = QS3NetworkAccessManager::instance().send(account, request, QNetworkAccessManager::HeadOperation);
+        connect(reply, &QNetworkReply::finished, q, [this, reply, row, key, cacheKey]() {
+            metadataRunning--;
+            int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            if (httpStatusCode == 200) {
+                QVariantMap metadata;
+                foreach (const QNetworkReply::RawHeaderPair &header, reply->rawHeaderPairs()) {
+                    QByteArray headerName = header.first.toLower();
+                    if (headerName.startsWith("x-amz-meta-"))
+                        metadata.insert(QString::fromUtf8(headerName.mid(11)), QString::fromUtf8(header.second));
+                }
+                QVariantMap *value = new QVariantMap;
+                value->insert(QStringLiteral("eTag"), QString::fromUtf8(reply->rawHeader("ETag")));
+                value->insert(QStringLiteral("contentType"), reply->header(QNetworkRequest::ContentTypeHeader).toString());
+                value->insert(QStringLiteral("metadata"), metadata);
+                if (q->get(row).value(QStringLiteral("key")).toString() == key)
+                    q->update(row, *value);
+                metadataCache.insert(cacheKey, value);
+            } else {
+                // asked again the next time the row is looked at
+                metadataRequested.remove(row);
+            }
+            reply->deleteLater();
+            fetchMetadata();
+        });
+    }
 }
 
 QBucket::QBucket(QObject *parent)
@@ -81,10 +181,23 @@ QHash<int, QByteArray> QBucket::roleNames() const
         d->roleNames.insert(role++, "size");
         d->roleNames.insert(role++, "storageClass");
         d->roleNames.insert(role++, "owner");
+        d->roleNames.insert(role++, "contentType");
+        d->roleNames.insert(role++, "metadata");
     }
     return d->roleNames;
 }
 
+QVariant QBucket::data(const QModelIndex &index, int role) const
+{
+    QVariant ret = QAbstractS3Model::data(index, role);
+    if (!ret.isValid() && d->autoFetchMetadata) {
+        QByteArray roleName = roleNames().value(role);
+        if (roleName == "contentType" || roleName == "metadata")
+            d->enqueueMetadata(index.row());
+    }
+    return ret;
+}
+
 const QString &QBucket::name() const
 {
     return d->name;
@@ -157,13 +270,44 @@ void QBucket::setTruncated(bool truncated)
     emit truncatedChanged(truncated);
 }
 
+bool QBucket::autoFetchMetadata() const
+{
+    return d->autoFetchMetadata;
+}
+
+void QBucket::setAutoFetchMetadata(bool autoFetchMetadata)
+{
+    if (d->autoFetchMetadata == autoFetchMetadata) return;
+    d->autoFetchMetadata = autoFetchMetadata;
+    emit autoFetchMetadataChanged(autoFetchMetadata);
+}
+
+int QBucket::metadataConcurrency() const
+{
+    return d->metadataConcurrency;
+}
+
+void QBucket::setMetadataConcurrency(int metadataConcurrency)
+{
+    if (d->metadataConcurrency == metadataConcurrency) return;
+    d->metadataConcurrency = metadataConcurrency;
+    emit metadataConcurrencyChanged(metadataConcurrency);
+    d->metadataTimer.start();
+}
+
+void QBucket::fetchMetadata(int row)
+{
+    if (row < 0 || row >= count()) return;
+    d->enqueueMetadata(row);
+}
+
 void QBucket::load()
 {
     if (loading()) return;
     if (!account()) return;
     if (d->name.isEmpty()) return;
 
-    QUrl url(QStringLiteral("http://%1.s3.amazonaws.com/").arg(d->name));
+    QUrl url = account()->url(d->name);
     QUrlQuery query;
     if (!d->delimiter.isEmpty())
         query.addQueryItem(QStringLiteral("delimiter"), d->delimiter);
@@ -179,98 +323,23 @@ void QBucket::load()
 
 void QBucket::finished(QIODevice *io)
 {
-    QXmlStreamReader xml(io);
-
-    bool commonPrefix = false;
-    QVariantMap content;
-    QVariantMap owner;
-
-    QList<QVariantMap> contents;
-    QList<QVariantMap> commonPrefixes;
-
-    while (!xml.atEnd()) {
-        QXmlStreamReader::TokenType type = xml.readNext();
-        switch (type) {
-        case QXmlStreamReader::StartElement:
-            if (xml.name() == QStringLiteral("ListBucketResult")) {
-                contents.clear();
-            } else if (xml.name() == QStringLiteral("Name")) {
-                xml.readNext();
-                setName(xml.text().toString());
-            } else if (xml.name() == QStringLiteral("Prefix")) {
-                xml.readNext();
-                if (commonPrefix) {
-                    content.insert(QStringLiteral("key"), xml.text().toString());
-                } else {
-                    setPrefix(xml.text().toString());
-                }
-            } else if (xml.name() == QStringLiteral("Delimiter")) {
-                xml.readNext();
-                setDelimiter(xml.text().toString());
-            } else if (xml.name() == QStringLiteral("Marker")) {
-                xml.readNext();
-                setMarker(xml.text().toString());
-            } else if (xml.name() == QStringLiteral("MaxKeys")) {
-                xml.readNext();
-                setMaxKeys(xml.text().toInt());
-            } else if (xml.name() == QStringLiteral("IsTruncated")) {
-                xml.readNext();
-                setTruncated(xml.text().toString() == QStringLiteral("true"));
-            } else if (xml.name() == QStringLiteral("Contents")) {
-                content.clear();
-            } else if (xml.name() == QStringLiteral("Key")) {
-                xml.readNext();
-                content.insert(QStringLiteral("key"), xml.text().toString());
-            } else if (xml.name() == QStringLiteral("LastModified")) {
-                xml.readNext();
-                content.insert(QStringLiteral("lastModified"), QDateTime::fromString(xml.text().toString(), QStringLiteral("yyyy-MM-ddThh:mm:ss.zzzZ")));
-            } else if (xml.name() == QStringLiteral("ETag")) {
-                xml.readNext();
-                content.insert(QStringLiteral("eTag"), xml.text().toString());
-            } else if (xml.name() == QStringLiteral("Size")) {
-                xml.readNext();
-                content.insert(QStringLiteral("size"), xml.text().toULongLong());
-            } else if (xml.name() == QStringLiteral("StorageClass")) {
-                xml.readNext();
-                content.insert(QStringLiteral("storageClass"), xml.text().toString());
-            } else if (xml.name() == QStringLiteral("Owner")) {
-                owner.clear();
-            } else if (xml.name() == QStringLiteral("ID")) {
-                xml.readNext();
-                owner.insert(QStringLiteral("id"), xml.text().toString());
-            } else if (xml.name() == QStringLiteral("DisplayName")) {
-                xml.readNext();
-                owner.insert(QStringLiteral("displayName"), xml.text().toString());
-            } else if (xml.name() == QStringLiteral("CommonPrefixes")) {
-                commonPrefix = true;
-                content.clear();
-            } else if (xml.name() == QStringLiteral("Key")) {
-                xml.readNext();
-                content.insert(QStringLiteral("key"), xml.text().toString());
-            } else {
-                qDebug() << Q_FUNC_INFO << __LINE__ << xml.name();
-                xml.readNext();
-                qDebug() << Q_FUNC_INFO << __LINE__ << xml.text().toString();
-            }
-            break;
-        case QXmlStreamReader::EndElement:
-            if (xml.name() == QStringLiteral("Owner")) {
-                content.insert(QStringLiteral("owner"), owner);
-            } else if (xml.name() == QStringLiteral("Contents")) {
-                contents.append(content);
-            } else if (xml.name() == QStringLiteral("CommonPrefixes")) {
-                commonPrefix = false;
-                commonPrefixes.append(content);
-            } else if (xml.name() == QStringLiteral("ListBucketResult")) {
-//                qDebug() << Q_FUNC_INFO << __LINE__ << contents;
-                append(commonPrefixes);
-                append(contents);
-            }
-            break;
-        default:
-            break;
-        }
-    }
-    if (xml.hasError()) {
-    }
+    QS3_TRACE_SCOPE("bucket", "parse");
+    QS3ListBucketResult result;
+    bool complete = result.read(io);
+
+    if (result.name.isValid())
+        setName(result.name.toString());
+    if (result.prefix.isValid())
+        setPrefix(result.prefix.toString());
+    if (result.delimiter.isValid())
+        setDelimiter(result.delimiter.toString());
+    if (result.marker.isValid())
+        setMarker(result.marker.toString());
+    if (result.maxKeys.isValid())
+        setMaxKeys(result.maxKeys.toInt());
+    if (result.truncated.isValid())
+        setTruncated(result.truncated.toBool());
+    if (!complete) return;
+    append(result.commonPrefixes);
+    append(result.contents);
 }
@@ -41,10 +41,13 @@ class S3_EXPORT QBucket : public QAbstractS3Model
     Q_PROPERTY(int maxKeys READ maxKeys WRITE setMaxKeys NOTIFY maxKeysChanged)
     Q_PROPERTY(QString prefix READ prefix WRITE setPrefix NOTIFY prefixChanged)
     Q_PROPERTY(bool isTruncated READ isTruncated NOTIFY truncatedChanged)
+    Q_PROPERTY(bool autoFetchMetadata READ autoFetchMetadata WRITE setAutoFetchMetadata NOTIFY autoFetchMetadataChanged)
+    Q_PROPERTY(int metadataConcurrency READ metadataConcurrency WRITE setMetadataConcurrency NOTIFY metadataConcurrencyChanged)
 public:
     explicit QBucket(QObject *parent = 0);
 
     virtual QHash<int, QByteArray> roleNames() const;
+    virtual QVariant data(const QModelIndex &index, int role) const;
 
     const QString &name() const;
     const QString &delimiter() const;
@@ -52,6 +55,10 @@ public:
     int maxKeys() const;
     const QString &prefix() const;
     bool isTruncated() const;
+    bool autoFetchMetadata() const;
+    int metadataConcurrency() const;
+
+    Q_INVOKABLE void fetchMetadata(int row);
 
 public slots:
     void setName(const QString &name);
@@ -59,6 +66,8 @@ public slots:
     void setMarker(const QString &marker);
     void setMaxKeys(int maxKeys);
     void setPrefix(const QString &prefix);
+    void setAutoFetchMetadata(bool autoFetchMetadata);
+    void setMetadataConcurrency(int metadataConcurrency);
 
 private slots:
     void setTruncated(bool trunctated);
@@ -73,6 +82,8 @@ signals:
     void maxKeysChanged(int maxKeys);
     void prefixChanged(const QString &prefix);
     void truncatedChanged(bool isTruncated);
+    void autoFetchMetadataChanged(bool autoFetchMetadata);
+    void metadataConcurrencyChanged(int metadataConcurrency);
 
 protected:
     void finished(QIODevice *io);
@@ -0,0 +1,207 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3blockcache.h"
+#include "qs3metrics.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFuture>
+#include <QtCore/QLockFile>
+#include <QtCore/QMutex>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtConcurrent/QtConcurrentRun>
+
+static bool olderFirst(const QFileInfo &a, const QFileInfo &b)
+{
+    return a.lastModified() < b.lastModified();
+}
+
+class QS3BlockCache::Private
+{
+public:
+    Private();
+
+    QString fileName(const QString &bucket, const QString &key, const QByteArray &eTag, qint64 blockSize, qint64 index) const;
+
+    QMutex mutex;
+    QString directory;
+    qint64 maxSize;
+    qint64 written;
+    QFuture<void> eviction;
+};
+
+QS3BlockCache::Private::Private()
+    : directory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/s3blocks"))
+    , maxSize(1024 * 1024 * 1024)
+    , written(0)
+{
+    QByteArray environment = qgetenv("QS3_BLOCK_CACHE");
+    if (!environment.isEmpty())
+        directory = QFile::decodeName(environment);
+}
+
+QString QS3BlockCache::Private::fileName(const QString &bucket, const QString &key, const QByteArray &eTag, qint64 blockSize, qint64 index) const
+{
+    // a new ETag is a new object, its blocks never meet the old ones
+    QByteArray id = bucket.toUtf8() + '\n' + key.toUtf8() + '\n' + eTag + '\n' + QByteArray::number(blockSize);
+    QString hash = QString::fromLatin1(QCryptographicHash::hash(id, QCryptographicHash::Sha1).toHex());
+    return QStringLiteral("%1/%2/%3-%4").arg(directory).arg(hash.left(2)).arg(hash).arg(index);
+}
+
+QS3BlockCache &QS3BlockCache::instance()
+{
+    static QS3BlockCache ret;
+    return ret;
+}
+
+QS3BlockCache::QS3BlockCache()
+    : d(new Private)
+{
+}
+
+QS3BlockCache::~QS3BlockCache()
+{
+    d->eviction.waitForFinished();
+    delete d;
+}
+
+QString QS3BlockCache::directory() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->directory;
+}
+
+void QS3BlockCache::setDirectory(const QString &directory)
+{
+    QMutexLocker locker(&d->mutex);
+    d->directory = directory;
+}
+
+qint64 QS3BlockCache::maxSize() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->maxSize;
+}
+
+void QS3BlockCache::setMaxSize(qint64 maxSize)
+{
+    QMutexLocker locker(&d->mutex);
+    d->maxSize = maxSize;
+}
+
+QByteArray QS3BlockCache::read(const QString &bucket, const QString &key, const QByteArray &eTag, qint64 blockSize, qint64 index)
+{
+    QString fileName;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->maxSize <= 0 || d->directory.isEmpty() || eTag.isEmpty()) return QByteArray();
+        fileName = d->fileName(bucket, key, eTag, blockSize, index);
+    }
+
+    // blocks are renamed into place complete, a file that opens is a whole block
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        QS3Metrics::instance().increment(QS3Metrics::CacheMisses);
+        return QByteArray();
+    }
+    QS3Metrics::instance().increment(QS3Metrics::CacheHits);
+    // callers keep the block, so it is copied out either way, a mapping would only add a page fault per page
+    QByteArray ret = file.readAll();
+
+    // keep recently used blocks at the young end for eviction
+    QDateTime now = QDateTime::currentDateTime();
+    if (QFileInfo(file).lastModified().secsTo(now) > 60)
+        file.setFileTime(now, QFileDevice::FileModificationTime);
+    return ret;
+}
+
+void QS3BlockCache::write(const QString &bucket, const QString &key, const QByteArray &eTag, qint64 blockSize, qint64 index, const QByteArray &data)
+{
+    QString fileName;
+    bool full = false;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->maxSize <= 0 || d->directory.isEmpty() || eTag.isEmpty()) return;
+        fileName = d->fileName(bucket, key, eTag, blockSize, index);
+        d->written += data.size();
+        if (d->written > d->maxSize / 16 && d->eviction.isFinished()) {
+            d->written = 0;
+            full = true;
+        }
+    }
+
+    if (QFile::exists(fileName)) return;
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    // another process writing the same block at the same time just wins the rename
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly)) return;
+    file.write(data);
+    file.commit();
+
+    // walking the whole directory is far too slow for the thread that reads the device
+    if (full) {
+        QMutexLocker locker(&d->mutex);
+        d->eviction = QtConcurrent::run(this, &QS3BlockCache::evict);
+    }
+}
+
+void QS3BlockCache::evict()
+{
+    QString directory = this->directory();
+    qint64 maxSize = this->maxSize();
+    if (directory.isEmpty()) return;
+
+    // one process at a time, the others keep going
+    QDir().mkpath(directory);
+    QLockFile lock(directory + QStringLiteral("/.lock"));
+    if (!lock.tryLock(0)) return;
+
+    QList<QFileInfo> files;
+    qint64 size = 0;
+    QDirIterator it(directory, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        if (it.fileName() == QStringLiteral(".lock")) continue;
+        files.append(it.fileInfo());
+        size += it.fileInfo().size();
+    }
+    if (size <= maxSize) return;
+
+    qSort(files.begin(), files.end(), olderFirst);
+    // leave some room so that eviction does not run again right away
+    qint64 target = maxSize / 10 * 9;
+    foreach (const QFileInfo &file, files) {
+        if (size <= target) break;
+        if (QFile::remove(file.absoluteFilePath()))
+            size -= file.size();
+    }
+}
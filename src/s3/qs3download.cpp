@@ -0,0 +1,429 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3download.h"
+
+#include "qaccount.h"
+#include "qs3blockcache.h"
+#include "qs3networkaccessmanager.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QSaveFile>
+#include <QtNetwork/QNetworkReply>
+
+class QS3Download::Private
+{
+public:
+    Private(QS3Download *parent);
+
+    QString journalName() const;
+    void readJournal();
+    void writeJournal();
+
+    void request();
+    void begin();
+    void write();
+    void cache(const QByteArray &data);
+    void finished();
+    void complete(int httpStatusCode);
+
+private:
+    QS3Download *q;
+
+public:
+    QAccount *account;
+    QString bucket;
+    QString key;
+    QString fileName;
+    bool running;
+    qint64 bytesReceived;
+    qint64 bytesTotal;
+
+    QFile partial;
+    QNetworkReply *reply;
+    QIODevice *device;
+    bool begun;
+    qint64 offset;
+    qint64 journaled;
+    QByteArray eTag;
+    QByteArray lastModified;
+    // the aligned block the body is in, handed to the block cache once it is complete
+    QByteArray block;
+};
+
+// the default of QS3RandomAccessDevice, blocks are only shared between equal sizes
+static const qint64 blockSize = 256 * 1024;
+
+QS3Download::Private::Private(QS3Download *parent)
+    : q(parent)
+    , account(0)
+    , running(false)
+    , bytesReceived(0)
+    , bytesTotal(0)
+    , reply(0)
+    , device(0)
+    , begun(false)
+    , offset(0)
+    , journaled(0)
+{
+}
+
+QString QS3Download::Private::journalName() const
+{
+    return fileName + QStringLiteral(".s3journal");
+}
+
+void QS3Download::Private::readJournal()
+{
+    QFile file(journalName());
+    if (!file.open(QFile::ReadOnly)) return;
+
+    QJsonObject journal = QJsonDocument::fromJson(file.readAll()).object();
+    if (journal.value(QStringLiteral("bucket")).toString() != bucket) return;
+    if (journal.value(QStringLiteral("key")).toString() != key) return;
+    qint64 offset = static_cast<qint64>(journal.value(QStringLiteral("offset")).toDouble());
+    if (QFileInfo(partial.fileName()).size() < offset) return;
+
+    this->offset = offset;
+    eTag = journal.value(QStringLiteral("eTag")).toString().toUtf8();
+    lastModified = journal.value(QStringLiteral("lastModified")).toString().toUtf8();
+}
+
+void QS3Download::Private::writeJournal()
+{
+    QJsonObject journal;
+    journal.insert(QStringLiteral("bucket"), bucket);
+    journal.insert(QStringLiteral("key"), key);
+    journal.insert(QStringLiteral("offset"), static_cast<double>(offset));
+    journal.insert(QStringLiteral("eTag"), QString::fromUtf8(eTag));
+    journal.insert(QStringLiteral("lastModified"), QString::fromUtf8(lastModified));
+
+    QSaveFile file(journalName());
+    if (!file.open(QFile::WriteOnly)) return;
+    file.write(QJsonDocument(journal).toJson(QJsonDocument::Compact));
+    if (file.commit())
+        journaled = offset;
+}
+
+void QS3Download::Private::request()
+{
+    if (!partial.isOpen() && !partial.open(QFile::ReadWrite)) {
+        qWarning() << Q_FUNC_INFO << partial.errorString();
+        q->setRunning(false);
+        emit q->failed(0);
+        return;
+    }
+    partial.resize(offset);
+    partial.seek(offset);
+    journaled = offset;
+    block.clear();
+
+    // a resume knows the version it wants, whatever other downloads or devices on this machine fetched of it is
+    // taken from the block cache, a 416 tells once that was all of it
+    if (!eTag.isEmpty()) {
+        while (offset % blockSize == 0) {
+            QByteArray data = QS3BlockCache::instance().read(bucket, key, eTag, blockSize, offset / blockSize);
+            if (data.isEmpty() || partial.write(data) != data.size()) break;
+            offset += data.size();
+            if (data.size() < blockSize) break;
+        }
+        if (offset != journaled) {
+            partial.flush();
+            writeJournal();
+        }
+    }
+    q->setBytesReceived(offset);
+
+    QNetworkRequest request(account->url(bucket, key));
+    request.setRawHeader("Accept-Encoding", "identity");
+    if (offset > 0) {
+        request.setRawHeader("Range", QByteArray("bytes=") + QByteArray::number(offset) + "-");
+        request.setRawHeader("If-Match", eTag);
+    }
+
+    begun = false;
+    QS3NetworkAccessManager &networkAccessManager = QS3NetworkAccessManager::instance();
+    reply = networkAccessManager.send(account, request, QNetworkAccessManager::GetOperation);
+    // the body is read through the account's bandwidth limits, so finish only once it is drained
+    device = networkAccessManager.throttled(reply, account);
+    connect(device, &QIODevice::readyRead, [this]() {
+        if (!begun)
+            begin();
+        write();
+    });
+    connect(device, &QIODevice::readChannelFinished, [this]() {
+        finished();
+    });
+}
+
+void QS3Download::Private::begin()
+{
+    begun = true;
+    int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    switch (httpStatusCode) {
+    case 200:
+        offset = 0;
+        block.clear();
+        partial.resize(0);
+        partial.seek(0);
+        q->setBytesTotal(reply->header(QNetworkRequest::ContentLengthHeader).toLongLong());
+        break;
+    case 206: {
+        QByteArray contentRange = reply->rawHeader("Content-Range");
+        q->setBytesTotal(contentRange.mid(contentRange.lastIndexOf('/') + 1).toLongLong());
+        break; }
+    default:
+        return;
+    }
+    eTag = reply->rawHeader("ETag");
+    lastModified = reply->rawHeader("Last-Modified");
+    writeJournal();
+}
+
+void QS3Download::Private::write()
+{
+    QByteArray data = device->readAll();
+    int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (httpStatusCode != 200 && httpStatusCode != 206) return;
+
+    if (partial.write(data) != data.size()) {
+        reply->abort();
+        return;
+    }
+    cache(data);
+    offset += data.size();
+    q->setBytesReceived(offset);
+    if (offset - journaled >= 4 * 1024 * 1024) {
+        partial.flush();
+        writeJournal();
+    }
+}
+
+void QS3Download::Private::cache(const QByteArray &data)
+{
+    if (eTag.isEmpty()) return;
+    qint64 position = offset;
+    int i = 0;
+    while (i < data.size()) {
+        if (block.isEmpty() && (position + i) % blockSize != 0) {
+            // a resume starts in the middle of a block, that one is left out
+            i += qMin<qint64>(data.size() - i, blockSize - (position + i) % blockSize);
+            continue;
+        }
+        int length = qMin<qint64>(data.size() - i, blockSize - block.size());
+        block.append(data.constData() + i, length);
+        i += length;
+        if (block.size() == blockSize) {
+            QS3BlockCache::instance().write(bucket, key, eTag, blockSize, (position + i - 1) / blockSize, block);
+            block.clear();
+        }
+    }
+}
+
+void QS3Download::Private::finished()
+{
+    QNetworkReply *reply = this->reply;
+    reply->deleteLater();
+    if (!begun)
+        begin();
+
+    int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    switch (httpStatusCode) {
+    case 416: {
+        // nothing left after offset, the last run got all bytes but stopped before the rename
+        QByteArray contentRange = reply->rawHeader("Content-Range");
+        if (offset > 0 && contentRange.startsWith("bytes */") && contentRange.mid(8).trimmed().toLongLong() == offset) {
+            this->reply = 0;
+            q->setBytesTotal(offset);
+            complete(httpStatusCode);
+            return;
+        }
+        }
+        // fall through
+    case 412:
+        // the object changed since the partial download started
+        offset = 0;
+        eTag.clear();
+        lastModified.clear();
+        QFile::remove(journalName());
+        request();
+        return;
+    case 200:
+    case 206:
+        if (reply->error() == QNetworkReply::NoError) {
+            write();
+            // the body ended, so what is left is the short last block
+            if (!block.isEmpty() && !eTag.isEmpty())
+                QS3BlockCache::instance().write(bucket, key, eTag, blockSize, (offset - block.size()) / blockSize, block);
+            block.clear();
+            this->reply = 0;
+            complete(httpStatusCode);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    this->reply = 0;
+    partial.flush();
+    if (offset > 0)
+        writeJournal();
+    partial.close();
+    q->setRunning(false);
+    emit q->failed(httpStatusCode);
+}
+
+void QS3Download::Private::complete(int httpStatusCode)
+{
+    partial.close();
+    QFile::remove(fileName);
+    if (!partial.rename(fileName)) {
+        qWarning() << Q_FUNC_INFO << partial.errorString();
+        q->setRunning(false);
+        emit q->failed(httpStatusCode);
+        return;
+    }
+    QFile::remove(journalName());
+    q->setRunning(false);
+    emit q->finished();
+}
+
+QS3Download::QS3Download(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3Download::destroyed, [d]() { delete d; });
+}
+
+QAccount *QS3Download::account() const
+{
+    return d->account;
+}
+
+void QS3Download::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    d->account = account;
+    emit accountChanged(account);
+}
+
+const QString &QS3Download::bucket() const
+{
+    return d->bucket;
+}
+
+void QS3Download::setBucket(const QString &bucket)
+{
+    if (d->bucket == bucket) return;
+    d->bucket = bucket;
+    emit bucketChanged(bucket);
+}
+
+const QString &QS3Download::key() const
+{
+    return d->key;
+}
+
+void QS3Download::setKey(const QString &key)
+{
+    if (d->key == key) return;
+    d->key = key;
+    emit keyChanged(key);
+}
+
+const QString &QS3Download::fileName() const
+{
+    return d->fileName;
+}
+
+void QS3Download::setFileName(const QString &fileName)
+{
+    if (d->fileName == fileName) return;
+    d->fileName = fileName;
+    emit fileNameChanged(fileName);
+}
+
+bool QS3Download::running() const
+{
+    return d->running;
+}
+
+void QS3Download::setRunning(bool running)
+{
+    if (d->running == running) return;
+    d->running = running;
+    emit runningChanged(running);
+}
+
+qint64 QS3Download::bytesReceived() const
+{
+    return d->bytesReceived;
+}
+
+void QS3Download::setBytesReceived(qint64 bytesReceived)
+{
+    if (d->bytesReceived == bytesReceived) return;
+    d->bytesReceived = bytesReceived;
+    emit bytesReceivedChanged(bytesReceived);
+}
+
+qint64 QS3Download::bytesTotal() const
+{
+    return d->bytesTotal;
+}
+
+void QS3Download::setBytesTotal(qint64 bytesTotal)
+{
+    if (d->bytesTotal == bytesTotal) return;
+    d->bytesTotal = bytesTotal;
+    emit bytesTotalChanged(bytesTotal);
+}
+
+void QS3Download::start()
+{
+    if (d->running) return;
+    if (!d->account) return;
+    if (d->bucket.isEmpty() || d->key.isEmpty() || d->fileName.isEmpty()) return;
+
+    setRunning(true);
+    d->offset = 0;
+    d->eTag.clear();
+    d->lastModified.clear();
+    d->partial.setFileName(d->fileName + QStringLiteral(".part"));
+    d->readJournal();
+    d->request();
+}
+
+void QS3Download::abort()
+{
+    if (!d->reply) return;
+    d->reply->abort();
+}
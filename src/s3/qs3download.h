@@ -0,0 +1,88 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3DOWNLOAD_H
+#define QS3DOWNLOAD_H
+
+#include "s3_global.h"
+
+#include <QtCore/QObject>
+
+class QAccount;
+
+class S3_EXPORT QS3Download : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QAccount *account READ account WRITE setAccount NOTIFY accountChanged)
+    Q_PROPERTY(QString bucket READ bucket WRITE setBucket NOTIFY bucketChanged)
+    Q_PROPERTY(QString key READ key WRITE setKey NOTIFY keyChanged)
+    Q_PROPERTY(QString fileName READ fileName WRITE setFileName NOTIFY fileNameChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(qint64 bytesReceived READ bytesReceived NOTIFY bytesReceivedChanged)
+    Q_PROPERTY(qint64 bytesTotal READ bytesTotal NOTIFY bytesTotalChanged)
+public:
+    explicit QS3Download(QObject *parent = 0);
+
+    QAccount *account() const;
+    const QString &bucket() const;
+    const QString &key() const;
+    const QString &fileName() const;
+    bool running() const;
+    qint64 bytesReceived() const;
+    qint64 bytesTotal() const;
+
+public slots:
+    void setAccount(QAccount *account);
+    void setBucket(const QString &bucket);
+    void setKey(const QString &key);
+    void setFileName(const QString &fileName);
+
+    void start();
+    void abort();
+
+private slots:
+    void setRunning(bool running);
+    void setBytesReceived(qint64 bytesReceived);
+    void setBytesTotal(qint64 bytesTotal);
+
+signals:
+    void accountChanged(QAccount *account);
+    void bucketChanged(const QString &bucket);
+    void keyChanged(const QString &key);
+    void fileNameChanged(const QString &fileName);
+    void runningChanged(bool running);
+    void bytesReceivedChanged(qint64 bytesReceived);
+    void bytesTotalChanged(qint64 bytesTotal);
+
+    void failed(int httpStatusCode);
+    void finished();
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3DOWNLOAD_H
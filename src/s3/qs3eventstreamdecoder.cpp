@@ -0,0 +1,205 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3eventstreamdecoder.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QtEndian>
+#include <QtCore/QUuid>
+
+#include <zlib.h>
+
+// total length, headers length, prelude crc
+static const int preludeLength = 12;
+// far above what S3 sends, a corrupt prelude must not make us buffer gigabytes
+static const quint32 maximumMessageLength = 16 * 1024 * 1024;
+
+enum HeaderType {
+    BoolTrue,
+    BoolFalse,
+    Byte,
+    Short,
+    Integer,
+    Long,
+    ByteArray,
+    String,
+    Timestamp,
+    Uuid
+};
+
+static quint32 crc(const char *data, int length)
+{
+    return crc32(0, reinterpret_cast<const Bytef *>(data), length);
+}
+
+static bool parseHeaders(const char *data, int length, QVariantMap *headers)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + length;
+    while (p < end) {
+        int nameLength = *p++;
+        if (end - p < nameLength + 1) return false;
+        QString name = QString::fromUtf8(reinterpret_cast<const char *>(p), nameLength);
+        p += nameLength;
+
+        QVariant value;
+        int type = *p++;
+        switch (type) {
+        case BoolTrue:
+            value = true;
+            break;
+        case BoolFalse:
+            value = false;
+            break;
+        case Byte:
+            if (end - p < 1) return false;
+            value = static_cast<qint8>(*p);
+            p += 1;
+            break;
+        case Short:
+            if (end - p < 2) return false;
+            value = qFromBigEndian<qint16>(p);
+            p += 2;
+            break;
+        case Integer:
+            if (end - p < 4) return false;
+            value = qFromBigEndian<qint32>(p);
+            p += 4;
+            break;
+        case Long:
+            if (end - p < 8) return false;
+            value = qFromBigEndian<qint64>(p);
+            p += 8;
+            break;
+        case ByteArray:
+        case String: {
+            if (end - p < 2) return false;
+            int size = qFromBigEndian<quint16>(p);
+            p += 2;
+            if (end - p < size) return false;
+            QByteArray bytes(reinterpret_cast<const char *>(p), size);
+            value = type == String ? QVariant(QString::fromUtf8(bytes)) : QVariant(bytes);
+            p += size;
+            break; }
+        case Timestamp:
+            if (end - p < 8) return false;
+            value = QDateTime::fromMSecsSinceEpoch(qFromBigEndian<qint64>(p), Qt::UTC);
+            p += 8;
+            break;
+        case Uuid:
+            if (end - p < 16) return false;
+            value = QUuid::fromRfc4122(QByteArray(reinterpret_cast<const char *>(p), 16));
+            p += 16;
+            break;
+        default:
+            return false;
+        }
+        headers->insert(name, value);
+    }
+    return true;
+}
+
+QS3EventStreamDecoder::QS3EventStreamDecoder()
+{
+}
+
+void QS3EventStreamDecoder::feed(const QByteArray &data)
+{
+    buffer.append(data);
+}
+
+bool QS3EventStreamDecoder::next(Message *message)
+{
+    if (!error.isEmpty() || buffer.size() < preludeLength) return false;
+
+    const uchar *prelude = reinterpret_cast<const uchar *>(buffer.constData());
+    quint32 totalLength = qFromBigEndian<quint32>(prelude);
+    quint32 headersLength = qFromBigEndian<quint32>(prelude + 4);
+    if (qFromBigEndian<quint32>(prelude + 8) != crc(buffer.constData(), 8)) {
+        error = QStringLiteral("prelude checksum mismatch");
+        return false;
+    }
+    // compared without adding, a huge headers length would wrap around
+    if (totalLength > maximumMessageLength || totalLength < preludeLength + 4 || headersLength > totalLength - preludeLength - 4) {
+        error = QStringLiteral("invalid message length");
+        return false;
+    }
+    // wait for the rest of the message
+    if (static_cast<quint32>(buffer.size()) < totalLength) return false;
+
+    if (qFromBigEndian<quint32>(prelude + totalLength - 4) != crc(buffer.constData(), totalLength - 4)) {
+        error = QStringLiteral("message checksum mismatch");
+        return false;
+    }
+
+    message->headers.clear();
+    if (!parseHeaders(buffer.constData() + preludeLength, headersLength, &message->headers)) {
+        error = QStringLiteral("malformed headers");
+        return false;
+    }
+    message->payload = buffer.mid(preludeLength + headersLength, totalLength - preludeLength - headersLength - 4);
+    buffer.remove(0, totalLength);
+    return true;
+}
+
+bool QS3EventStreamDecoder::hasError() const
+{
+    return !error.isEmpty();
+}
+
+QString QS3EventStreamDecoder::errorString() const
+{
+    return error;
+}
+
+QByteArray QS3EventStreamDecoder::encode(const QVariantMap &headers, const QByteArray &payload)
+{
+    // string headers only, which is all S3 sends
+    QByteArray encodedHeaders;
+    foreach (const QString &name, headers.keys()) {
+        QByteArray encodedName = name.toUtf8();
+        QByteArray value = headers.value(name).toString().toUtf8();
+        encodedHeaders.append(static_cast<char>(encodedName.size()));
+        encodedHeaders.append(encodedName);
+        encodedHeaders.append(static_cast<char>(String));
+        encodedHeaders.append(static_cast<char>(value.size() >> 8));
+        encodedHeaders.append(static_cast<char>(value.size() & 0xff));
+        encodedHeaders.append(value);
+    }
+
+    QByteArray ret(preludeLength, Qt::Uninitialized);
+    uchar *prelude = reinterpret_cast<uchar *>(ret.data());
+    qToBigEndian<quint32>(preludeLength + encodedHeaders.size() + payload.size() + 4, prelude);
+    qToBigEndian<quint32>(encodedHeaders.size(), prelude + 4);
+    qToBigEndian<quint32>(crc(ret.constData(), 8), prelude + 8);
+    ret.append(encodedHeaders);
+    ret.append(payload);
+
+    QByteArray checksum(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(crc(ret.constData(), ret.size()), reinterpret_cast<uchar *>(checksum.data()));
+    ret.append(checksum);
+    return ret;
+}
@@ -0,0 +1,498 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3federatedmodel.h"
+
+#include "qaccount.h"
+#include "qs3listbucketresult.h"
+#include "qs3metrics.h"
+#include "qs3networkaccessmanager.h"
+#include "qs3trace.h"
+
+#include <QtCore/QCache>
+#include <QtCore/QDateTime>
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+#include <QtCore/QUrlQuery>
+#include <QtNetwork/QNetworkReply>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+class QS3FederatedModel::Private
+{
+public:
+    struct Listing {
+        QList<QVariantMap> rows;
+        QDateTime loaded;
+    };
+
+    struct Source {
+        int index;
+        QPointer<QAccount> account;
+        QString bucket;
+        QString prefix;
+        QString delimiter;
+        QString cacheKey;
+
+        // listed in key order, merged from consumed on
+        QList<QVariantMap> rows;
+        int consumed;
+        bool complete;
+        QString marker;
+        int attempts;
+    };
+
+    struct Head {
+        QString key;
+        int source;
+        bool operator>(const Head &other) const {
+            if (key != other.key) return key > other.key;
+            return source > other.source;
+        }
+    };
+
+    struct Row {
+        int source;
+        int row;
+    };
+
+    Private(QS3FederatedModel *parent);
+
+    void pump();
+    void list(int source);
+    void send(int source, const QNetworkRequest &request);
+    void received(int source, const QS3ListBucketResult &result);
+    void retry(int source, int httpStatusCode);
+    void drop(int source);
+    void push(int source);
+    void merge();
+    void abort();
+
+private:
+    QS3FederatedModel *q;
+
+public:
+    static QHash<int, QByteArray> roleNames;
+    static QCache<QString, Listing> cache;
+    QVariantList sources;
+    int concurrency;
+    int maxAge;
+    bool loading;
+
+    QVector<Source> loaded;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heads;
+    QVector<Row> rows;
+
+    QList<int> queue;
+    QList<QNetworkReply *> replies;
+    // sources sitting out their backoff, neither queued nor in flight
+    int waiting;
+    int generation;
+    QTimer timer;
+};
+
+QHash<int, QByteArray> QS3FederatedModel::Private::roleNames;
+// cost is one per row
+QCache<QString, QS3FederatedModel::Private::Listing> QS3FederatedModel::Private::cache(1000000);
+
+QS3FederatedModel::Private::Private(QS3FederatedModel *parent)
+    : q(parent)
+    , concurrency(8)
+    , maxAge(300)
+    , loading(false)
+    , waiting(0)
+    , generation(0)
+{
+    timer.setInterval(0);
+    timer.setSingleShot(true);
+    connect(&timer, &QTimer::timeout, parent, &QS3FederatedModel::load);
+
+    connect(parent, &QS3FederatedModel::sourcesChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(&QS3NetworkAccessManager::instance(), &QS3NetworkAccessManager::windowAvailable, parent, [this]() {
+        if (!queue.isEmpty())
+            pump();
+    });
+}
+
+void QS3FederatedModel::Private::pump()
+{
+    // one budget for all sources, continuations queue up behind the other sources
+    while (replies.count() < concurrency && !queue.isEmpty()) {
+        const Source &source = loaded.at(queue.first());
+        // the account went away while the source waited for its turn
+        if (!source.account) {
+            drop(queue.takeFirst());
+            continue;
+        }
+        if (QS3NetworkAccessManager::instance().isSaturated(source.account->url(source.bucket))) break;
+        list(queue.takeFirst());
+    }
+    if (replies.isEmpty() && queue.isEmpty() && waiting == 0)
+        q->setLoading(false);
+}
+
+void QS3FederatedModel::Private::list(int source)
+{
+    const Source &s = loaded.at(source);
+    QUrl url = s.account->url(s.bucket);
+    QUrlQuery query;
+    if (!s.delimiter.isEmpty())
+        query.addQueryItem(QStringLiteral("delimiter"), QString::fromLatin1(QUrl::toPercentEncoding(s.delimiter)));
+    if (!s.marker.isEmpty())
+        query.addQueryItem(QStringLiteral("marker"), QString::fromLatin1(QUrl::toPercentEncoding(s.marker)));
+    query.addQueryItem(QStringLiteral("max-keys"), QStringLiteral("1000"));
+    if (!s.prefix.isEmpty())
+        query.addQueryItem(QStringLiteral("prefix"), QString::fromLatin1(QUrl::toPercentEncoding(s.prefix)));
+    url.setQuery(query);
+
+    QNetworkRequest request(url);
+    request.setPriority(QNetworkRequest::HighPriority);
+    send(source, request);
+}
+
+void QS3FederatedModel::Private::send(int source, const QNetworkRequest &request)
+{
+    int generation = this->generation;
+    auto track = [this](QNetworkReply *reply, bool inFlight) {
+        if (inFlight)
+            replies.append(reply);
+        else
+            replies.removeOne(reply);
+    };
+    QS3NetworkAccessManager::instance().follow(loaded.at(source).account, request, QNetworkAccessManager::GetOperation, QByteArray(), q, track, [this, source, generation](QNetworkReply *reply) {
+        if (generation != this->generation) return;
+
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode == 200) {
+            QS3ListBucketResult result;
+            if (result.read(reply)) {
+                received(source, result);
+                return;
+            }
+        }
+        retry(source, httpStatusCode);
+    });
+}
+
+static bool keyLessThan(const QVariantMap &left, const QVariantMap &right)
+{
+    return left.value(QStringLiteral("key")).toString() < right.value(QStringLiteral("key")).toString();
+}
+
+void QS3FederatedModel::Private::received(int source, const QS3ListBucketResult &result)
+{
+    Source &s = loaded[source];
+    s.attempts = 0;
+
+    // contents and common prefixes are each in order, a page needs them interleaved
+    QList<QVariantMap> page = result.contents;
+    if (!result.commonPrefixes.isEmpty()) {
+        page.append(result.commonPrefixes);
+        std::sort(page.begin(), page.end(), keyLessThan);
+    }
+    bool buffered = s.consumed < s.rows.count();
+    s.rows.append(page);
+    if (!buffered)
+        push(source);
+
+    if (result.truncated.toBool() && !page.isEmpty()) {
+        s.marker = result.nextMarker.isValid() ? result.nextMarker.toString() : page.last().value(QStringLiteral("key")).toString();
+        queue.append(source);
+    } else {
+        s.complete = true;
+        Listing *listing = new Listing;
+        listing->rows = s.rows;
+        listing->loaded = QDateTime::currentDateTimeUtc();
+        cache.insert(s.cacheKey, listing, qMax(1, s.rows.count()));
+    }
+    merge();
+    pump();
+}
+
+void QS3FederatedModel::Private::retry(int source, int httpStatusCode)
+{
+    Source &s = loaded[source];
+    if (++s.attempts < 3) {
+        QS3Metrics::instance().increment(QS3Metrics::Retries);
+        // 500 ms, then 1 s, the other sources keep the budget meanwhile
+        int generation = this->generation;
+        waiting++;
+        QTimer::singleShot(250 << s.attempts, q, [this, source, generation]() {
+            if (generation != this->generation) return;
+            waiting--;
+            queue.append(source);
+            pump();
+        });
+    } else {
+        emit q->failed(httpStatusCode);
+        drop(source);
+    }
+    pump();
+}
+
+void QS3FederatedModel::Private::drop(int source)
+{
+    // a source that cannot be listed any further must not hold back the merge of the others
+    loaded[source].complete = true;
+    merge();
+}
+
+void QS3FederatedModel::Private::push(int source)
+{
+    const Source &s = loaded.at(source);
+    if (s.consumed >= s.rows.count()) return;
+    Head head;
+    head.key = s.rows.at(s.consumed).value(QStringLiteral("key")).toString();
+    head.source = source;
+    heads.push(head);
+}
+
+void QS3FederatedModel::Private::merge()
+{
+    QS3_TRACE_SCOPE("federated", "merge");
+    // a source still listing only ever adds keys after its last one, anything up to the lowest of those is final
+    bool bounded = false;
+    QString watermark;
+    for (int i = 0; i < loaded.count(); i++) {
+        const Source &s = loaded.at(i);
+        if (s.complete || s.consumed < s.rows.count()) continue;
+        if (s.rows.isEmpty()) return;
+        QString last = s.rows.last().value(QStringLiteral("key")).toString();
+        if (!bounded || last < watermark)
+            watermark = last;
+        bounded = true;
+    }
+
+    QVector<Row> merged;
+    while (!heads.empty()) {
+        Head head = heads.top();
+        if (bounded && watermark < head.key) break;
+        heads.pop();
+        Source &s = loaded[head.source];
+        Row row;
+        row.source = head.source;
+        row.row = s.consumed++;
+        merged.append(row);
+        if (s.consumed < s.rows.count()) {
+            push(head.source);
+        } else if (!s.complete) {
+            // its next page decides where the merge may go on
+            QString last = s.rows.last().value(QStringLiteral("key")).toString();
+            if (!bounded || last < watermark)
+                watermark = last;
+            bounded = true;
+        }
+    }
+    if (merged.isEmpty()) return;
+
+    q->beginInsertRows(QModelIndex(), rows.count(), rows.count() + merged.count() - 1);
+    rows += merged;
+    q->endInsertRows();
+    emit q->countChanged(rows.count());
+}
+
+void QS3FederatedModel::Private::abort()
+{
+    generation++;
+    foreach (QNetworkReply *reply, replies) {
+        disconnect(reply, 0, q, 0);
+        reply->abort();
+        reply->deleteLater();
+    }
+    replies.clear();
+    queue.clear();
+    waiting = 0;
+}
+
+QS3FederatedModel::QS3FederatedModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3FederatedModel::destroyed, [d]() { delete d; });
+}
+
+int QS3FederatedModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return d->rows.count();
+}
+
+QVariant QS3FederatedModel::data(const QModelIndex &index, int role) const
+{
+    int row = index.row();
+    if (row < 0 || row >= d->rows.count()) return QVariant();
+    const Private::Row &r = d->rows.at(row);
+    const Private::Source &source = d->loaded.at(r.source);
+    switch (role - Qt::UserRole) {
+    case 0:
+        return source.index;
+    case 1:
+        return QVariant::fromValue<QObject *>(source.account.data());
+    case 2:
+        return source.bucket;
+    default:
+        break;
+    }
+    return source.rows.at(r.row).value(QString::fromUtf8(roleNames().value(role)));
+}
+
+QHash<int, QByteArray> QS3FederatedModel::roleNames() const
+{
+    if (d->roleNames.isEmpty()) {
+        int role = Qt::UserRole;
+        d->roleNames.insert(role++, "source");
+        d->roleNames.insert(role++, "account");
+        d->roleNames.insert(role++, "bucket");
+        d->roleNames.insert(role++, "key");
+        d->roleNames.insert(role++, "lastModified");
+        d->roleNames.insert(role++, "eTag");
+        d->roleNames.insert(role++, "size");
+        d->roleNames.insert(role++, "storageClass");
+        d->roleNames.insert(role++, "owner");
+    }
+    return d->roleNames;
+}
+
+const QVariantList &QS3FederatedModel::sources() const
+{
+    return d->sources;
+}
+
+void QS3FederatedModel::setSources(const QVariantList &sources)
+{
+    if (d->sources == sources) return;
+    d->sources = sources;
+    emit sourcesChanged(sources);
+}
+
+int QS3FederatedModel::concurrency() const
+{
+    return d->concurrency;
+}
+
+void QS3FederatedModel::setConcurrency(int concurrency)
+{
+    if (d->concurrency == concurrency) return;
+    d->concurrency = concurrency;
+    emit concurrencyChanged(concurrency);
+    d->pump();
+}
+
+int QS3FederatedModel::maxAge() const
+{
+    return d->maxAge;
+}
+
+void QS3FederatedModel::setMaxAge(int maxAge)
+{
+    if (d->maxAge == maxAge) return;
+    d->maxAge = maxAge;
+    emit maxAgeChanged(maxAge);
+}
+
+bool QS3FederatedModel::loading() const
+{
+    return d->loading;
+}
+
+void QS3FederatedModel::setLoading(bool loading)
+{
+    if (d->loading == loading) return;
+    d->loading = loading;
+    emit loadingChanged(loading);
+}
+
+int QS3FederatedModel::count() const
+{
+    return d->rows.count();
+}
+
+QVariantMap QS3FederatedModel::get(int i) const
+{
+    QVariantMap ret;
+    if (i < 0 || i >= d->rows.count()) return ret;
+    QHash<int, QByteArray> roleNames = this->roleNames();
+    foreach (int role, roleNames.keys())
+        ret.insert(QString::fromUtf8(roleNames.value(role)), data(index(i), role));
+    return ret;
+}
+
+void QS3FederatedModel::load()
+{
+    d->abort();
+    beginResetModel();
+    d->loaded.clear();
+    d->heads = std::priority_queue<Private::Head, std::vector<Private::Head>, std::greater<Private::Head> >();
+    d->rows.clear();
+
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    for (int i = 0; i < d->sources.count(); i++) {
+        QVariantMap map = d->sources.at(i).toMap();
+        Private::Source source;
+        source.index = i;
+        source.account = qobject_cast<QAccount *>(map.value(QStringLiteral("account")).value<QObject *>());
+        if (!source.account)
+            source.account = QAccount::defaultAccount();
+        source.bucket = map.value(QStringLiteral("bucket")).toString();
+        source.prefix = map.value(QStringLiteral("prefix")).toString();
+        source.delimiter = map.value(QStringLiteral("delimiter")).toString();
+        source.consumed = 0;
+        source.complete = false;
+        source.attempts = 0;
+        if (!source.account || source.bucket.isEmpty()) continue;
+        // keyed by who is asking, not by the QML object that happens to hold the credentials
+        source.cacheKey = (QStringList()
+                << QString::fromLatin1(source.account->awsAccessKeyId())
+                << source.account->endpoint().toString()
+                << source.bucket << source.prefix << source.delimiter).join(QLatin1Char('\n'));
+
+        Private::Listing *listing = d->cache.object(source.cacheKey);
+        if (listing && listing->loaded.secsTo(now) < d->maxAge) {
+            source.rows = listing->rows;
+            source.complete = true;
+        }
+        d->loaded.append(source);
+        if (source.complete)
+            d->push(d->loaded.count() - 1);
+        else
+            d->queue.append(d->loaded.count() - 1);
+    }
+    endResetModel();
+    emit countChanged(0);
+
+    setLoading(!d->queue.isEmpty());
+    d->merge();
+    d->pump();
+}
+
+void QS3FederatedModel::reload()
+{
+    foreach (const Private::Source &source, d->loaded)
+        d->cache.remove(source.cacheKey);
+    load();
+}
@@ -0,0 +1,176 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3filesource.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QFile>
+#include <QtCore/QPair>
+#include <QtConcurrent/QtConcurrentMap>
+
+typedef QPair<qint64, qint64> Part;
+
+struct Digest
+{
+    typedef QByteArray result_type;
+
+    Digest(const QString &fileName, const uchar *map, qint64 offset)
+        : fileName(fileName)
+        , map(map)
+        , offset(offset)
+    {
+    }
+
+    QByteArray operator()(const Part &part) const
+    {
+        QCryptographicHash md5(QCryptographicHash::Md5);
+        if (map) {
+            const qint64 chunk = 1 << 30;
+            for (qint64 i = 0; i < part.second; i += chunk)
+                md5.addData(reinterpret_cast<const char *>(map + part.first + i), qMin(chunk, part.second - i));
+        } else {
+            QFile file(fileName);
+            if (!file.open(QFile::ReadOnly) || !file.seek(offset + part.first))
+                return QByteArray();
+            QByteArray buffer;
+            for (qint64 left = part.second; left > 0; left -= buffer.size()) {
+                buffer = file.read(qMin<qint64>(left, 1 << 20));
+                if (buffer.isEmpty())
+                    return QByteArray();
+                md5.addData(buffer);
+            }
+        }
+        return md5.result();
+    }
+
+    QString fileName;
+    const uchar *map;
+    qint64 offset;
+};
+
+class QS3FileSource::Private
+{
+public:
+    Private(const QString &fileName, qint64 offset, qint64 length);
+
+    QFile file;
+    qint64 offset;
+    qint64 length;
+    uchar *map;
+};
+
+QS3FileSource::Private::Private(const QString &fileName, qint64 offset, qint64 length)
+    : file(fileName)
+    , offset(offset)
+    , length(length)
+    , map(0)
+{
+}
+
+QS3FileSource::QS3FileSource(const QString &fileName, QObject *parent)
+    : QIODevice(parent)
+    , d(new Private(fileName, 0, -1))
+{
+    connect(this, &QS3FileSource::destroyed, [d]() { delete d; });
+}
+
+QS3FileSource::QS3FileSource(const QString &fileName, qint64 offset, qint64 length, QObject *parent)
+    : QIODevice(parent)
+    , d(new Private(fileName, offset, length))
+{
+    connect(this, &QS3FileSource::destroyed, [d]() { delete d; });
+}
+
+bool QS3FileSource::open(OpenMode mode)
+{
+    if (mode & WriteOnly) return false;
+    if (!d->file.open(QFile::ReadOnly)) return false;
+
+    qint64 available = qMax<qint64>(0, d->file.size() - d->offset);
+    if (d->length < 0 || d->length > available)
+        d->length = available;
+    if (d->length > 0)
+        d->map = d->file.map(d->offset, d->length);
+    return QIODevice::open(mode);
+}
+
+void QS3FileSource::close()
+{
+    QIODevice::close();
+    if (d->map) {
+        d->file.unmap(d->map);
+        d->map = 0;
+    }
+    d->file.close();
+}
+
+qint64 QS3FileSource::size() const
+{
+    return qMax<qint64>(0, d->length);
+}
+
+bool QS3FileSource::isMapped() const
+{
+    return d->map;
+}
+
+QByteArray QS3FileSource::mapped() const
+{
+    if (!d->map) return QByteArray();
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(d->map), d->length);
+}
+
+QByteArray QS3FileSource::md5() const
+{
+    return Digest(d->file.fileName(), d->map, d->offset)(Part(0, size()));
+}
+
+QList<QByteArray> QS3FileSource::md5(qint64 partSize) const
+{
+    QList<Part> parts;
+    for (qint64 offset = 0; offset < size(); offset += partSize)
+        parts.append(Part(offset, qMin(partSize, size() - offset)));
+    return QtConcurrent::blockingMapped<QList<QByteArray> >(parts, Digest(d->file.fileName(), d->map, d->offset));
+}
+
+qint64 QS3FileSource::readData(char *data, qint64 maxSize)
+{
+    qint64 length = qMin(maxSize, size() - pos());
+    if (length <= 0) return 0;
+    if (d->map) {
+        memcpy(data, d->map + pos(), length);
+        return length;
+    }
+    if (!d->file.seek(d->offset + pos())) return -1;
+    return d->file.read(data, length);
+}
+
+qint64 QS3FileSource::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+}
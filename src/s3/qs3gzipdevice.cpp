@@ -0,0 +1,232 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3gzipdevice.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtNetwork/QNetworkReply>
+
+#include <zlib.h>
+
+class QS3GzipDevice::Private
+{
+public:
+    Private(QS3GzipDevice *parent, QIODevice *source, Mode mode);
+    ~Private();
+
+    void decode();
+    void fail(const QString &message);
+    void finish();
+
+private:
+    QS3GzipDevice *q;
+
+public:
+    QIODevice *source;
+    Mode mode;
+    bool detected;
+    bool passthrough;
+    // inside a gzip member, the source ending here would cut it short
+    bool inMember;
+    bool finished;
+    bool failed;
+    z_stream stream;
+    QByteArray buffer;
+};
+
+QS3GzipDevice::Private::Private(QS3GzipDevice *parent, QIODevice *source, Mode mode)
+    : q(parent)
+    , source(source)
+    , mode(mode)
+    , detected(false)
+    , passthrough(false)
+    , inMember(false)
+    , finished(false)
+    , failed(false)
+{
+    memset(&stream, 0, sizeof(stream));
+    inflateInit2(&stream, 15 + 32);
+}
+
+QS3GzipDevice::Private::~Private()
+{
+    inflateEnd(&stream);
+}
+
+void QS3GzipDevice::Private::decode()
+{
+    QByteArray input = source->readAll();
+    // after an error the rest of the source is read and dropped
+    if (input.isEmpty() || failed) return;
+
+    if (!detected) {
+        QNetworkReply *reply = qobject_cast<QNetworkReply *>(source);
+        // a throttled reply is a child of the reply it reads from
+        if (!reply)
+            reply = qobject_cast<QNetworkReply *>(source->parent());
+        if (mode == Auto && reply)
+            passthrough = !reply->rawHeader("Content-Encoding").toLower().contains("gzip");
+        detected = true;
+    }
+    if (passthrough) {
+        buffer.append(input);
+        return;
+    }
+
+    char output[65536];
+    stream.next_in = reinterpret_cast<Bytef *>(input.data());
+    stream.avail_in = input.size();
+    while (stream.avail_in > 0) {
+        stream.next_out = reinterpret_cast<Bytef *>(output);
+        stream.avail_out = sizeof(output);
+        int ret = inflate(&stream, Z_NO_FLUSH);
+        buffer.append(output, sizeof(output) - stream.avail_out);
+        if (ret == Z_STREAM_END) {
+            // concatenated gzip members
+            inMember = false;
+            inflateReset(&stream);
+        } else if (ret == Z_OK) {
+            inMember = true;
+        } else if (ret != Z_BUF_ERROR) {
+            fail(QString::fromLatin1(stream.msg ? stream.msg : "inflate failed"));
+            break;
+        } else {
+            break;
+        }
+    }
+}
+
+void QS3GzipDevice::Private::fail(const QString &message)
+{
+    failed = true;
+    q->setErrorString(message);
+}
+
+void QS3GzipDevice::Private::finish()
+{
+    if (finished) return;
+    qint64 available = buffer.size();
+    decode();
+    if (!passthrough && inMember && !failed)
+        fail(QStringLiteral("Unexpected end of gzip stream"));
+    finished = true;
+    if (buffer.size() > available)
+        emit q->readyRead();
+    emit q->readChannelFinished();
+}
+
+QS3GzipDevice::QS3GzipDevice(QIODevice *source, Mode mode, QObject *parent)
+    : QIODevice(parent)
+    , d(new Private(this, source, mode))
+{
+    connect(this, &QS3GzipDevice::destroyed, [d]() { delete d; });
+    connect(source, &QIODevice::readyRead, this, [this]() {
+        qint64 available = d->buffer.size();
+        d->decode();
+        if (d->buffer.size() > available)
+            emit readyRead();
+        // an inflate error ends the stream here, whatever the source still has
+        if (d->failed)
+            d->finish();
+    });
+    connect(source, &QIODevice::readChannelFinished, this, [this]() { d->finish(); });
+    open(ReadOnly);
+}
+
+bool QS3GzipDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 QS3GzipDevice::bytesAvailable() const
+{
+    return d->buffer.size() + QIODevice::bytesAvailable();
+}
+
+bool QS3GzipDevice::atEnd() const
+{
+    // an empty buffer only means the next bytes have not arrived yet
+    return d->finished && bytesAvailable() == 0;
+}
+
+bool QS3GzipDevice::hasError() const
+{
+    return d->failed;
+}
+
+qint64 QS3GzipDevice::readData(char *data, qint64 maxSize)
+{
+    d->decode();
+    if (d->buffer.isEmpty() && d->failed)
+        return -1;
+    qint64 size = qMin<qint64>(maxSize, d->buffer.size());
+    memcpy(data, d->buffer.constData(), size);
+    d->buffer.remove(0, size);
+    return size;
+}
+
+qint64 QS3GzipDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+}
+
+bool QS3GzipDevice::compress(QIODevice *in, QIODevice *out, QByteArray *md5)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    char output[65536];
+    bool ret = true;
+    int flush = Z_NO_FLUSH;
+    while (ret && flush != Z_FINISH) {
+        QByteArray input = in->read(sizeof(output));
+        if (input.isEmpty())
+            flush = Z_FINISH;
+        stream.next_in = reinterpret_cast<Bytef *>(input.data());
+        stream.avail_in = input.size();
+        do {
+            stream.next_out = reinterpret_cast<Bytef *>(output);
+            stream.avail_out = sizeof(output);
+            deflate(&stream, flush);
+            int size = sizeof(output) - stream.avail_out;
+            if (out->write(output, size) != size) {
+                ret = false;
+                break;
+            }
+            hash.addData(output, size);
+        } while (stream.avail_out == 0);
+    }
+    deflateEnd(&stream);
+
+    if (md5)
+        *md5 = hash.result();
+    return ret;
+}
@@ -0,0 +1,536 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3inventory.h"
+#include "qs3networkaccessmanager.h"
+#include "qs3gzipdevice.h"
+#include "qs3trace.h"
+#include "qaccount.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QVector>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtNetwork/QNetworkReply>
+
+#include <algorithm>
+
+static const char *storageClasses[] = {
+    "STANDARD", "REDUCED_REDUNDANCY", "GLACIER", "STANDARD_IA", "ONEZONE_IA",
+    "INTELLIGENT_TIERING", "DEEP_ARCHIVE", "OUTPOSTS", "GLACIER_IR", 0
+};
+
+// strings live in the chunk a row was parsed into, a row only keeps offsets
+struct Row {
+    quint32 key;
+    quint32 eTag;
+    quint16 keyLength;
+    quint8 eTagLength;
+    qint8 storageClass;
+    qint64 size;
+    qint64 lastModified;
+};
+
+struct Chunk {
+    QByteArray strings;
+    QVector<Row> rows;
+};
+
+struct Schema {
+    Schema() : key(-1), size(-1), lastModified(-1), eTag(-1), storageClass(-1), columns(0) {}
+
+    int key;
+    int size;
+    int lastModified;
+    int eTag;
+    int storageClass;
+    int columns;
+};
+
+static QList<QByteArray> fields(const char *p, const char *end)
+{
+    QList<QByteArray> ret;
+    QByteArray field;
+    bool quoted = false;
+    for (; p < end; p++) {
+        if (quoted) {
+            if (*p != '"')
+                field.append(*p);
+            else if (p + 1 < end && p[1] == '"')
+                field.append(*++p);
+            else
+                quoted = false;
+        } else if (*p == '"') {
+            quoted = true;
+        } else if (*p == ',') {
+            ret.append(field);
+            field.clear();
+        } else if (*p != '\r') {
+            field.append(*p);
+        }
+    }
+    ret.append(field);
+    return ret;
+}
+
+static Chunk parse(const QByteArray &lines, const Schema &schema)
+{
+    QS3_TRACE_SCOPE("inventory", "parse");
+    Chunk ret;
+    const char *p = lines.constData();
+    const char *end = p + lines.size();
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+        QList<QByteArray> columns = fields(p, eol);
+        p = eol + 1;
+        if (columns.count() < schema.columns) continue;
+
+        Row row;
+        // inventory keys are URL-encoded
+        QByteArray key = QByteArray::fromPercentEncoding(columns.at(schema.key));
+        row.key = ret.strings.size();
+        row.keyLength = key.size();
+        ret.strings.append(key);
+
+        QByteArray eTag = schema.eTag < 0 ? QByteArray() : columns.at(schema.eTag);
+        row.eTag = ret.strings.size();
+        row.eTagLength = qMin(eTag.size(), 255);
+        ret.strings.append(eTag.left(row.eTagLength));
+
+        row.size = schema.size < 0 ? -1 : columns.at(schema.size).toLongLong();
+        row.lastModified = schema.lastModified < 0 ? 0 : QDateTime::fromString(QString::fromLatin1(columns.at(schema.lastModified)), Qt::ISODate).toMSecsSinceEpoch();
+        row.storageClass = -1;
+        if (schema.storageClass >= 0) {
+            for (int i = 0; storageClasses[i]; i++) {
+                if (columns.at(schema.storageClass) == storageClasses[i]) {
+                    row.storageClass = i;
+                    break;
+                }
+            }
+        }
+        ret.rows.append(row);
+    }
+    return ret;
+}
+
+class QS3Inventory::Private
+{
+public:
+    struct File {
+        QNetworkReply *reply;
+        QIODevice *device;
+        QByteArray tail;
+        int parsing;
+        bool received;
+    };
+
+    Private(QS3Inventory *parent);
+
+    void manifestReceived(QNetworkReply *reply);
+    void pump();
+    void consume(File *file, bool last);
+    void check(File *file);
+    void merge(const Chunk &chunk);
+    void fail(int httpStatusCode);
+    void abort();
+
+private:
+    QS3Inventory *q;
+
+public:
+    static QHash<int, QByteArray> roleNames;
+    QAccount *account;
+    QString bucket;
+    QString manifest;
+    int concurrency;
+    bool loading;
+    int progress;
+
+    int generation;
+    Schema schema;
+    QString dataBucket;
+    QStringList queue;
+    QList<File *> files;
+    int total;
+    int completed;
+
+    QList<Chunk> chunks;
+    QVector<int> starts;
+    int count;
+};
+
+QHash<int, QByteArray> QS3Inventory::Private::roleNames;
+
+QS3Inventory::Private::Private(QS3Inventory *parent)
+    : q(parent)
+    , account(0)
+    , concurrency(4)
+    , loading(false)
+    , progress(0)
+    , generation(0)
+    , total(0)
+    , completed(0)
+    , count(0)
+{
+}
+
+void QS3Inventory::Private::manifestReceived(QNetworkReply *reply)
+{
+    int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (httpStatusCode != 200) {
+        fail(httpStatusCode);
+        return;
+    }
+
+    QJsonObject manifest = QJsonDocument::fromJson(reply->readAll()).object();
+    if (manifest.value(QStringLiteral("fileFormat")).toString() != QStringLiteral("CSV")) {
+        qWarning() << Q_FUNC_INFO << "unsupported inventory format" << manifest.value(QStringLiteral("fileFormat")).toString();
+        fail(0);
+        return;
+    }
+
+    schema = Schema();
+    QStringList columns = manifest.value(QStringLiteral("fileSchema")).toString().split(QLatin1Char(','));
+    for (int i = 0; i < columns.count(); i++) {
+        QString column = columns.at(i).trimmed();
+        if (column == QStringLiteral("Key"))
+            schema.key = i;
+        else if (column == QStringLiteral("Size"))
+            schema.size = i;
+        else if (column == QStringLiteral("LastModifiedDate"))
+            schema.lastModified = i;
+        else if (column == QStringLiteral("ETag"))
+            schema.eTag = i;
+        else if (column == QStringLiteral("StorageClass"))
+            schema.storageClass = i;
+    }
+    schema.columns = qMax(schema.key, qMax(qMax(schema.size, schema.lastModified), qMax(schema.eTag, schema.storageClass))) + 1;
+    if (schema.key < 0) {
+        fail(0);
+        return;
+    }
+
+    // arn:aws:s3:::bucket
+    dataBucket = manifest.value(QStringLiteral("destinationBucket")).toString().section(QLatin1Char(':'), -1);
+    if (dataBucket.isEmpty())
+        dataBucket = bucket;
+
+    queue.clear();
+    foreach (const QJsonValue &file, manifest.value(QStringLiteral("files")).toArray())
+        queue.append(file.toObject().value(QStringLiteral("key")).toString());
+    total = queue.count();
+    completed = 0;
+    if (total == 0) {
+        q->setLoading(false);
+        return;
+    }
+    pump();
+}
+
+void QS3Inventory::Private::pump()
+{
+    QS3NetworkAccessManager &networkAccessManager = QS3NetworkAccessManager::instance();
+    while (files.count() < concurrency && !queue.isEmpty()) {
+        File *file = new File;
+        QNetworkRequest request(account->url(dataBucket, queue.takeFirst()));
+        request.setRawHeader("Accept-Encoding", "identity");
+        file->reply = networkAccessManager.send(account, request, QNetworkAccessManager::GetOperation);
+        QIODevice *throttled = networkAccessManager.throttled(file->reply, account);
+        // data files are gzip objects, not gzip transfers
+        file->device = new QS3GzipDevice(throttled, QS3GzipDevice::Gzip, file->reply);
+        file->parsing = 0;
+        file->received = false;
+        files.append(file);
+
+        connect(file->device, &QIODevice::readyRead, q, [this, file]() { consume(file, false); });
+        // the gzip device ends after the throttled one, with the last inflated bytes
+        connect(file->device, &QIODevice::readChannelFinished, q, [this, file]() {
+            int httpStatusCode = file->reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            if (httpStatusCode != 200) {
+                fail(httpStatusCode);
+                return;
+            }
+            if (static_cast<QS3GzipDevice *>(file->device)->hasError()) {
+                fail(0);
+                return;
+            }
+            consume(file, true);
+        });
+    }
+}
+
+void QS3Inventory::Private::consume(File *file, bool last)
+{
+    // error bodies are drained too so the device reaches its end
+    QByteArray data = file->device->readAll();
+    if (file->reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200) return;
+
+    file->tail.append(data);
+    // parse in batches of whole lines on the thread pool
+    if (last || file->tail.size() >= 1024 * 1024) {
+        int end = last ? file->tail.size() : file->tail.lastIndexOf('\n') + 1;
+        QByteArray lines = file->tail.left(end);
+        file->tail.remove(0, end);
+        if (!lines.isEmpty()) {
+            file->parsing++;
+            int generation = this->generation;
+            QFutureWatcher<Chunk> *watcher = new QFutureWatcher<Chunk>(q);
+            connect(watcher, &QFutureWatcher<Chunk>::finished, [this, watcher, file, generation]() {
+                watcher->deleteLater();
+                if (generation != this->generation) return;
+                merge(watcher->result());
+                file->parsing--;
+                check(file);
+            });
+            watcher->setFuture(QtConcurrent::run(parse, lines, schema));
+        }
+    }
+
+    if (last) {
+        file->received = true;
+        check(file);
+    }
+}
+
+void QS3Inventory::Private::check(File *file)
+{
+    if (!file->received || file->parsing > 0) return;
+
+    files.removeOne(file);
+    file->reply->deleteLater();
+    delete file;
+    completed++;
+    q->setProgress(completed * 100 / total);
+    if (completed == total)
+        q->setLoading(false);
+    else
+        pump();
+}
+
+void QS3Inventory::Private::merge(const Chunk &chunk)
+{
+    if (chunk.rows.isEmpty()) return;
+    QS3_TRACE_SCOPE("inventory", "merge");
+    q->beginInsertRows(QModelIndex(), count, count + chunk.rows.count() - 1);
+    starts.append(count);
+    chunks.append(chunk);
+    count += chunk.rows.count();
+    q->endInsertRows();
+    emit q->countChanged(count);
+}
+
+void QS3Inventory::Private::abort()
+{
+    generation++;
+    foreach (File *file, files) {
+        disconnect(file->reply, 0, q, 0);
+        disconnect(file->device, 0, q, 0);
+        foreach (QObject *child, file->reply->children())
+            disconnect(child, 0, q, 0);
+        file->reply->abort();
+        file->reply->deleteLater();
+        delete file;
+    }
+    files.clear();
+    queue.clear();
+}
+
+void QS3Inventory::Private::fail(int httpStatusCode)
+{
+    abort();
+    q->setLoading(false);
+    emit q->failed(httpStatusCode);
+}
+
+QS3Inventory::QS3Inventory(QObject *parent)
+    : QAbstractListModel(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3Inventory::destroyed, [d]() {
+        d->abort();
+        delete d;
+    });
+}
+
+int QS3Inventory::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return d->count;
+}
+
+QVariant QS3Inventory::data(const QModelIndex &index, int role) const
+{
+    int row = index.row();
+    if (row < 0 || row >= d->count) return QVariant();
+
+    int i = std::upper_bound(d->starts.constBegin(), d->starts.constEnd(), row) - d->starts.constBegin() - 1;
+    const Chunk &chunk = d->chunks.at(i);
+    const Row &r = chunk.rows.at(row - d->starts.at(i));
+
+    switch (role - Qt::UserRole) {
+    case 0:
+        return QString::fromUtf8(chunk.strings.constData() + r.key, r.keyLength);
+    case 1:
+        return QDateTime::fromMSecsSinceEpoch(r.lastModified, Qt::UTC);
+    case 2:
+        return QString::fromLatin1(chunk.strings.constData() + r.eTag, r.eTagLength);
+    case 3:
+        return r.size;
+    case 4:
+        return r.storageClass < 0 ? QString() : QString::fromLatin1(storageClasses[r.storageClass]);
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+QHash<int, QByteArray> QS3Inventory::roleNames() const
+{
+    if (d->roleNames.isEmpty()) {
+        int role = Qt::UserRole;
+        d->roleNames.insert(role++, "key");
+        d->roleNames.insert(role++, "lastModified");
+        d->roleNames.insert(role++, "eTag");
+        d->roleNames.insert(role++, "size");
+        d->roleNames.insert(role++, "storageClass");
+    }
+    return d->roleNames;
+}
+
+QVariantMap QS3Inventory::get(int i) const
+{
+    QVariantMap ret;
+    QModelIndex index = this->index(i);
+    QHash<int, QByteArray> roleNames = this->roleNames();
+    foreach (int role, roleNames.keys())
+        ret.insert(QString::fromUtf8(roleNames.value(role)), data(index, role));
+    return ret;
+}
+
+QAccount *QS3Inventory::account() const
+{
+    return d->account;
+}
+
+void QS3Inventory::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    d->account = account;
+    emit accountChanged(account);
+}
+
+const QString &QS3Inventory::bucket() const
+{
+    return d->bucket;
+}
+
+void QS3Inventory::setBucket(const QString &bucket)
+{
+    if (d->bucket == bucket) return;
+    d->bucket = bucket;
+    emit bucketChanged(bucket);
+}
+
+const QString &QS3Inventory::manifest() const
+{
+    return d->manifest;
+}
+
+void QS3Inventory::setManifest(const QString &manifest)
+{
+    if (d->manifest == manifest) return;
+    d->manifest = manifest;
+    emit manifestChanged(manifest);
+}
+
+int QS3Inventory::concurrency() const
+{
+    return d->concurrency;
+}
+
+void QS3Inventory::setConcurrency(int concurrency)
+{
+    if (d->concurrency == concurrency) return;
+    d->concurrency = concurrency;
+    emit concurrencyChanged(concurrency);
+}
+
+bool QS3Inventory::loading() const
+{
+    return d->loading;
+}
+
+void QS3Inventory::setLoading(bool loading)
+{
+    if (d->loading == loading) return;
+    d->loading = loading;
+    emit loadingChanged(loading);
+}
+
+int QS3Inventory::progress() const
+{
+    return d->progress;
+}
+
+void QS3Inventory::setProgress(int progress)
+{
+    if (d->progress == progress) return;
+    d->progress = progress;
+    emit progressChanged(progress);
+}
+
+int QS3Inventory::count() const
+{
+    return d->count;
+}
+
+void QS3Inventory::load()
+{
+    if (d->loading) return;
+    if (!d->account) return;
+    if (d->bucket.isEmpty() || d->manifest.isEmpty()) return;
+
+    beginResetModel();
+    d->chunks.clear();
+    d->starts.clear();
+    d->count = 0;
+    endResetModel();
+    emit countChanged(0);
+
+    setProgress(0);
+    setLoading(true);
+    QNetworkReply *reply = QS3NetworkAccessManager::instance().send(d->account, QNetworkRequest(d->account->url(d->bucket, d->manifest)), QNetworkAccessManager::GetOperation);
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        reply->deleteLater();
+        d->manifestReceived(reply);
+    });
+}
@@ -0,0 +1,91 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3INVENTORY_H
+#define QS3INVENTORY_H
+
+#include "s3_global.h"
+
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QVariantMap>
+
+class QAccount;
+
+class S3_EXPORT QS3Inventory : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QAccount *account READ account WRITE setAccount NOTIFY accountChanged)
+    Q_PROPERTY(QString bucket READ bucket WRITE setBucket NOTIFY bucketChanged)
+    Q_PROPERTY(QString manifest READ manifest WRITE setManifest NOTIFY manifestChanged)
+    Q_PROPERTY(int concurrency READ concurrency WRITE setConcurrency NOTIFY concurrencyChanged)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+    Q_PROPERTY(int progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+public:
+    explicit QS3Inventory(QObject *parent = 0);
+
+    virtual int rowCount(const QModelIndex &parent) const;
+    virtual QVariant data(const QModelIndex &index, int role) const;
+    virtual QHash<int, QByteArray> roleNames() const;
+
+    QAccount *account() const;
+    const QString &bucket() const;
+    const QString &manifest() const;
+    int concurrency() const;
+    bool loading() const;
+    int progress() const;
+    int count() const;
+
+    Q_INVOKABLE QVariantMap get(int i) const;
+
+public slots:
+    void setAccount(QAccount *account);
+    void setBucket(const QString &bucket);
+    void setManifest(const QString &manifest);
+    void setConcurrency(int concurrency);
+
+    void load();
+
+private slots:
+    void setLoading(bool loading);
+    void setProgress(int progress);
+
+signals:
+    void accountChanged(QAccount *account);
+    void bucketChanged(const QString &bucket);
+    void manifestChanged(const QString &manifest);
+    void concurrencyChanged(int concurrency);
+    void loadingChanged(bool loading);
+    void progressChanged(int progress);
+    void countChanged(int count);
+    void failed(int httpStatusCode);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3INVENTORY_H
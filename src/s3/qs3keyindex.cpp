@@ -0,0 +1,102 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3keyindex.h"
+
+#include <algorithm>
+
+static QVector<quint32> trigrams(const QString &text)
+{
+    // folded, so that one index serves case sensitive and insensitive queries
+    QByteArray folded = text.toCaseFolded().toUtf8();
+    QVector<quint32> ret;
+    const uchar *data = reinterpret_cast<const uchar *>(folded.constData());
+    for (int i = 0; i + 2 < folded.length(); i++)
+        ret.append(data[i] << 16 | data[i + 1] << 8 | data[i + 2]);
+    return ret;
+}
+
+QS3KeyIndex::QS3KeyIndex()
+    : offsets(1, 0)
+{
+}
+
+void QS3KeyIndex::append(const QString &key)
+{
+    int row = count();
+    foreach (quint32 trigram, trigrams(key)) {
+        QVector<int> &rows = postings[trigram];
+        if (rows.isEmpty() || rows.last() != row)
+            rows.append(row);
+    }
+    arena.append(key.toUtf8());
+    offsets.append(arena.length());
+}
+
+void QS3KeyIndex::clear()
+{
+    arena.clear();
+    offsets.resize(1);
+    postings.clear();
+}
+
+QString QS3KeyIndex::key(int row) const
+{
+    return QString::fromUtf8(arena.constData() + offsets.at(row), offsets.at(row + 1) - offsets.at(row));
+}
+
+QByteArray QS3KeyIndex::bytes(int row) const
+{
+    return QByteArray::fromRawData(arena.constData() + offsets.at(row), offsets.at(row + 1) - offsets.at(row));
+}
+
+bool QS3KeyIndex::candidates(const QStringList &fragments, QVector<int> *rows) const
+{
+    QList<const QVector<int> *> lists;
+    foreach (const QString &fragment, fragments) {
+        foreach (quint32 trigram, trigrams(fragment)) {
+            QHash<quint32, QVector<int> >::const_iterator i = postings.constFind(trigram);
+            if (i == postings.constEnd()) {
+                rows->clear();
+                return true;
+            }
+            if (!lists.contains(&i.value()))
+                lists.append(&i.value());
+        }
+    }
+    if (lists.isEmpty()) return false;
+
+    // shortest list first, the running intersection only shrinks from there
+    std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) { return a->count() < b->count(); });
+    *rows = *lists.first();
+    QVector<int> intersection;
+    for (int i = 1; i < lists.count() && !rows->isEmpty(); i++) {
+        intersection.clear();
+        std::set_intersection(rows->constBegin(), rows->constEnd(), lists.at(i)->constBegin(), lists.at(i)->constEnd(), std::back_inserter(intersection));
+        rows->swap(intersection);
+    }
+    return true;
+}
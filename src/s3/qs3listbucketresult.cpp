@@ -0,0 +1,121 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3listbucketresult.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QXmlStreamReader>
+
+bool QS3ListBucketResult::read(QIODevice *io)
+{
+    QXmlStreamReader xml(io);
+
+    bool commonPrefix = false;
+    QVariantMap content;
+    QVariantMap owner;
+
+    while (!xml.atEnd()) {
+        QXmlStreamReader::TokenType type = xml.readNext();
+        switch (type) {
+        case QXmlStreamReader::StartElement:
+            if (xml.name() == QStringLiteral("ListBucketResult")) {
+                contents.clear();
+            } else if (xml.name() == QStringLiteral("Name")) {
+                xml.readNext();
+                name = xml.text().toString();
+            } else if (xml.name() == QStringLiteral("Prefix")) {
+                xml.readNext();
+                if (commonPrefix) {
+                    content.insert(QStringLiteral("key"), xml.text().toString());
+                } else {
+                    prefix = xml.text().toString();
+                }
+            } else if (xml.name() == QStringLiteral("Delimiter")) {
+                xml.readNext();
+                delimiter = xml.text().toString();
+            } else if (xml.name() == QStringLiteral("Marker")) {
+                xml.readNext();
+                marker = xml.text().toString();
+            } else if (xml.name() == QStringLiteral("NextMarker")) {
+                xml.readNext();
+                nextMarker = xml.text().toString();
+            } else if (xml.name() == QStringLiteral("MaxKeys")) {
+                xml.readNext();
+                maxKeys = xml.text().toInt();
+            } else if (xml.name() == QStringLiteral("IsTruncated")) {
+                xml.readNext();
+                truncated = xml.text().toString() == QStringLiteral("true");
+            } else if (xml.name() == QStringLiteral("Contents")) {
+                content.clear();
+            } else if (xml.name() == QStringLiteral("Key")) {
+                xml.readNext();
+                content.insert(QStringLiteral("key"), xml.text().toString());
+            } else if (xml.name() == QStringLiteral("LastModified")) {
+                xml.readNext();
+                content.insert(QStringLiteral("lastModified"), QDateTime::fromString(xml.text().toString(), QStringLiteral("yyyy-MM-ddThh:mm:ss.zzzZ")));
+            } else if (xml.name() == QStringLiteral("ETag")) {
+                xml.readNext();
+                content.insert(QStringLiteral("eTag"), xml.text().toString());
+            } else if (xml.name() == QStringLiteral("Size")) {
+                xml.readNext();
+                content.insert(QStringLiteral("size"), xml.text().toULongLong());
+            } else if (xml.name() == QStringLiteral("StorageClass")) {
+                xml.readNext();
+                content.insert(QStringLiteral("storageClass"), xml.text().toString());
+            } else if (xml.name() == QStringLiteral("Owner")) {
+                owner.clear();
+            } else if (xml.name() == QStringLiteral("ID")) {
+                xml.readNext();
+                owner.insert(QStringLiteral("id"), xml.text().toString());
+            } else if (xml.name() == QStringLiteral("DisplayName")) {
+                xml.readNext();
+                owner.insert(QStringLiteral("displayName"), xml.text().toString());
+            } else if (xml.name() == QStringLiteral("CommonPrefixes")) {
+                commonPrefix = true;
+                content.clear();
+            } else {
+                qDebug() << Q_FUNC_INFO << __LINE__ << xml.name();
+                xml.readNext();
+                qDebug() << Q_FUNC_INFO << __LINE__ << xml.text().toString();
+            }
+            break;
+        case QXmlStreamReader::EndElement:
+            if (xml.name() == QStringLiteral("Owner")) {
+                content.insert(QStringLiteral("owner"), owner);
+            } else if (xml.name() == QStringLiteral("Contents")) {
+                contents.append(content);
+            } else if (xml.name() == QStringLiteral("CommonPrefixes")) {
+                commonPrefix = false;
+                commonPrefixes.append(content);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return !xml.hasError();
+}
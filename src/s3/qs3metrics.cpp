@@ -0,0 +1,376 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3metrics.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+// upper bounds in milliseconds, the last bucket is +Inf
+static const qint64 bounds[] = { 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000 };
+static const int boundCount = sizeof(bounds) / sizeof(bounds[0]);
+
+struct Histogram {
+    Histogram() : counts(boundCount + 1, 0), count(0), sum(0) {}
+
+    void add(qint64 msecs);
+    qint64 percentile(double p) const;
+
+    QVector<qint64> counts;
+    qint64 count;
+    qint64 sum;
+};
+
+void Histogram::add(qint64 msecs)
+{
+    int i = 0;
+    while (i < boundCount && msecs > bounds[i])
+        i++;
+    counts[i]++;
+    count++;
+    sum += msecs;
+}
+
+qint64 Histogram::percentile(double p) const
+{
+    // interpolated within the bucket the rank falls into
+    if (count == 0) return 0;
+    double rank = p * count;
+    qint64 seen = 0;
+    for (int i = 0; i <= boundCount; i++) {
+        if (seen + counts.at(i) >= rank && counts.at(i) > 0) {
+            qint64 lower = i == 0 ? 0 : bounds[i - 1];
+            qint64 upper = i < boundCount ? bounds[i] : lower * 2;
+            return lower + (upper - lower) * (rank - seen) / counts.at(i);
+        }
+        seen += counts.at(i);
+    }
+    return bounds[boundCount - 1];
+}
+
+struct Series {
+    Series() : bytesReceived(0), bytesSent(0) {}
+
+    Histogram duration;
+    Histogram timeToFirstByte;
+    qint64 bytesReceived;
+    qint64 bytesSent;
+};
+
+struct Labels {
+    QString operation;
+    QString bucket;
+    int httpStatusCode;
+
+    bool operator<(const Labels &other) const {
+        if (operation != other.operation) return operation < other.operation;
+        if (bucket != other.bucket) return bucket < other.bucket;
+        return httpStatusCode < other.httpStatusCode;
+    }
+};
+
+static QByteArray escape(const QString &value)
+{
+    QByteArray ret = value.toUtf8();
+    ret.replace('\\', "\\\\");
+    ret.replace('"', "\\\"");
+    ret.replace('\n', "\\n");
+    return ret;
+}
+
+static QByteArray seconds(qint64 msecs)
+{
+    return QByteArray::number(msecs / 1000.0, 'g', 6);
+}
+
+class QS3Metrics::Private
+{
+public:
+    Private(QS3Metrics *parent);
+
+    void schedule();
+    static void write(QByteArray *out, const char *name, const char *help, const QMap<Labels, Series> &series, Histogram Series::*histogram);
+
+private:
+    QS3Metrics *q;
+
+public:
+    mutable QMutex mutex;
+    QMap<Labels, Series> series;
+    qint64 counters[CacheMisses + 1];
+    bool scheduled;
+    QTcpServer *server;
+};
+
+QS3Metrics::Private::Private(QS3Metrics *parent)
+    : q(parent)
+    , scheduled(false)
+    , server(0)
+{
+    memset(counters, 0, sizeof(counters));
+}
+
+void QS3Metrics::Private::schedule()
+{
+    // coalesce notifications, bindings should not see every single request
+    if (scheduled) return;
+    scheduled = true;
+    QTimer::singleShot(250, q, [this]() {
+        {
+            QMutexLocker locker(&mutex);
+            scheduled = false;
+        }
+        emit q->changed();
+    });
+}
+
+void QS3Metrics::Private::write(QByteArray *out, const char *name, const char *help, const QMap<Labels, Series> &series, Histogram Series::*histogram)
+{
+    out->append("# HELP ").append(name).append(' ').append(help).append('\n');
+    out->append("# TYPE ").append(name).append(" histogram\n");
+    for (QMap<Labels, Series>::const_iterator i = series.constBegin(); i != series.constEnd(); ++i) {
+        const Histogram &h = i.value().*histogram;
+        if (h.count == 0) continue;
+        QByteArray labels = "operation=\"" + escape(i.key().operation) + "\",bucket=\"" + escape(i.key().bucket) + "\",status=\"" + QByteArray::number(i.key().httpStatusCode) + '"';
+        qint64 cumulative = 0;
+        for (int b = 0; b <= boundCount; b++) {
+            cumulative += h.counts.at(b);
+            QByteArray le = b < boundCount ? seconds(bounds[b]) : QByteArray("+Inf");
+            out->append(name).append("_bucket{").append(labels).append(",le=\"").append(le).append("\"} ").append(QByteArray::number(cumulative)).append('\n');
+        }
+        out->append(name).append("_sum{").append(labels).append("} ").append(seconds(h.sum)).append('\n');
+        out->append(name).append("_count{").append(labels).append("} ").append(QByteArray::number(h.count)).append('\n');
+    }
+}
+
+QS3Metrics &QS3Metrics::instance()
+{
+    static QS3Metrics ret;
+    return ret;
+}
+
+QS3Metrics::QS3Metrics(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3Metrics::destroyed, [d]() { delete d; });
+}
+
+qint64 QS3Metrics::requests() const
+{
+    QMutexLocker locker(&d->mutex);
+    qint64 ret = 0;
+    foreach (const Series &series, d->series)
+        ret += series.duration.count;
+    return ret;
+}
+
+qint64 QS3Metrics::errors() const
+{
+    QMutexLocker locker(&d->mutex);
+    qint64 ret = 0;
+    for (QMap<Labels, Series>::const_iterator i = d->series.constBegin(); i != d->series.constEnd(); ++i) {
+        if (i.key().httpStatusCode == 0 || i.key().httpStatusCode >= 400)
+            ret += i.value().duration.count;
+    }
+    return ret;
+}
+
+qint64 QS3Metrics::bytesReceived() const
+{
+    QMutexLocker locker(&d->mutex);
+    qint64 ret = 0;
+    foreach (const Series &series, d->series)
+        ret += series.bytesReceived;
+    return ret;
+}
+
+qint64 QS3Metrics::bytesSent() const
+{
+    QMutexLocker locker(&d->mutex);
+    qint64 ret = 0;
+    foreach (const Series &series, d->series)
+        ret += series.bytesSent;
+    return ret;
+}
+
+qint64 QS3Metrics::retries() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->counters[Retries];
+}
+
+qint64 QS3Metrics::redirects() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->counters[Redirects];
+}
+
+qint64 QS3Metrics::cacheHits() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->counters[CacheHits];
+}
+
+qint64 QS3Metrics::cacheMisses() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->counters[CacheMisses];
+}
+
+QVariantList QS3Metrics::series() const
+{
+    QMutexLocker locker(&d->mutex);
+    QVariantList ret;
+    for (QMap<Labels, Series>::const_iterator i = d->series.constBegin(); i != d->series.constEnd(); ++i) {
+        const Series &series = i.value();
+        QVariantMap map;
+        map.insert(QStringLiteral("operation"), i.key().operation);
+        map.insert(QStringLiteral("bucket"), i.key().bucket);
+        map.insert(QStringLiteral("status"), i.key().httpStatusCode);
+        map.insert(QStringLiteral("count"), series.duration.count);
+        map.insert(QStringLiteral("mean"), series.duration.count ? series.duration.sum / series.duration.count : 0);
+        map.insert(QStringLiteral("p50"), series.duration.percentile(0.5));
+        map.insert(QStringLiteral("p90"), series.duration.percentile(0.9));
+        map.insert(QStringLiteral("p99"), series.duration.percentile(0.99));
+        map.insert(QStringLiteral("ttfb50"), series.timeToFirstByte.percentile(0.5));
+        map.insert(QStringLiteral("ttfb99"), series.timeToFirstByte.percentile(0.99));
+        map.insert(QStringLiteral("bytesReceived"), series.bytesReceived);
+        map.insert(QStringLiteral("bytesSent"), series.bytesSent);
+        ret.append(map);
+    }
+    return ret;
+}
+
+void QS3Metrics::record(const QString &operation, const QString &bucket, int httpStatusCode, qint64 duration, qint64 timeToFirstByte, qint64 bytesReceived, qint64 bytesSent)
+{
+    QMutexLocker locker(&d->mutex);
+    Labels labels = { operation, bucket, httpStatusCode };
+    Series &series = d->series[labels];
+    series.duration.add(duration);
+    if (timeToFirstByte >= 0)
+        series.timeToFirstByte.add(timeToFirstByte);
+    series.bytesReceived += qMax<qint64>(0, bytesReceived);
+    series.bytesSent += qMax<qint64>(0, bytesSent);
+    d->schedule();
+}
+
+void QS3Metrics::increment(Counter counter, qint64 value)
+{
+    QMutexLocker locker(&d->mutex);
+    d->counters[counter] += value;
+    d->schedule();
+}
+
+QByteArray QS3Metrics::prometheus() const
+{
+    QMutexLocker locker(&d->mutex);
+    QByteArray ret;
+    Private::write(&ret, "qs3_request_duration_seconds", "Time from sending a request until its reply finished.", d->series, &Series::duration);
+    Private::write(&ret, "qs3_time_to_first_byte_seconds", "Time from sending a request until the response headers arrived.", d->series, &Series::timeToFirstByte);
+
+    static const char *totals[] = { "qs3_bytes_received_total", "qs3_bytes_sent_total" };
+    for (int t = 0; t < 2; t++) {
+        ret.append("# TYPE ").append(totals[t]).append(" counter\n");
+        for (QMap<Labels, Series>::const_iterator i = d->series.constBegin(); i != d->series.constEnd(); ++i) {
+            ret.append(totals[t]).append("{operation=\"").append(escape(i.key().operation));
+            ret.append("\",bucket=\"").append(escape(i.key().bucket));
+            ret.append("\",status=\"").append(QByteArray::number(i.key().httpStatusCode)).append("\"} ");
+            ret.append(QByteArray::number(t == 0 ? i.value().bytesReceived : i.value().bytesSent)).append('\n');
+        }
+    }
+
+    static const char *counters[] = { "qs3_retries_total", "qs3_redirects_total", "qs3_cache_hits_total", "qs3_cache_misses_total" };
+    for (int c = Retries; c <= CacheMisses; c++) {
+        ret.append("# TYPE ").append(counters[c]).append(" counter\n");
+        ret.append(counters[c]).append(' ').append(QByteArray::number(d->counters[c])).append('\n');
+    }
+    return ret;
+}
+
+bool QS3Metrics::dump(const QString &fileName) const
+{
+    // a scraper reading the file never sees half of it
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << Q_FUNC_INFO << fileName << file.errorString();
+        return false;
+    }
+    file.write(prometheus());
+    return file.commit();
+}
+
+bool QS3Metrics::listen(quint16 port, const QString &address)
+{
+    close();
+    d->server = new QTcpServer(this);
+    connect(d->server, &QTcpServer::newConnection, [this]() {
+        while (QTcpSocket *socket = d->server->nextPendingConnection()) {
+            connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+            // whatever was asked for, the answer is the exposition
+            connect(socket, &QTcpSocket::readyRead, [this, socket]() {
+                if (!socket->canReadLine()) return;
+                QByteArray body = prometheus();
+                socket->write("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: ");
+                socket->write(QByteArray::number(body.size()));
+                socket->write("\r\nConnection: close\r\n\r\n");
+                socket->write(body);
+                socket->disconnectFromHost();
+            });
+        }
+    });
+    if (!d->server->listen(QHostAddress(address), port)) {
+        qWarning() << Q_FUNC_INFO << address << port << d->server->errorString();
+        close();
+        return false;
+    }
+    return true;
+}
+
+void QS3Metrics::close()
+{
+    delete d->server;
+    d->server = 0;
+}
+
+void QS3Metrics::reset()
+{
+    {
+        QMutexLocker locker(&d->mutex);
+        d->series.clear();
+        memset(d->counters, 0, sizeof(d->counters));
+    }
+    emit changed();
+}
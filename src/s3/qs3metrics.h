@@ -0,0 +1,89 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3METRICS_H
+#define QS3METRICS_H
+
+#include "s3_global.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QVariantList>
+
+class S3_EXPORT QS3Metrics : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(qint64 requests READ requests NOTIFY changed)
+    Q_PROPERTY(qint64 errors READ errors NOTIFY changed)
+    Q_PROPERTY(qint64 bytesReceived READ bytesReceived NOTIFY changed)
+    Q_PROPERTY(qint64 bytesSent READ bytesSent NOTIFY changed)
+    Q_PROPERTY(qint64 retries READ retries NOTIFY changed)
+    Q_PROPERTY(qint64 redirects READ redirects NOTIFY changed)
+    Q_PROPERTY(qint64 cacheHits READ cacheHits NOTIFY changed)
+    Q_PROPERTY(qint64 cacheMisses READ cacheMisses NOTIFY changed)
+    Q_PROPERTY(QVariantList series READ series NOTIFY changed)
+public:
+    enum Counter {
+        Retries,
+        Redirects,
+        CacheHits,
+        CacheMisses
+    };
+    Q_ENUMS(Counter)
+
+    static QS3Metrics &instance();
+
+    qint64 requests() const;
+    qint64 errors() const;
+    qint64 bytesReceived() const;
+    qint64 bytesSent() const;
+    qint64 retries() const;
+    qint64 redirects() const;
+    qint64 cacheHits() const;
+    qint64 cacheMisses() const;
+    QVariantList series() const;
+
+    void record(const QString &operation, const QString &bucket, int httpStatusCode, qint64 duration, qint64 timeToFirstByte, qint64 bytesReceived, qint64 bytesSent);
+    void increment(Counter counter, qint64 value = 1);
+
+    Q_INVOKABLE QByteArray prometheus() const;
+    Q_INVOKABLE bool dump(const QString &fileName) const;
+    Q_INVOKABLE bool listen(quint16 port, const QString &address = QStringLiteral("127.0.0.1"));
+    Q_INVOKABLE void close();
+
+public slots:
+    void reset();
+
+signals:
+    void changed();
+
+private:
+    explicit QS3Metrics(QObject *parent = 0);
+
+    class Private;
+    Private *d;
+};
+
+#endif // QS3METRICS_H
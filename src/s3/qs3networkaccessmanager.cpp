@@ -1,5 +1,416 @@
 #include "qs3networkaccessmanager.h"
 
+#include "qaccount.h"
+#include "qs3filesource.h"
+#include "qs3gzipdevice.h"
+#include "qs3metrics.h"
+#include "qs3queuedreply.h"
+#include "qs3throttleddevice.h"
+#include "qs3trace.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QMessageAuthenticationCode>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QLocale>
+#include <QtCore/QMap>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QBuffer>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QPointer>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QUrlQuery>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtNetwork/QNetworkReply>
+
+static QByteArray toString(const QDateTime &dt)
+{
+    QDateTime utc(dt);
+    utc.setTimeSpec(Qt::UTC);
+    int timezoneSeconds = dt.secsTo(utc);
+    QChar sign = (timezoneSeconds >=0 ? QLatin1Char('+') : QLatin1Char('-'));
+    if (timezoneSeconds < 0)
+        timezoneSeconds = -timezoneSeconds;
+    int timezoneMinutes = (timezoneSeconds % 3600) / 60;
+    int timezoneHours = (timezoneSeconds / 3600);
+
+    QLocale locale(QStringLiteral("C"));
+    return QStringLiteral("%1 %2%3").arg(locale.toString(dt, QStringLiteral("ddd, dd MMM yyyy hh:mm:ss"))).arg(sign).arg(timezoneHours * 100 + timezoneMinutes, 4, 10, QLatin1Char('0')).toLatin1();
+}
+
+static QByteArray toString(QNetworkAccessManager::Operation operation)
+{
+    static QMap<QNetworkAccessManager::Operation, QByteArray> map;
+    if (map.isEmpty()) {
+        map.insert(QNetworkAccessManager::HeadOperation, "HEAD");
+        map.insert(QNetworkAccessManager::GetOperation, "GET");
+        map.insert(QNetworkAccessManager::PostOperation, "POST");
+        map.insert(QNetworkAccessManager::PutOperation, "PUT");
+        map.insert(QNetworkAccessManager::DeleteOperation, "DELETE");
+    }
+    return map.value(operation);
+}
+
+static QRegularExpressionMatch matchBucket(const QUrl &url)
+{
+    static const QRegularExpression bucket(QStringLiteral("^([a-z0-9\\-]+)\\.s3[a-z0-9\\-]*\\.amazonaws\\.com$"));
+    return bucket.match(url.host());
+}
+
+static QString bucketName(const QUrl &url)
+{
+    QRegularExpressionMatch match = matchBucket(url);
+    if (match.hasMatch())
+        return match.captured(1);
+    return url.path().section(QLatin1Char('/'), 1, 1);
+}
+
+static QString hostKey(const QUrl &url)
+{
+    return url.host() + QLatin1Char(':') + QString::number(url.port(url.scheme() == QStringLiteral("https") ? 443 : 80));
+}
+
+static QByteArray toString(const QUrl &url)
+{
+    QByteArray ret;
+    QRegularExpressionMatch match = matchBucket(url);
+    if (match.hasMatch()) {
+        ret.append("/");
+        ret.append(match.captured(1).toUtf8());
+    }
+    ret.append(url.path(QUrl::FullyEncoded).toUtf8());
+
+    // sub-resources have to be signed, in this order
+    static const char *subResources[] = {
+        "acl", "cors", "delete", "lifecycle", "location", "logging", "notification",
+        "partNumber", "policy", "requestPayment",
+        "response-cache-control", "response-content-disposition", "response-content-encoding",
+        "response-content-language", "response-content-type", "response-expires",
+        "restore", "select", "select-type", "tagging", "torrent", "uploadId", "uploads",
+        "versionId", "versioning", "versions", "website", 0
+    };
+    QUrlQuery query(url);
+    QChar separator = QLatin1Char('?');
+    for (const char **subResource = subResources; *subResource; subResource++) {
+        QString name = QString::fromLatin1(*subResource);
+        if (!query.hasQueryItem(name)) continue;
+        ret.append(separator.toLatin1());
+        ret.append(*subResource);
+        QString value = query.queryItemValue(name, QUrl::FullyDecoded);
+        if (!value.isEmpty()) {
+            ret.append("=");
+            ret.append(value.toUtf8());
+        }
+        separator = QLatin1Char('&');
+    }
+    return ret;
+}
+
+class QS3NetworkAccessManager::Private
+{
+public:
+    struct Window {
+        Window();
+        int size() const { return static_cast<int>(window); }
+
+        double window;
+        int inFlight;
+        double latency;
+        double baseline;
+        qint64 decreased;
+    };
+
+    struct Pending {
+        QString key;
+        QString host;
+        QString bucket;
+        QByteArray operation;
+        qint64 started;
+        qint64 latency;
+        qint64 bytesReceived;
+        qint64 bytesSent;
+        QPointer<QAccount> account;
+        QNetworkRequest::Priority priority;
+    };
+
+    // a request as it was handed to send(), signed only once it goes out
+    struct Queued {
+        QPointer<QS3QueuedReply> reply;
+        QPointer<QAccount> account;
+        QNetworkRequest request;
+        QNetworkAccessManager::Operation operation;
+        QByteArray data;
+        bool hasDevice;
+        QPointer<QIODevice> device;
+        QByteArray contentMd5;
+    };
+
+    Private(QS3NetworkAccessManager *parent);
+
+    static int key(QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction);
+    QList<QS3TokenBucket *> buckets(QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction);
+
+    void finished(QNetworkReply *reply);
+    void decrease(Window *window);
+
+    bool isAdmissible(const QUrl &url) const;
+    QNetworkReply *admit(const Queued &request);
+    QNetworkReply *transmit(const Queued &request);
+    void pump();
+
+    void follow(QAccount *account, const QNetworkRequest &request, Operation operation, const QByteArray &data, QObject *context,
+                const std::function<void(QNetworkReply *reply, bool inFlight)> &track, const std::function<void(QNetworkReply *)> &finished, int redirects);
+
+private:
+    QS3NetworkAccessManager *q;
+
+public:
+    QHash<int, QS3TokenBucket> classes;
+    QHash<QString, Window> windows;
+    QHash<QNetworkReply *, Pending> pending;
+    // replies QNAM works on per host and port, see connectionsPerHost
+    QHash<QString, int> connections;
+    // highest priority first, in order of arrival within a priority
+    QList<Queued> queue;
+    QElapsedTimer clock;
+};
+
+static const double minimumWindow = 1;
+static const double initialWindow = 8;
+static const double maximumWindow = 256;
+// QNAM opens at most this many HTTP connections per host and queues the rest itself, where the wait would pass
+// for server latency; nothing beyond it is handed over, so that the window sees the time to first byte only
+static const int connectionsPerHost = 6;
+static const int maximumRedirects = 5;
+
+QS3NetworkAccessManager::Private::Window::Window()
+    : window(initialWindow)
+    , inFlight(0)
+    , latency(0)
+    , baseline(0)
+    , decreased(-1)
+{
+}
+
+QS3NetworkAccessManager::Private::Private(QS3NetworkAccessManager *parent)
+    : q(parent)
+{
+    clock.start();
+}
+
+void QS3NetworkAccessManager::Private::finished(QNetworkReply *reply)
+{
+    if (!pending.contains(reply)) return;
+    Pending request = pending.take(reply);
+    Window &window = windows[request.key];
+    int size = window.size();
+    bool limited = window.inFlight >= size;
+    window.inFlight--;
+    connections[request.host]--;
+
+    int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (QS3Trace::isEnabled())
+        QS3Trace::asyncEnd("network", "request", reply, QS3Trace::argument("status", httpStatusCode) + ',' + QS3Trace::argument("bytesReceived", request.bytesReceived));
+    QS3Metrics::instance().record(QString::fromLatin1(request.operation), request.bucket, httpStatusCode, clock.elapsed() - request.started, request.latency, request.bytesReceived, request.bytesSent);
+    if (httpStatusCode == 500 || httpStatusCode == 503) {
+        // InternalError and SlowDown: S3 asks us to back off
+        decrease(&window);
+    } else if (request.latency >= 0) {
+        // time to first byte, so that object sizes do not count as latency
+        window.latency = window.latency == 0 ? request.latency : window.latency * 0.8 + request.latency * 0.2;
+        if (window.baseline == 0 || window.latency < window.baseline)
+            window.baseline = window.latency;
+        else
+            window.baseline += (window.latency - window.baseline) * 0.01;
+
+        if (window.latency > window.baseline * 2 + 10)
+            decrease(&window);
+        else if (limited)
+            window.window = qMin(maximumWindow, window.window + 1 / window.window);
+    }
+
+    if (window.size() != size)
+        emit q->windowChanged(request.key, window.size());
+    pump();
+    if (window.inFlight < window.size())
+        emit q->windowAvailable(request.key);
+}
+
+void QS3NetworkAccessManager::Private::follow(QAccount *account, const QNetworkRequest &request, Operation operation, const QByteArray &data, QObject *context,
+                                              const std::function<void(QNetworkReply *reply, bool inFlight)> &track, const std::function<void(QNetworkReply *)> &finished, int redirects)
+{
+    QNetworkReply *reply = q->send(account, request, operation, data);
+    if (track)
+        track(reply, true);
+    // the reply belongs to the singleton, it goes away even when context is gone by the time it finishes
+    connect(reply, &QNetworkReply::finished, reply, &QObject::deleteLater);
+    QPointer<QAccount> guard(account);
+    connect(reply, &QNetworkReply::finished, context, [this, reply, guard, request, operation, data, context, track, finished, redirects]() {
+        if (track)
+            track(reply, false);
+        // without the account the redirect cannot be signed, and a loop has to end somewhere, either way the 307 goes to finished as it is
+        if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 307 && guard && redirects < maximumRedirects) {
+            QS3Metrics::instance().increment(QS3Metrics::Redirects);
+            QNetworkRequest redirected(request);
+            redirected.setUrl(reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl());
+            follow(guard, redirected, operation, data, context, track, finished, redirects + 1);
+            return;
+        }
+        finished(reply);
+    });
+}
+
+bool QS3NetworkAccessManager::Private::isAdmissible(const QUrl &url) const
+{
+    Window window = windows.value(QS3NetworkAccessManager::windowKey(url));
+    return window.inFlight < window.size() && connections.value(hostKey(url)) < connectionsPerHost;
+}
+
+QNetworkReply *QS3NetworkAccessManager::Private::admit(const Queued &request)
+{
+    // nothing overtakes a request that already waits for the same host
+    QString host = hostKey(request.request.url());
+    bool waiting = false;
+    foreach (const Queued &queued, queue) {
+        if (queued.reply && hostKey(queued.request.url()) == host) {
+            waiting = true;
+            break;
+        }
+    }
+    if (!waiting && isAdmissible(request.request.url()))
+        return transmit(request);
+
+    Queued queued(request);
+    queued.reply = new QS3QueuedReply(request.request, request.operation, q);
+    int i = queue.count();
+    while (i > 0 && queue.at(i - 1).request.priority() > request.request.priority())
+        i--;
+    queue.insert(i, queued);
+    return queued.reply;
+}
+
+void QS3NetworkAccessManager::Private::pump()
+{
+    // attaching can finish a reply right away, and its handler may send again, so the scan starts over every time
+    bool sent = true;
+    while (sent) {
+        sent = false;
+        for (int i = 0; i < queue.count(); i++) {
+            const Queued &request = queue.at(i);
+            if (!request.reply || request.reply->isFinished()) {
+                queue.removeAt(i--);
+                continue;
+            }
+            if (!isAdmissible(request.request.url())) continue;
+            Queued queued = queue.takeAt(i);
+            QNetworkReply *reply = queued.account ? transmit(queued) : 0;
+            queued.reply->attach(reply);
+            sent = true;
+            break;
+        }
+    }
+}
+
+QNetworkReply *QS3NetworkAccessManager::Private::transmit(const Queued &request)
+{
+    QAccount *account = request.account;
+    QNetworkRequest signedRequest(request.request);
+    Operation operation = request.operation;
+
+    if (!request.hasDevice) {
+        const QByteArray &data = request.data;
+        if (!data.isEmpty() && q->isThrottled(account, signedRequest.priority(), QS3TokenBucket::Upload)) {
+            QBuffer *buffer = new QBuffer;
+            buffer->setData(data);
+            buffer->open(QIODevice::ReadOnly);
+            Queued buffered(request);
+            buffered.data.clear();
+            buffered.hasDevice = true;
+            buffered.device = buffer;
+            buffered.contentMd5 = QCryptographicHash::hash(data, QCryptographicHash::Md5);
+            QNetworkReply *reply = transmit(buffered);
+            if (reply)
+                buffer->setParent(reply);
+            else
+                delete buffer;
+            return reply;
+        }
+
+        QByteArray contentMd5;
+        if (!data.isEmpty())
+            contentMd5 = QCryptographicHash::hash(data, QCryptographicHash::Md5).toBase64();
+        sign(account, &signedRequest, operation, contentMd5);
+        return q->dispatch(signedRequest, operation, data);
+    }
+
+    // the body went away while the request was queued
+    QIODevice *data = request.device;
+    if (!data) return 0;
+
+    QIODevice *throttled = 0;
+    if (q->isThrottled(account, signedRequest.priority(), QS3TokenBucket::Upload)) {
+        // QNAM pulls from the wrapper, which only hands out what the buckets grant
+        signedRequest.setHeader(QNetworkRequest::ContentLengthHeader, data->size() - data->pos());
+        throttled = new QS3ThrottledDevice(data, account, signedRequest.priority(), QS3TokenBucket::Upload);
+        data = throttled;
+    } else {
+        // hand a mapped file over as a raw QByteArray so that the socket is fed straight from the mapping
+        QS3FileSource *source = qobject_cast<QS3FileSource *>(data);
+        if (source && source->isMapped()) {
+            sign(account, &signedRequest, operation, request.contentMd5.toBase64());
+            return q->dispatch(signedRequest, operation, source->mapped());
+        }
+        signedRequest.setHeader(QNetworkRequest::ContentLengthHeader, data->size());
+    }
+
+    sign(account, &signedRequest, operation, request.contentMd5.toBase64());
+
+    QNetworkReply *reply = 0;
+    switch (operation) {
+    case PostOperation:
+        reply = q->post(signedRequest, data);
+        break;
+    case PutOperation:
+        reply = q->put(signedRequest, data);
+        break;
+    default:
+        qWarning() << Q_FUNC_INFO << "operation without a body" << operation;
+        break;
+    }
+    if (throttled) {
+        if (reply)
+            throttled->setParent(reply);
+        else
+            delete throttled;
+    }
+    return reply;
+}
+
+void QS3NetworkAccessManager::Private::decrease(Window *window)
+{
+    // once per round trip, a burst of errors is one congestion event
+    qint64 now = clock.elapsed();
+    if (window->decreased >= 0 && now - window->decreased < qMax<qint64>(100, window->latency)) return;
+    window->window = qMax(minimumWindow, window->window / 2);
+    window->decreased = now;
+}
+
+int QS3NetworkAccessManager::Private::key(QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction)
+{
+    return priority << 1 | direction;
+}
+
+QList<QS3TokenBucket *> QS3NetworkAccessManager::Private::buckets(QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction)
+{
+    QList<QS3TokenBucket *> ret;
+    ret.append(&classes[key(priority, direction)]);
+    if (account)
+        ret.append(account->tokenBucket(direction));
+    return ret;
+}
+
 QS3NetworkAccessManager &QS3NetworkAccessManager::instance()
 {
     static QS3NetworkAccessManager ret;
@@ -8,5 +419,319 @@ QS3NetworkAccessManager &QS3NetworkAccessManager::instance()
 
 QS3NetworkAccessManager::QS3NetworkAccessManager(QObject *parent)
     : QNetworkAccessManager(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3NetworkAccessManager::destroyed, [d]() { delete d; });
+}
+
+qint64 QS3NetworkAccessManager::maxRate(QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction) const
+{
+    return d->classes.value(Private::key(priority, direction)).rate();
+}
+
+void QS3NetworkAccessManager::setMaxRate(QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction, qint64 bytesPerSecond)
+{
+    d->classes[Private::key(priority, direction)].setRate(bytesPerSecond);
+}
+
+qint64 QS3NetworkAccessManager::rate(QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction) const
+{
+    return d->classes.value(Private::key(priority, direction)).throughput();
+}
+
+bool QS3NetworkAccessManager::isThrottled(QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction) const
+{
+    foreach (QS3TokenBucket *bucket, d->buckets(account, priority, direction)) {
+        if (bucket->isLimited())
+            return true;
+    }
+    return false;
+}
+
+qint64 QS3NetworkAccessManager::acquire(QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction, qint64 bytes)
+{
+    // grant what every bucket on the way can afford, then charge all of them with that
+    QList<QS3TokenBucket *> buckets = d->buckets(account, priority, direction);
+    qint64 granted = bytes;
+    foreach (QS3TokenBucket *bucket, buckets)
+        granted = bucket->available(granted);
+    if (granted > 0) {
+        foreach (QS3TokenBucket *bucket, buckets)
+            bucket->take(granted);
+    }
+    return granted;
+}
+
+int QS3NetworkAccessManager::delay(QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction, qint64 bytes)
+{
+    int ret = 0;
+    foreach (QS3TokenBucket *bucket, d->buckets(account, priority, direction))
+        ret = qMax(ret, bucket->wait(bytes));
+    return ret;
+}
+
+QIODevice *QS3NetworkAccessManager::throttled(QNetworkReply *reply, QAccount *account)
+{
+    // keep the socket from buffering far ahead of what the buckets let through
+    reply->setReadBufferSize(256 * 1024);
+    return new QS3ThrottledDevice(reply, account, reply->request().priority(), QS3TokenBucket::Download, reply);
+}
+
+void QS3NetworkAccessManager::sign(QAccount *account, QNetworkRequest *request, Operation operation, const QByteArray &contentMd5)
+{
+    QS3_TRACE_SCOPE("network", "sign");
+    QByteArray httpVerb = toString(operation);
+    QByteArray contentType = request->header(QNetworkRequest::ContentTypeHeader).toByteArray();
+    QByteArray date = toString(QDateTime::currentDateTime());
+    QByteArray canonicalizedAmzHeaders;
+    QMap<QByteArray, QByteArray> amzHeaders;
+    foreach (const QByteArray &headerName, request->rawHeaderList()) {
+        QByteArray name = headerName.toLower();
+        if (name.startsWith("x-amz-"))
+            amzHeaders.insert(name, request->rawHeader(headerName).trimmed());
+    }
+    foreach (const QByteArray &name, amzHeaders.keys())
+        canonicalizedAmzHeaders.append(name + ':' + amzHeaders.value(name) + '\n');
+    QByteArray canonicalizedResource = toString(request->url());
+
+    QByteArray stringToSign = httpVerb + "\n"
+            + contentMd5 + "\n"
+            + contentType + "\n"
+            + date + "\n"
+            + canonicalizedAmzHeaders
+            + canonicalizedResource;
+    QByteArray signature = QMessageAuthenticationCode::hash(stringToSign, account->awsSecretAccessKey(), QCryptographicHash::Sha1);
+    signature = signature.toBase64();
+    QByteArray authorization("AWS ");
+    authorization.append(account->awsAccessKeyId());
+    authorization.append(":");
+    authorization.append(signature);
+
+    if (!contentMd5.isEmpty())
+        request->setRawHeader("Content-MD5", contentMd5);
+    request->setRawHeader("Date", date);
+    request->setRawHeader("Authorization", authorization);
+}
+
+QByteArray QS3NetworkAccessManager::canonicalizedResource(const QUrl &url)
+{
+    return toString(url);
+}
+
+QNetworkReply *QS3NetworkAccessManager::send(QAccount *account, QNetworkRequest request, Operation operation, const QByteArray &data)
+{
+    QS3_TRACE_SCOPE("network", "send");
+    // createRequest() meters the traffic against the account
+    request.setAttribute(AccountAttribute, QVariant::fromValue<QObject *>(account));
+    if (request.attribute(CompressionAttribute).toBool()) {
+        if (operation == GetOperation || operation == HeadOperation) {
+            // an explicit Accept-Encoding keeps QNAM from inflating behind our back
+            request.setRawHeader("Accept-Encoding", "gzip");
+        } else if (!data.isEmpty()) {
+            // compressed on the thread pool, the returned reply stands in for the request until the body is ready
+            QS3QueuedReply *reply = new QS3QueuedReply(request, operation, this);
+            QPointer<QS3QueuedReply> guard(reply);
+            QPointer<QAccount> accountGuard(account);
+            QFutureWatcher<QByteArray> *watcher = new QFutureWatcher<QByteArray>(this);
+            connect(watcher, &QFutureWatcher<QByteArray>::finished, this, [this, watcher, guard, accountGuard, request, operation]() {
+                watcher->deleteLater();
+                if (!guard || guard->isFinished()) return;
+                QByteArray body = watcher->result();
+                if (!accountGuard || body.isEmpty()) {
+                    qWarning() << Q_FUNC_INFO << "compression failed";
+                    guard->attach(0);
+                    return;
+                }
+                QNetworkRequest compressed(request);
+                compressed.setAttribute(CompressionAttribute, false);
+                compressed.setRawHeader("Content-Encoding", "gzip");
+                guard->attach(send(accountGuard, compressed, operation, body));
+            });
+            watcher->setFuture(QtConcurrent::run([data]() {
+                QS3_TRACE_SCOPE("network", "compress");
+                QBuffer in;
+                in.setData(data);
+                in.open(QIODevice::ReadOnly);
+                QBuffer out;
+                out.open(QIODevice::WriteOnly);
+                if (!QS3GzipDevice::compress(&in, &out))
+                    return QByteArray();
+                return out.data();
+            }));
+            return reply;
+        }
+    }
+
+    Private::Queued queued = { 0, account, request, operation, data, false, 0, QByteArray() };
+    return d->admit(queued);
+}
+
+QNetworkReply *QS3NetworkAccessManager::send(QAccount *account, QNetworkRequest request, Operation operation, QIODevice *data, const QByteArray &contentMd5)
+{
+    QS3_TRACE_SCOPE("network", "send");
+    request.setAttribute(AccountAttribute, QVariant::fromValue<QObject *>(account));
+    if (request.attribute(CompressionAttribute).toBool()) {
+        // compressing a stream takes a while, that is only done off the GUI thread
+        qWarning() << Q_FUNC_INFO << "use the asynchronous send() to compress a device";
+        return 0;
+    }
+    if (operation != PostOperation && operation != PutOperation) {
+        qWarning() << Q_FUNC_INFO << "operation without a body" << operation;
+        return 0;
+    }
+
+    Private::Queued queued = { 0, account, request, operation, QByteArray(), true, data, contentMd5 };
+    return d->admit(queued);
+}
+
+void QS3NetworkAccessManager::send(QAccount *account, QNetworkRequest request, Operation operation, QIODevice *data, QObject *context, const std::function<void(QNetworkReply *)> &sent)
 {
+    if (!request.attribute(CompressionAttribute).toBool()) {
+        sent(send(account, request, operation, data));
+        return;
+    }
+
+    // S3 needs the Content-Length up front, so the gzip body goes into a temporary file
+    QTemporaryFile *file = new QTemporaryFile;
+    if (!file->open()) {
+        qWarning() << Q_FUNC_INFO << "compression failed" << file->errorString();
+        delete file;
+        sent(0);
+        return;
+    }
+    QPointer<QObject> guard(context);
+    QPointer<QAccount> accountGuard(account);
+    QFutureWatcher<QByteArray> *watcher = new QFutureWatcher<QByteArray>(this);
+    connect(watcher, &QFutureWatcher<QByteArray>::finished, this, [this, watcher, file, guard, accountGuard, request, operation, sent]() {
+        watcher->deleteLater();
+        QByteArray md5 = watcher->result();
+        if (!guard || !accountGuard) {
+            delete file;
+            return;
+        }
+        if (md5.isEmpty() || !file->seek(0)) {
+            qWarning() << Q_FUNC_INFO << "compression failed" << file->errorString();
+            delete file;
+            sent(0);
+            return;
+        }
+        QNetworkRequest compressed(request);
+        compressed.setAttribute(CompressionAttribute, false);
+        compressed.setRawHeader("Content-Encoding", "gzip");
+        QNetworkReply *reply = send(accountGuard, compressed, operation, file, md5);
+        if (reply)
+            file->setParent(reply);
+        else
+            delete file;
+        sent(reply);
+    });
+    watcher->setFuture(QtConcurrent::run([data, file]() {
+        QS3_TRACE_SCOPE("network", "compress");
+        QByteArray md5;
+        if (!QS3GzipDevice::compress(data, file, &md5))
+            return QByteArray();
+        return md5;
+    }));
+}
+
+void QS3NetworkAccessManager::follow(QAccount *account, const QNetworkRequest &request, Operation operation, const QByteArray &data, QObject *context,
+                                     const std::function<void(QNetworkReply *reply, bool inFlight)> &track, const std::function<void(QNetworkReply *)> &finished)
+{
+    d->follow(account, request, operation, data, context, track, finished, 0);
+}
+
+QNetworkReply *QS3NetworkAccessManager::dispatch(const QNetworkRequest &request, Operation operation, const QByteArray &data)
+{
+    QNetworkReply *reply = 0;
+    switch (operation) {
+    case HeadOperation:
+        reply = head(request);
+        break;
+    case GetOperation:
+        reply = get(request);
+        break;
+    case PostOperation:
+        reply = post(request, data);
+        break;
+    case PutOperation:
+        reply = put(request, data);
+        break;
+    case DeleteOperation:
+        reply = deleteResource(request);
+        break;
+    default:
+        break;
+    }
+    return reply;
+}
+
+QString QS3NetworkAccessManager::windowKey(const QUrl &url)
+{
+    // host plus the first path segment, objects right under the bucket share the bucket's window
+    QString path = url.path();
+    int slash = path.indexOf(QLatin1Char('/'), 1);
+    return url.host() + (slash > 0 ? path.left(slash) : QStringLiteral("/"));
+}
+
+int QS3NetworkAccessManager::window(const QUrl &url) const
+{
+    return d->windows.value(windowKey(url)).size();
+}
+
+int QS3NetworkAccessManager::inFlight(const QUrl &url) const
+{
+    return d->windows.value(windowKey(url)).inFlight;
+}
+
+bool QS3NetworkAccessManager::isSaturated(const QUrl &url) const
+{
+    return !d->isAdmissible(url);
+}
+
+QVariantMap QS3NetworkAccessManager::windows() const
+{
+    QVariantMap ret;
+    foreach (const QString &key, d->windows.keys())
+        ret.insert(key, d->windows.value(key).size());
+    return ret;
+}
+
+QNetworkReply *QS3NetworkAccessManager::createRequest(Operation operation, const QNetworkRequest &request, QIODevice *outgoingData)
+{
+    QNetworkReply *reply = QNetworkAccessManager::createRequest(operation, request, outgoingData);
+
+    QByteArray verb = operation == CustomOperation ? request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() : toString(operation);
+    QAccount *account = qobject_cast<QAccount *>(request.attribute(AccountAttribute).value<QObject *>());
+    Private::Pending pending = { windowKey(request.url()), hostKey(request.url()), bucketName(request.url()), verb, d->clock.elapsed(), -1, 0, 0, account, request.priority() };
+    d->windows[pending.key].inFlight++;
+    d->connections[pending.host]++;
+    d->pending.insert(reply, pending);
+    if (QS3Trace::isEnabled())
+        QS3Trace::asyncBegin("network", "request", reply, QS3Trace::argument("verb", QString::fromLatin1(verb)) + ',' + QS3Trace::argument("url", request.url().toString()));
+    connect(reply, &QNetworkReply::metaDataChanged, this, [this, reply]() {
+        QHash<QNetworkReply *, Private::Pending>::iterator pending = d->pending.find(reply);
+        if (pending != d->pending.end() && pending->latency < 0) {
+            pending->latency = d->clock.elapsed() - pending->started;
+            QS3Trace::asyncStep("network", "headers", reply);
+        }
+    });
+    connect(reply, &QNetworkReply::downloadProgress, this, [this, reply](qint64 bytesReceived) {
+        QHash<QNetworkReply *, Private::Pending>::iterator pending = d->pending.find(reply);
+        if (pending == d->pending.end()) return;
+        // every transfer is metered, throttled or not
+        foreach (QS3TokenBucket *bucket, d->buckets(pending->account, pending->priority, QS3TokenBucket::Download))
+            bucket->measure(bytesReceived - pending->bytesReceived);
+        pending->bytesReceived = bytesReceived;
+    });
+    connect(reply, &QNetworkReply::uploadProgress, this, [this, reply](qint64 bytesSent) {
+        QHash<QNetworkReply *, Private::Pending>::iterator pending = d->pending.find(reply);
+        if (pending == d->pending.end()) return;
+        foreach (QS3TokenBucket *bucket, d->buckets(pending->account, pending->priority, QS3TokenBucket::Upload))
+            bucket->measure(bytesSent - pending->bytesSent);
+        pending->bytesSent = bytesSent;
+    });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        d->finished(reply);
+    });
+    return reply;
 }
@@ -2,17 +2,68 @@
 #define S3NETWORKACCESSMANAGER_H
 
 #include "s3_global.h"
+#include "qs3tokenbucket.h"
 
 #include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkRequest>
+#include <QtCore/QVariantMap>
+
+#include <functional>
+
+class QAccount;
 
 class S3_EXPORT QS3NetworkAccessManager : public QNetworkAccessManager
 {
     Q_OBJECT
 public:
+    static const QNetworkRequest::Attribute CompressionAttribute = static_cast<QNetworkRequest::Attribute>(QNetworkRequest::User + 1);
+    static const QNetworkRequest::Attribute AccountAttribute = static_cast<QNetworkRequest::Attribute>(QNetworkRequest::User + 2);
+
     static QS3NetworkAccessManager &instance();
 
+    // a request beyond the window of its host and prefix waits here, the reply returned stands in for it until it is sent,
+    // just like a body with CompressionAttribute while it is gzipped on the thread pool
+    QNetworkReply *send(QAccount *account, QNetworkRequest request, Operation operation, const QByteArray &data = QByteArray());
+    QNetworkReply *send(QAccount *account, QNetworkRequest request, Operation operation, QIODevice *data, const QByteArray &contentMd5 = QByteArray());
+    // with CompressionAttribute the body is gzipped on the thread pool first, data has to live until sent is called
+    void send(QAccount *account, QNetworkRequest request, Operation operation, QIODevice *data, QObject *context, const std::function<void(QNetworkReply *)> &sent);
+    // 307s are counted and resent to their target up to five times, track sees every reply on the way when it goes out
+    // and when it is done, finished only the last one, both are dropped with context while the replies clean up anyway
+    void follow(QAccount *account, const QNetworkRequest &request, Operation operation, const QByteArray &data, QObject *context,
+                const std::function<void(QNetworkReply *reply, bool inFlight)> &track, const std::function<void(QNetworkReply *)> &finished);
+
+    static void sign(QAccount *account, QNetworkRequest *request, Operation operation, const QByteArray &contentMd5 = QByteArray());
+    static QByteArray canonicalizedResource(const QUrl &url);
+
+    qint64 maxRate(QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction) const;
+    void setMaxRate(QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction, qint64 bytesPerSecond);
+    qint64 rate(QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction) const;
+
+    bool isThrottled(QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction) const;
+    qint64 acquire(QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction, qint64 bytes);
+    int delay(QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction, qint64 bytes);
+    QIODevice *throttled(QNetworkReply *reply, QAccount *account);
+
+    static QString windowKey(const QUrl &url);
+    int window(const QUrl &url) const;
+    int inFlight(const QUrl &url) const;
+    bool isSaturated(const QUrl &url) const;
+    QVariantMap windows() const;
+
+signals:
+    void windowChanged(const QString &key, int window);
+    void windowAvailable(const QString &key);
+
+protected:
+    virtual QNetworkReply *createRequest(Operation operation, const QNetworkRequest &request, QIODevice *outgoingData);
+
 private:
     explicit QS3NetworkAccessManager(QObject *parent = 0);
+
+    QNetworkReply *dispatch(const QNetworkRequest &request, Operation operation, const QByteArray &data);
+
+    class Private;
+    Private *d;
 };
 
 #endif // S3NETWORKACCESSMANAGER_H
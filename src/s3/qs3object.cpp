@@ -0,0 +1,517 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3object.h"
+#include "qs3networkaccessmanager.h"
+#include "qs3gzipdevice.h"
+#include "qaccount.h"
+
+#include <QtCore/QUrl>
+#include <QtCore/QXmlStreamReader>
+#include <QtNetwork/QNetworkReply>
+
+class QS3Object::Private
+{
+public:
+    Private(QS3Object *parent);
+    ~Private();
+
+    QNetworkRequest request(const QString &bucket, const QString &key, const QString &versionId) const;
+    void describe(QNetworkRequest *request) const;
+    void start(QNetworkReply *reply, QNetworkAccessManager::Operation operation);
+    void detach();
+    void readHeaders();
+    void readyRead();
+    void finished();
+
+private:
+    QS3Object *q;
+
+public:
+    QAccount *account;
+    QString bucket;
+    QString key;
+    QString versionId;
+    bool compressed;
+    QString contentType;
+    QVariantMap metadata;
+    bool buffered;
+    QString eTag;
+    QDateTime lastModified;
+    bool running;
+    qint64 bytesReceived;
+    qint64 bytesSent;
+    qint64 bytesTotal;
+
+    QNetworkReply *reply;
+    QIODevice *throttled;
+    QIODevice *device;
+    QByteArray body;
+    QNetworkAccessManager::Operation operation;
+    bool copying;
+    bool replyFinished;
+    bool drained;
+    int generation;
+};
+
+QS3Object::Private::Private(QS3Object *parent)
+    : q(parent)
+    , account(0)
+    , compressed(false)
+    , buffered(false)
+    , running(false)
+    , bytesReceived(0)
+    , bytesSent(0)
+    , bytesTotal(0)
+    , reply(0)
+    , throttled(0)
+    , device(0)
+    , operation(QNetworkAccessManager::UnknownOperation)
+    , copying(false)
+    , replyFinished(false)
+    , drained(false)
+    , generation(0)
+{
+}
+
+QS3Object::Private::~Private()
+{
+    detach();
+}
+
+QNetworkRequest QS3Object::Private::request(const QString &bucket, const QString &key, const QString &versionId) const
+{
+    QUrl url = account->url(bucket, key);
+    if (!versionId.isEmpty())
+        url.setQuery(QStringLiteral("versionId=") + QString::fromLatin1(QUrl::toPercentEncoding(versionId)));
+    QNetworkRequest ret(url);
+    ret.setAttribute(QS3NetworkAccessManager::CompressionAttribute, compressed);
+    return ret;
+}
+
+void QS3Object::Private::describe(QNetworkRequest *request) const
+{
+    if (!contentType.isEmpty())
+        request->setHeader(QNetworkRequest::ContentTypeHeader, contentType);
+    foreach (const QString &name, metadata.keys())
+        request->setRawHeader("x-amz-meta-" + name.toUtf8(), metadata.value(name).toString().toUtf8());
+}
+
+void QS3Object::Private::detach()
+{
+    if (!reply) return;
+    disconnect(reply, 0, q, 0);
+    if (throttled)
+        disconnect(throttled, 0, q, 0);
+    if (device)
+        disconnect(device, 0, q, 0);
+    reply->abort();
+    // the devices of a get are children of its reply
+    reply->deleteLater();
+    reply = 0;
+    throttled = 0;
+    device = 0;
+}
+
+void QS3Object::Private::start(QNetworkReply *reply, QNetworkAccessManager::Operation operation)
+{
+    bool hadDevice = device;
+    detach();
+    generation++;
+    if (!reply) {
+        // the request could not even be sent, a compressed body for instance
+        q->setRunning(false);
+        emit q->failed(0);
+        return;
+    }
+
+    this->reply = reply;
+    this->operation = operation;
+    copying = false;
+    replyFinished = false;
+    drained = false;
+    body.clear();
+    q->setBytesReceived(0);
+    q->setBytesSent(0);
+    q->setBytesTotal(0);
+    q->setRunning(true);
+
+    connect(reply, &QNetworkReply::metaDataChanged, q, [this]() { readHeaders(); });
+    connect(reply, &QNetworkReply::downloadProgress, q, [this](qint64 bytesReceived, qint64 bytesTotal) {
+        q->setBytesReceived(bytesReceived);
+        if (this->operation == QNetworkAccessManager::GetOperation && bytesTotal > 0)
+            q->setBytesTotal(bytesTotal);
+    });
+    connect(reply, &QNetworkReply::uploadProgress, q, [this](qint64 bytesSent, qint64 bytesTotal) {
+        q->setBytesSent(bytesSent);
+        if (this->operation != QNetworkAccessManager::GetOperation && bytesTotal > 0)
+            q->setBytesTotal(bytesTotal);
+    });
+
+    connect(reply, &QNetworkReply::finished, q, [this]() {
+        replyFinished = true;
+        finished();
+    });
+    if (operation == QNetworkAccessManager::GetOperation) {
+        // data is handed out as it arrives, it is only collected here for a buffered object
+        throttled = QS3NetworkAccessManager::instance().throttled(reply, account);
+        connect(throttled, &QIODevice::readChannelFinished, q, [this]() {
+            drained = true;
+            finished();
+        });
+        device = compressed ? new QS3GzipDevice(throttled, QS3GzipDevice::Auto, reply) : throttled;
+        connect(device, &QIODevice::readyRead, q, [this]() { readyRead(); });
+        emit q->deviceChanged(device);
+    } else if (hadDevice) {
+        emit q->deviceChanged(0);
+    }
+}
+
+void QS3Object::Private::readHeaders()
+{
+    int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (httpStatusCode < 200 || httpStatusCode > 299 || copying) return;
+
+    if (operation == QNetworkAccessManager::GetOperation || operation == QNetworkAccessManager::HeadOperation) {
+        q->setContentType(reply->header(QNetworkRequest::ContentTypeHeader).toString());
+        q->setLastModified(reply->header(QNetworkRequest::LastModifiedHeader).toDateTime());
+        QVariantMap metadata;
+        foreach (const QNetworkReply::RawHeaderPair &header, reply->rawHeaderPairs()) {
+            QByteArray headerName = header.first.toLower();
+            if (headerName.startsWith("x-amz-meta-"))
+                metadata.insert(QString::fromUtf8(headerName.mid(11)), QString::fromUtf8(header.second));
+        }
+        q->setMetadata(metadata);
+        if (operation == QNetworkAccessManager::HeadOperation)
+            q->setBytesTotal(reply->header(QNetworkRequest::ContentLengthHeader).toLongLong());
+    }
+    if (reply->hasRawHeader("ETag"))
+        q->setETag(QString::fromUtf8(reply->rawHeader("ETag")));
+}
+
+void QS3Object::Private::readyRead()
+{
+    // otherwise the bytes stay in the capped device until the caller reads them, which holds the transfer back
+    if (buffered) {
+        body.append(device->readAll());
+        return;
+    }
+    emit q->readyRead();
+}
+
+void QS3Object::Private::finished()
+{
+    if (!running || !replyFinished) return;
+    int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool ok = reply->error() == QNetworkReply::NoError && httpStatusCode >= 200 && httpStatusCode < 300;
+    // a successful get is done once the throttled body has been released, an error does not wait for it
+    if (ok && operation == QNetworkAccessManager::GetOperation && !drained) return;
+    if (ok && copying) {
+        // a copy can still fail after the 200 has been sent
+        QXmlStreamReader xml(reply->readAll());
+        if (xml.readNextStartElement() && xml.name() == QStringLiteral("Error"))
+            ok = false;
+    }
+
+    // a get keeps its reply, the device reads from it
+    if (operation != QNetworkAccessManager::GetOperation) {
+        disconnect(reply, 0, q, 0);
+        reply->deleteLater();
+        reply = 0;
+    }
+
+    q->setRunning(false);
+    if (ok)
+        emit q->finished();
+    else
+        emit q->failed(httpStatusCode);
+}
+
+QS3Object::QS3Object(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3Object::destroyed, [d]() { delete d; });
+}
+
+QAccount *QS3Object::account() const
+{
+    return d->account;
+}
+
+void QS3Object::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    d->account = account;
+    emit accountChanged(account);
+}
+
+const QString &QS3Object::bucket() const
+{
+    return d->bucket;
+}
+
+void QS3Object::setBucket(const QString &bucket)
+{
+    if (d->bucket == bucket) return;
+    d->bucket = bucket;
+    emit bucketChanged(bucket);
+}
+
+const QString &QS3Object::key() const
+{
+    return d->key;
+}
+
+void QS3Object::setKey(const QString &key)
+{
+    if (d->key == key) return;
+    d->key = key;
+    emit keyChanged(key);
+}
+
+const QString &QS3Object::versionId() const
+{
+    return d->versionId;
+}
+
+void QS3Object::setVersionId(const QString &versionId)
+{
+    if (d->versionId == versionId) return;
+    d->versionId = versionId;
+    emit versionIdChanged(versionId);
+}
+
+bool QS3Object::compressed() const
+{
+    return d->compressed;
+}
+
+void QS3Object::setCompressed(bool compressed)
+{
+    if (d->compressed == compressed) return;
+    d->compressed = compressed;
+    emit compressedChanged(compressed);
+}
+
+const QString &QS3Object::contentType() const
+{
+    return d->contentType;
+}
+
+void QS3Object::setContentType(const QString &contentType)
+{
+    if (d->contentType == contentType) return;
+    d->contentType = contentType;
+    emit contentTypeChanged(contentType);
+}
+
+const QVariantMap &QS3Object::metadata() const
+{
+    return d->metadata;
+}
+
+void QS3Object::setMetadata(const QVariantMap &metadata)
+{
+    if (d->metadata == metadata) return;
+    d->metadata = metadata;
+    emit metadataChanged(metadata);
+}
+
+bool QS3Object::buffered() const
+{
+    return d->buffered;
+}
+
+void QS3Object::setBuffered(bool buffered)
+{
+    if (d->buffered == buffered) return;
+    d->buffered = buffered;
+    emit bufferedChanged(buffered);
+}
+
+const QString &QS3Object::eTag() const
+{
+    return d->eTag;
+}
+
+void QS3Object::setETag(const QString &eTag)
+{
+    if (d->eTag == eTag) return;
+    d->eTag = eTag;
+    emit eTagChanged(eTag);
+}
+
+const QDateTime &QS3Object::lastModified() const
+{
+    return d->lastModified;
+}
+
+void QS3Object::setLastModified(const QDateTime &lastModified)
+{
+    if (d->lastModified == lastModified) return;
+    d->lastModified = lastModified;
+    emit lastModifiedChanged(lastModified);
+}
+
+bool QS3Object::running() const
+{
+    return d->running;
+}
+
+void QS3Object::setRunning(bool running)
+{
+    if (d->running == running) return;
+    d->running = running;
+    emit runningChanged(running);
+}
+
+qint64 QS3Object::bytesReceived() const
+{
+    return d->bytesReceived;
+}
+
+void QS3Object::setBytesReceived(qint64 bytesReceived)
+{
+    if (d->bytesReceived == bytesReceived) return;
+    d->bytesReceived = bytesReceived;
+    emit bytesReceivedChanged(bytesReceived);
+}
+
+qint64 QS3Object::bytesSent() const
+{
+    return d->bytesSent;
+}
+
+void QS3Object::setBytesSent(qint64 bytesSent)
+{
+    if (d->bytesSent == bytesSent) return;
+    d->bytesSent = bytesSent;
+    emit bytesSentChanged(bytesSent);
+}
+
+qint64 QS3Object::bytesTotal() const
+{
+    return d->bytesTotal;
+}
+
+void QS3Object::setBytesTotal(qint64 bytesTotal)
+{
+    if (d->bytesTotal == bytesTotal) return;
+    d->bytesTotal = bytesTotal;
+    emit bytesTotalChanged(bytesTotal);
+}
+
+QIODevice *QS3Object::device() const
+{
+    return d->device;
+}
+
+QByteArray QS3Object::readAll()
+{
+    QByteArray ret = d->body;
+    d->body.clear();
+    if (d->device)
+        ret.append(d->device->readAll());
+    return ret;
+}
+
+QIODevice *QS3Object::get()
+{
+    if (!d->account) return 0;
+    QNetworkRequest request = d->request(d->bucket, d->key, d->versionId);
+    d->start(QS3NetworkAccessManager::instance().send(d->account, request, QNetworkAccessManager::GetOperation), QNetworkAccessManager::GetOperation);
+    return d->device;
+}
+
+void QS3Object::put(const QByteArray &data)
+{
+    if (!d->account) return;
+    QNetworkRequest request = d->request(d->bucket, d->key, QString());
+    d->describe(&request);
+    d->start(QS3NetworkAccessManager::instance().send(d->account, request, QNetworkAccessManager::PutOperation, data), QNetworkAccessManager::PutOperation);
+}
+
+void QS3Object::put(QIODevice *data)
+{
+    if (!d->account || !data) return;
+    QNetworkRequest request = d->request(d->bucket, d->key, QString());
+    d->describe(&request);
+    d->detach();
+    setRunning(true);
+    int generation = ++d->generation;
+    QS3NetworkAccessManager::instance().send(d->account, request, QNetworkAccessManager::PutOperation, data, this, [this, generation](QNetworkReply *reply) {
+        // superseded or aborted while the body was being compressed
+        if (generation != d->generation) {
+            if (reply) {
+                reply->abort();
+                reply->deleteLater();
+            }
+            return;
+        }
+        d->start(reply, QNetworkAccessManager::PutOperation);
+    });
+}
+
+void QS3Object::head()
+{
+    if (!d->account) return;
+    QNetworkRequest request = d->request(d->bucket, d->key, d->versionId);
+    d->start(QS3NetworkAccessManager::instance().send(d->account, request, QNetworkAccessManager::HeadOperation), QNetworkAccessManager::HeadOperation);
+}
+
+void QS3Object::remove()
+{
+    if (!d->account) return;
+    QNetworkRequest request = d->request(d->bucket, d->key, d->versionId);
+    d->start(QS3NetworkAccessManager::instance().send(d->account, request, QNetworkAccessManager::DeleteOperation), QNetworkAccessManager::DeleteOperation);
+}
+
+void QS3Object::copy(const QString &bucket, const QString &key)
+{
+    if (!d->account) return;
+    QByteArray source = '/' + d->bucket.toUtf8() + '/' + QUrl::toPercentEncoding(d->key, "/");
+    if (!d->versionId.isEmpty())
+        source.append("?versionId=" + QUrl::toPercentEncoding(d->versionId));
+    QNetworkRequest request = d->request(bucket, key, QString());
+    request.setAttribute(QS3NetworkAccessManager::CompressionAttribute, false);
+    request.setRawHeader("x-amz-copy-source", source);
+    d->start(QS3NetworkAccessManager::instance().send(d->account, request, QNetworkAccessManager::PutOperation), QNetworkAccessManager::PutOperation);
+    d->copying = d->reply;
+}
+
+void QS3Object::abort()
+{
+    if (!d->reply && d->running) {
+        // still compressing, the reply is dropped when it turns up
+        d->generation++;
+        setRunning(false);
+        emit failed(0);
+        return;
+    }
+    if (!d->reply || !d->running) return;
+    d->reply->abort();
+}
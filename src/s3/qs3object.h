@@ -0,0 +1,130 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3OBJECT_H
+#define QS3OBJECT_H
+
+#include "s3_global.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QObject>
+#include <QtCore/QVariantMap>
+
+class QAccount;
+class QIODevice;
+
+class S3_EXPORT QS3Object : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QAccount *account READ account WRITE setAccount NOTIFY accountChanged)
+    Q_PROPERTY(QString bucket READ bucket WRITE setBucket NOTIFY bucketChanged)
+    Q_PROPERTY(QString key READ key WRITE setKey NOTIFY keyChanged)
+    Q_PROPERTY(QString versionId READ versionId WRITE setVersionId NOTIFY versionIdChanged)
+    Q_PROPERTY(bool compressed READ compressed WRITE setCompressed NOTIFY compressedChanged)
+    Q_PROPERTY(QString contentType READ contentType WRITE setContentType NOTIFY contentTypeChanged)
+    Q_PROPERTY(QVariantMap metadata READ metadata WRITE setMetadata NOTIFY metadataChanged)
+    Q_PROPERTY(bool buffered READ buffered WRITE setBuffered NOTIFY bufferedChanged)
+    Q_PROPERTY(QString eTag READ eTag NOTIFY eTagChanged)
+    Q_PROPERTY(QDateTime lastModified READ lastModified NOTIFY lastModifiedChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(qint64 bytesReceived READ bytesReceived NOTIFY bytesReceivedChanged)
+    Q_PROPERTY(qint64 bytesSent READ bytesSent NOTIFY bytesSentChanged)
+    Q_PROPERTY(qint64 bytesTotal READ bytesTotal NOTIFY bytesTotalChanged)
+    Q_PROPERTY(QIODevice *device READ device NOTIFY deviceChanged)
+public:
+    explicit QS3Object(QObject *parent = 0);
+
+    QAccount *account() const;
+    const QString &bucket() const;
+    const QString &key() const;
+    const QString &versionId() const;
+    bool compressed() const;
+    const QString &contentType() const;
+    const QVariantMap &metadata() const;
+    bool buffered() const;
+    const QString &eTag() const;
+    const QDateTime &lastModified() const;
+    bool running() const;
+    qint64 bytesReceived() const;
+    qint64 bytesSent() const;
+    qint64 bytesTotal() const;
+    QIODevice *device() const;
+
+    Q_INVOKABLE QByteArray readAll();
+
+public slots:
+    void setAccount(QAccount *account);
+    void setBucket(const QString &bucket);
+    void setKey(const QString &key);
+    void setVersionId(const QString &versionId);
+    void setCompressed(bool compressed);
+    void setContentType(const QString &contentType);
+    void setMetadata(const QVariantMap &metadata);
+    void setBuffered(bool buffered);
+
+    QIODevice *get();
+    void put(const QByteArray &data);
+    void put(QIODevice *data);
+    void head();
+    void remove();
+    void copy(const QString &bucket, const QString &key);
+    void abort();
+
+private slots:
+    void setETag(const QString &eTag);
+    void setLastModified(const QDateTime &lastModified);
+    void setRunning(bool running);
+    void setBytesReceived(qint64 bytesReceived);
+    void setBytesSent(qint64 bytesSent);
+    void setBytesTotal(qint64 bytesTotal);
+
+signals:
+    void accountChanged(QAccount *account);
+    void bucketChanged(const QString &bucket);
+    void keyChanged(const QString &key);
+    void versionIdChanged(const QString &versionId);
+    void compressedChanged(bool compressed);
+    void contentTypeChanged(const QString &contentType);
+    void metadataChanged(const QVariantMap &metadata);
+    void bufferedChanged(bool buffered);
+    void eTagChanged(const QString &eTag);
+    void lastModifiedChanged(const QDateTime &lastModified);
+    void runningChanged(bool running);
+    void bytesReceivedChanged(qint64 bytesReceived);
+    void bytesSentChanged(qint64 bytesSent);
+    void bytesTotalChanged(qint64 bytesTotal);
+    void deviceChanged(QIODevice *device);
+
+    void readyRead();
+    void failed(int httpStatusCode);
+    void finished();
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3OBJECT_H
@@ -0,0 +1,167 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3presigner.h"
+#include "qs3networkaccessmanager.h"
+#include "qaccount.h"
+#include "qbucket.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QMessageAuthenticationCode>
+
+class QS3Presigner::Private
+{
+public:
+    Private(QS3Presigner *parent);
+
+    QUrl sign(const QUrl &url, Method method, const QByteArray &contentType, const QByteArray &expires);
+    QByteArray expiry() const;
+
+private:
+    QS3Presigner *q;
+
+public:
+    QAccount *account;
+    int expires;
+    QMessageAuthenticationCode *mac;
+};
+
+QS3Presigner::Private::Private(QS3Presigner *parent)
+    : q(parent)
+    , account(0)
+    , expires(3600)
+    , mac(0)
+{
+}
+
+QByteArray QS3Presigner::Private::expiry() const
+{
+    return QByteArray::number(QDateTime::currentDateTimeUtc().toTime_t() + expires);
+}
+
+QUrl QS3Presigner::Private::sign(const QUrl &url, Method method, const QByteArray &contentType, const QByteArray &expires)
+{
+    static const char *verbs[] = { "GET", "PUT", "HEAD", "DELETE" };
+
+    // the keyed hash is set up once per secret, every url only feeds its own string to sign
+    if (!mac)
+        mac = new QMessageAuthenticationCode(QCryptographicHash::Sha1, account->awsSecretAccessKey());
+    mac->reset();
+    mac->addData(verbs[method]);
+    mac->addData("\n\n");
+    mac->addData(contentType);
+    mac->addData("\n");
+    mac->addData(expires);
+    mac->addData("\n");
+    mac->addData(QS3NetworkAccessManager::canonicalizedResource(url));
+
+    QString query = url.query(QUrl::FullyEncoded);
+    if (!query.isEmpty())
+        query.append(QLatin1Char('&'));
+    query.append(QStringLiteral("AWSAccessKeyId=%1&Expires=%2&Signature=%3")
+                 .arg(QString::fromLatin1(QUrl::toPercentEncoding(account->awsAccessKeyId())))
+                 .arg(QString::fromLatin1(expires))
+                 .arg(QString::fromLatin1(QUrl::toPercentEncoding(mac->result().toBase64()))));
+
+    QUrl ret(url);
+    ret.setQuery(query, QUrl::StrictMode);
+    return ret;
+}
+
+QS3Presigner::QS3Presigner(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3Presigner::destroyed, [d]() { delete d->mac; delete d; });
+}
+
+QAccount *QS3Presigner::account() const
+{
+    return d->account;
+}
+
+void QS3Presigner::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    if (d->account)
+        disconnect(d->account, 0, this, 0);
+    delete d->mac;
+    d->mac = 0;
+    d->account = account;
+    if (account) {
+        connect(account, &QAccount::awsSecretAccessKeyChanged, this, [this]() {
+            delete d->mac;
+            d->mac = 0;
+        });
+    }
+    emit accountChanged(account);
+}
+
+int QS3Presigner::expires() const
+{
+    return d->expires;
+}
+
+void QS3Presigner::setExpires(int expires)
+{
+    if (d->expires == expires) return;
+    d->expires = expires;
+    emit expiresChanged(expires);
+}
+
+QUrl QS3Presigner::url(const QString &bucket, const QString &key, Method method, const QString &contentType) const
+{
+    if (!d->account) return QUrl();
+    return d->sign(d->account->url(bucket, key), method, contentType.toUtf8(), d->expiry());
+}
+
+QStringList QS3Presigner::urls(const QString &bucket, const QStringList &keys, Method method) const
+{
+    QStringList ret;
+    if (!d->account) return ret;
+
+    QByteArray expires = d->expiry();
+    foreach (const QString &key, keys)
+        ret.append(d->sign(d->account->url(bucket, key), method, QByteArray(), expires).toString(QUrl::FullyEncoded));
+    return ret;
+}
+
+QStringList QS3Presigner::urls(QBucket *bucket, Method method) const
+{
+    // one url per row, common prefixes have none
+    QStringList ret;
+    if (!d->account || !bucket) return ret;
+
+    QByteArray expires = d->expiry();
+    for (int i = 0; i < bucket->rowCount(QModelIndex()); i++) {
+        QString key = bucket->get(i).value(QStringLiteral("key")).toString();
+        if (key.isEmpty() || key.endsWith(QLatin1Char('/')))
+            ret.append(QString());
+        else
+            ret.append(d->sign(d->account->url(bucket->name(), key), method, QByteArray(), expires).toString(QUrl::FullyEncoded));
+    }
+    return ret;
+}
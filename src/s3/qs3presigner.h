@@ -0,0 +1,75 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3PRESIGNER_H
+#define QS3PRESIGNER_H
+
+#include "s3_global.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtCore/QUrl>
+
+class QAccount;
+class QBucket;
+
+class S3_EXPORT QS3Presigner : public QObject
+{
+    Q_OBJECT
+    Q_ENUMS(Method)
+    Q_PROPERTY(QAccount *account READ account WRITE setAccount NOTIFY accountChanged)
+    Q_PROPERTY(int expires READ expires WRITE setExpires NOTIFY expiresChanged)
+public:
+    enum Method {
+        Get,
+        Put,
+        Head,
+        Delete
+    };
+
+    explicit QS3Presigner(QObject *parent = 0);
+
+    QAccount *account() const;
+    int expires() const;
+
+    Q_INVOKABLE QUrl url(const QString &bucket, const QString &key, Method method = Get, const QString &contentType = QString()) const;
+    Q_INVOKABLE QStringList urls(const QString &bucket, const QStringList &keys, Method method = Get) const;
+    Q_INVOKABLE QStringList urls(QBucket *bucket, Method method = Get) const;
+
+public slots:
+    void setAccount(QAccount *account);
+    void setExpires(int expires);
+
+signals:
+    void accountChanged(QAccount *account);
+    void expiresChanged(int expires);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3PRESIGNER_H
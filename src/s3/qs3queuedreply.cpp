@@ -0,0 +1,188 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3queuedreply.h"
+
+#include <QtCore/QPointer>
+
+class QS3QueuedReply::Private
+{
+public:
+    Private(QS3QueuedReply *parent);
+
+    void readMetaData();
+    void fail(QNetworkReply::NetworkError error, const QString &errorString);
+    void finished();
+
+private:
+    QS3QueuedReply *q;
+
+public:
+    QPointer<QNetworkReply> reply;
+    qint64 readBufferSize;
+};
+
+QS3QueuedReply::Private::Private(QS3QueuedReply *parent)
+    : q(parent)
+    , readBufferSize(0)
+{
+}
+
+void QS3QueuedReply::Private::readMetaData()
+{
+    // QNetworkReply has no way to list its attributes, these are the ones an HTTP reply carries
+    static const QNetworkRequest::Attribute attributes[] = {
+        QNetworkRequest::HttpStatusCodeAttribute,
+        QNetworkRequest::HttpReasonPhraseAttribute,
+        QNetworkRequest::RedirectionTargetAttribute,
+        QNetworkRequest::ConnectionEncryptedAttribute,
+        QNetworkRequest::SourceIsFromCacheAttribute,
+        QNetworkRequest::HttpPipeliningWasUsedAttribute
+    };
+    for (uint i = 0; i < sizeof(attributes) / sizeof(attributes[0]); i++)
+        q->setAttribute(attributes[i], reply->attribute(attributes[i]));
+    foreach (const QNetworkReply::RawHeaderPair &header, reply->rawHeaderPairs())
+        q->setRawHeader(header.first, header.second);
+    q->setUrl(reply->url());
+}
+
+void QS3QueuedReply::Private::fail(QNetworkReply::NetworkError error, const QString &errorString)
+{
+    q->setError(error, errorString);
+    q->setFinished(true);
+    emit q->error(error);
+    emit q->readChannelFinished();
+    emit q->finished();
+}
+
+void QS3QueuedReply::Private::finished()
+{
+    readMetaData();
+    if (reply->error() != QNetworkReply::NoError)
+        q->setError(reply->error(), reply->errorString());
+    q->setFinished(true);
+    emit q->readChannelFinished();
+    emit q->finished();
+}
+
+QS3QueuedReply::QS3QueuedReply(const QNetworkRequest &request, QNetworkAccessManager::Operation operation, QObject *parent)
+    : QNetworkReply(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3QueuedReply::destroyed, [d]() { delete d; });
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(operation);
+    // the data stays in the real reply, a second buffer here would hide it from its read buffer limit
+    open(ReadOnly | Unbuffered);
+}
+
+QS3QueuedReply::~QS3QueuedReply()
+{
+    if (!d->reply) return;
+    disconnect(d->reply, 0, this, 0);
+    if (d->reply->isRunning())
+        d->reply->abort();
+    d->reply->deleteLater();
+}
+
+void QS3QueuedReply::attach(QNetworkReply *reply)
+{
+    if (isFinished()) {
+        // aborted while it waited
+        if (reply) {
+            reply->abort();
+            reply->deleteLater();
+        }
+        return;
+    }
+    if (!reply) {
+        d->fail(UnknownNetworkError, tr("The request could not be sent"));
+        return;
+    }
+
+    d->reply = reply;
+    setRequest(reply->request());
+    if (d->readBufferSize > 0)
+        reply->setReadBufferSize(d->readBufferSize);
+
+    connect(reply, &QNetworkReply::metaDataChanged, this, [this]() {
+        d->readMetaData();
+        emit metaDataChanged();
+    });
+    connect(reply, &QNetworkReply::readyRead, this, &QS3QueuedReply::readyRead);
+    connect(reply, &QNetworkReply::downloadProgress, this, &QS3QueuedReply::downloadProgress);
+    connect(reply, &QNetworkReply::uploadProgress, this, &QS3QueuedReply::uploadProgress);
+    connect(reply, static_cast<void (QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::error), this, [this](QNetworkReply::NetworkError error) {
+        setError(error, d->reply->errorString());
+        emit this->error(error);
+    });
+    connect(reply, &QNetworkReply::finished, this, [this]() { d->finished(); });
+}
+
+void QS3QueuedReply::abort()
+{
+    if (isFinished()) return;
+    if (d->reply) {
+        d->reply->abort();
+        return;
+    }
+    d->fail(OperationCanceledError, tr("Operation canceled"));
+}
+
+void QS3QueuedReply::close()
+{
+    abort();
+    QNetworkReply::close();
+}
+
+bool QS3QueuedReply::isSequential() const
+{
+    return true;
+}
+
+qint64 QS3QueuedReply::bytesAvailable() const
+{
+    if (!d->reply) return 0;
+    return d->reply->bytesAvailable();
+}
+
+void QS3QueuedReply::setReadBufferSize(qint64 size)
+{
+    QNetworkReply::setReadBufferSize(size);
+    d->readBufferSize = size;
+    if (d->reply)
+        d->reply->setReadBufferSize(size);
+}
+
+qint64 QS3QueuedReply::readData(char *data, qint64 maxSize)
+{
+    if (!d->reply) return isFinished() ? -1 : 0;
+    qint64 ret = d->reply->read(data, maxSize);
+    if (ret == 0 && d->reply->isFinished())
+        return -1;
+    return ret;
+}
@@ -0,0 +1,59 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3QUEUEDREPLY_H
+#define QS3QUEUEDREPLY_H
+
+#include "s3_global.h"
+
+#include <QtNetwork/QNetworkReply>
+
+// stands in for a request that waits for its window, the real reply is attached once it is sent
+class S3_EXPORT QS3QueuedReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    QS3QueuedReply(const QNetworkRequest &request, QNetworkAccessManager::Operation operation, QObject *parent = 0);
+    ~QS3QueuedReply();
+
+    // 0 when the request could not be sent after all
+    void attach(QNetworkReply *reply);
+
+    virtual void abort();
+    virtual void close();
+    virtual bool isSequential() const;
+    virtual qint64 bytesAvailable() const;
+    virtual void setReadBufferSize(qint64 size);
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3QUEUEDREPLY_H
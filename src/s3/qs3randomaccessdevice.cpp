@@ -0,0 +1,378 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3randomaccessdevice.h"
+#include "qs3networkaccessmanager.h"
+#include "qs3blockcache.h"
+#include "qaccount.h"
+
+#include <QtCore/QCache>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QHash>
+#include <QtCore/QPointer>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtNetwork/QNetworkReply>
+
+class QS3RandomAccessDevice::Private
+{
+public:
+    Private(QS3RandomAccessDevice *parent, QAccount *account, const QString &bucket, const QString &key);
+    ~Private();
+
+    bool head();
+    qint64 blockCount() const;
+    qint64 blockLength(qint64 index) const;
+    bool available(qint64 index);
+    void fetch(qint64 first, qint64 last);
+    void received(QNetworkReply *reply, qint64 first, qint64 last);
+    void cancel(QNetworkReply *reply);
+    const QByteArray *block(qint64 index);
+
+private:
+    QS3RandomAccessDevice *q;
+
+public:
+    QPointer<QAccount> account;
+    QString bucket;
+    QString key;
+    qint64 blockSize;
+    int readAhead;
+    int timeout;
+    qint64 size;
+    QByteArray eTag;
+
+    QCache<qint64, QByteArray> blocks;
+    QHash<qint64, QNetworkReply *> pending;
+    QEventLoop *loop;
+    qint64 lastBlock;
+    int sequential;
+};
+
+QS3RandomAccessDevice::Private::Private(QS3RandomAccessDevice *parent, QAccount *account, const QString &bucket, const QString &key)
+    : q(parent)
+    , account(account)
+    , bucket(bucket)
+    , key(key)
+    , blockSize(256 * 1024)
+    , readAhead(4)
+    , timeout(30000)
+    , size(-1)
+    , blocks(64)
+    , loop(0)
+    , lastBlock(-2)
+    , sequential(0)
+{
+}
+
+QS3RandomAccessDevice::Private::~Private()
+{
+    foreach (QNetworkReply *reply, pending.values().toSet()) {
+        disconnect(reply, 0, q, 0);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+bool QS3RandomAccessDevice::Private::head()
+{
+    if (!account) return false;
+
+    QEventLoop loop;
+    QNetworkReply *reply = QS3NetworkAccessManager::instance().send(account, QNetworkRequest(account->url(bucket, key)), QNetworkAccessManager::HeadOperation);
+    connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    QTimer::singleShot(timeout, &loop, &QEventLoop::quit);
+    loop.exec();
+    reply->deleteLater();
+
+    if (!reply->isFinished()) {
+        disconnect(reply, 0, &loop, 0);
+        reply->abort();
+        q->setErrorString(QStringLiteral("timed out"));
+        return false;
+    }
+
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200) {
+        q->setErrorString(reply->errorString());
+        return false;
+    }
+    size = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+    eTag = reply->rawHeader("ETag");
+    return true;
+}
+
+qint64 QS3RandomAccessDevice::Private::blockCount() const
+{
+    return (size + blockSize - 1) / blockSize;
+}
+
+qint64 QS3RandomAccessDevice::Private::blockLength(qint64 index) const
+{
+    return qMin(blockSize, size - index * blockSize);
+}
+
+bool QS3RandomAccessDevice::Private::available(qint64 index)
+{
+    if (blocks.contains(index) || pending.contains(index)) return true;
+
+    // other processes on this host may have fetched it already
+    QByteArray data = QS3BlockCache::instance().read(bucket, key, eTag, blockSize, index);
+    if (data.size() != blockLength(index)) return false;
+    blocks.insert(index, new QByteArray(data));
+    return true;
+}
+
+void QS3RandomAccessDevice::Private::fetch(qint64 first, qint64 last)
+{
+    // one ranged get for every run of adjacent blocks that are neither cached nor on their way
+    last = qMin(last, blockCount() - 1);
+    for (qint64 index = first; index <= last; index++) {
+        if (available(index)) continue;
+        qint64 end = index;
+        while (end < last && !available(end + 1))
+            end++;
+
+        QNetworkRequest request(account->url(bucket, key));
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(index * blockSize) + '-' + QByteArray::number(qMin(size, (end + 1) * blockSize) - 1));
+        request.setRawHeader("If-Match", eTag);
+        request.setRawHeader("Accept-Encoding", "identity");
+        QNetworkReply *reply = QS3NetworkAccessManager::instance().send(account, request, QNetworkAccessManager::GetOperation);
+        connect(reply, &QNetworkReply::finished, q, [this, reply, index, end]() {
+            received(reply, index, end);
+        });
+        for (qint64 i = index; i <= end; i++)
+            pending.insert(i, reply);
+        index = end;
+    }
+}
+
+void QS3RandomAccessDevice::Private::received(QNetworkReply *reply, qint64 first, qint64 last)
+{
+    reply->deleteLater();
+    for (qint64 i = first; i <= last; i++)
+        pending.remove(i);
+
+    QByteArray data = reply->readAll();
+    qint64 begin = first * blockSize;
+    qint64 end = qMin(size, (last + 1) * blockSize);
+    switch (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt()) {
+    case 200:
+        // the whole object instead of the range
+        if (data.size() != size) {
+            q->setErrorString(QStringLiteral("short read"));
+            data.clear();
+            break;
+        }
+        data = data.mid(begin, end - begin);
+        break;
+    case 206: {
+        // the range that came back has to be exactly the one asked for
+        QByteArray contentRange = reply->rawHeader("Content-Range");
+        QByteArray expected = "bytes " + QByteArray::number(begin) + '-' + QByteArray::number(end - 1) + '/';
+        if (!contentRange.startsWith(expected) || data.size() != end - begin) {
+            q->setErrorString(QStringLiteral("unexpected range %1").arg(QString::fromLatin1(contentRange)));
+            data.clear();
+        }
+        break; }
+    case 412:
+        q->setErrorString(QStringLiteral("the object changed while it was read"));
+        data.clear();
+        break;
+    default:
+        q->setErrorString(reply->errorString());
+        data.clear();
+        break;
+    }
+
+    if (data.size() == end - begin) {
+        for (qint64 i = first; i <= last; i++) {
+            QByteArray block = data.mid((i - first) * blockSize, blockSize);
+            QS3BlockCache::instance().write(bucket, key, eTag, blockSize, i, block);
+            blocks.insert(i, new QByteArray(block));
+        }
+    }
+
+    if (loop)
+        loop->quit();
+}
+
+void QS3RandomAccessDevice::Private::cancel(QNetworkReply *reply)
+{
+    disconnect(reply, 0, q, 0);
+    reply->abort();
+    reply->deleteLater();
+    foreach (qint64 index, pending.keys(reply))
+        pending.remove(index);
+}
+
+const QByteArray *QS3RandomAccessDevice::Private::block(qint64 index)
+{
+    // readData() has to return data, so wait for the network in a nested loop,
+    // this is why the device must never be read from the gui thread
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (!blocks.contains(index)) {
+        fetch(index, index);
+        if (blocks.contains(index)) break;
+        qint64 remaining = timeout - elapsed.elapsed();
+        if (remaining <= 0) {
+            if (pending.contains(index))
+                cancel(pending.value(index));
+            q->setErrorString(QStringLiteral("timed out"));
+            return 0;
+        }
+        QEventLoop loop;
+        QTimer::singleShot(int(remaining), &loop, &QEventLoop::quit);
+        this->loop = &loop;
+        loop.exec();
+        this->loop = 0;
+        if (!blocks.contains(index) && !pending.contains(index))
+            return 0;
+    }
+    return blocks.object(index);
+}
+
+QS3RandomAccessDevice::QS3RandomAccessDevice(QAccount *account, const QString &bucket, const QString &key, QObject *parent)
+    : QIODevice(parent)
+    , d(new Private(this, account, bucket, key))
+{
+    connect(this, &QS3RandomAccessDevice::destroyed, [d]() { delete d; });
+}
+
+qint64 QS3RandomAccessDevice::blockSize() const
+{
+    return d->blockSize;
+}
+
+void QS3RandomAccessDevice::setBlockSize(qint64 blockSize)
+{
+    if (isOpen() || blockSize <= 0) return;
+    d->blockSize = blockSize;
+}
+
+int QS3RandomAccessDevice::cacheSize() const
+{
+    return d->blocks.maxCost();
+}
+
+void QS3RandomAccessDevice::setCacheSize(int cacheSize)
+{
+    d->blocks.setMaxCost(qMax(1, cacheSize));
+}
+
+int QS3RandomAccessDevice::readAhead() const
+{
+    return d->readAhead;
+}
+
+void QS3RandomAccessDevice::setReadAhead(int readAhead)
+{
+    d->readAhead = qMax(0, readAhead);
+}
+
+int QS3RandomAccessDevice::timeout() const
+{
+    return d->timeout;
+}
+
+void QS3RandomAccessDevice::setTimeout(int timeout)
+{
+    d->timeout = qMax(1, timeout);
+}
+
+QByteArray QS3RandomAccessDevice::eTag() const
+{
+    return d->eTag;
+}
+
+bool QS3RandomAccessDevice::open(OpenMode mode)
+{
+    if (mode & WriteOnly) return false;
+    if (d->size < 0 && !d->head()) return false;
+    return QIODevice::open(mode | Unbuffered);
+}
+
+void QS3RandomAccessDevice::close()
+{
+    QIODevice::close();
+    d->blocks.clear();
+    d->lastBlock = -2;
+    d->sequential = 0;
+}
+
+bool QS3RandomAccessDevice::isSequential() const
+{
+    return false;
+}
+
+qint64 QS3RandomAccessDevice::size() const
+{
+    return qMax<qint64>(0, d->size);
+}
+
+qint64 QS3RandomAccessDevice::readData(char *data, qint64 maxSize)
+{
+    qint64 position = pos();
+    qint64 length = qMin(maxSize, size() - position);
+    if (length <= 0) return 0;
+
+    // never hold more blocks than the cache can keep at once
+    qint64 first = position / d->blockSize;
+    qint64 last = qMin((position + length - 1) / d->blockSize, first + d->blocks.maxCost() / 2);
+    length = qMin(length, (last + 1) * d->blockSize - position);
+
+    if (first == d->lastBlock || first == d->lastBlock + 1)
+        d->sequential++;
+    else
+        d->sequential = 0;
+    d->lastBlock = last;
+
+    d->fetch(first, last);
+    if (d->sequential > 1 && d->readAhead > 0)
+        d->fetch(last + 1, last + qMin(d->readAhead, d->blocks.maxCost() / 2));
+
+    qint64 read = 0;
+    for (qint64 index = first; index <= last; index++) {
+        const QByteArray *block = d->block(index);
+        if (!block)
+            return read > 0 ? read : -1;
+        qint64 offset = position + read - index * d->blockSize;
+        qint64 count = qMin<qint64>(length - read, block->size() - offset);
+        if (count <= 0)
+            return read > 0 ? read : -1;
+        memcpy(data + read, block->constData() + offset, count);
+        read += count;
+    }
+    return read;
+}
+
+qint64 QS3RandomAccessDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+}
@@ -0,0 +1,69 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3RANDOMACCESSDEVICE_H
+#define QS3RANDOMACCESSDEVICE_H
+
+#include "s3_global.h"
+
+#include <QtCore/QIODevice>
+
+class QAccount;
+
+// reads wait for the network in nested event loops for up to timeout() msecs,
+// so the device must not be read from the gui thread
+class S3_EXPORT QS3RandomAccessDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    QS3RandomAccessDevice(QAccount *account, const QString &bucket, const QString &key, QObject *parent = 0);
+
+    qint64 blockSize() const;
+    void setBlockSize(qint64 blockSize);
+    int cacheSize() const;
+    void setCacheSize(int cacheSize);
+    int readAhead() const;
+    void setReadAhead(int readAhead);
+    int timeout() const;
+    void setTimeout(int timeout);
+
+    QByteArray eTag() const;
+
+    virtual bool open(OpenMode mode);
+    virtual void close();
+    virtual bool isSequential() const;
+    virtual qint64 size() const;
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3RANDOMACCESSDEVICE_H
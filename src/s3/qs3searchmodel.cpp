@@ -0,0 +1,377 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3searchmodel.h"
+#include "qs3keyindex.h"
+#include "qs3trace.h"
+
+#include <QtCore/QRegularExpression>
+
+#include <algorithm>
+
+class QS3SearchModel::Private
+{
+public:
+    Private(QS3SearchModel *parent);
+
+    void compile();
+    bool matches(int row) const;
+    void index(int first, int last);
+    void search();
+    void rebuild();
+    void append(int first, int last);
+    void changed(int first, int last, const QVector<int> &roles);
+
+private:
+    QS3SearchModel *q;
+
+public:
+    QString searchBy;
+    QString query;
+    Syntax syntax;
+    bool caseSensitive;
+
+    int role;
+    QS3KeyIndex keys;
+    QVector<int> rows;
+
+    QStringList fragments;
+    QByteArray needle;
+    QRegularExpression expression;
+
+    bool resetting;
+    QList<QMetaObject::Connection> connections;
+};
+
+QS3SearchModel::Private::Private(QS3SearchModel *parent)
+    : q(parent)
+    , searchBy(QStringLiteral("key"))
+    , syntax(Substring)
+    , caseSensitive(false)
+    , role(-1)
+    , resetting(false)
+{
+}
+
+void QS3SearchModel::Private::compile()
+{
+    fragments.clear();
+    needle = query.toUtf8();
+    expression = QRegularExpression();
+    if (query.isEmpty()) return;
+
+    switch (syntax) {
+    case Substring:
+        fragments.append(query);
+        break;
+    case Wildcard: {
+        // the literal runs between wildcards are what the index can look up
+        QString pattern;
+        QString fragment;
+        foreach (const QChar &c, query) {
+            if (c == QLatin1Char('*') || c == QLatin1Char('?')) {
+                pattern.append(c == QLatin1Char('*') ? QStringLiteral(".*") : QStringLiteral("."));
+                if (!fragment.isEmpty())
+                    fragments.append(fragment);
+                fragment.clear();
+            } else {
+                pattern.append(QRegularExpression::escape(QString(c)));
+                fragment.append(c);
+            }
+        }
+        if (!fragment.isEmpty())
+            fragments.append(fragment);
+        expression = QRegularExpression(QStringLiteral("\\A(?:%1)\\z").arg(pattern), caseSensitive ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
+        expression.optimize();
+        break; }
+    }
+}
+
+bool QS3SearchModel::Private::matches(int row) const
+{
+    if (query.isEmpty()) return true;
+    switch (syntax) {
+    case Substring:
+        if (caseSensitive)
+            return keys.bytes(row).contains(needle);
+        return keys.key(row).contains(query, Qt::CaseInsensitive);
+    case Wildcard:
+        return expression.match(keys.key(row)).hasMatch();
+    }
+    return false;
+}
+
+void QS3SearchModel::Private::index(int first, int last)
+{
+    QAbstractItemModel *model = q->sourceModel();
+    for (int row = first; row <= last; row++)
+        keys.append(model->data(model->index(row, 0), role).toString());
+}
+
+void QS3SearchModel::Private::search()
+{
+    QS3_TRACE_SCOPE("search", "query");
+    rows.clear();
+    QVector<int> candidates;
+    if (query.isEmpty() || !keys.candidates(fragments, &candidates)) {
+        // nothing to narrow with, scan the arena instead of the source model
+        for (int row = 0; row < keys.count(); row++) {
+            if (matches(row))
+                rows.append(row);
+        }
+        return;
+    }
+    foreach (int row, candidates) {
+        if (matches(row))
+            rows.append(row);
+    }
+}
+
+void QS3SearchModel::Private::rebuild()
+{
+    QAbstractItemModel *model = q->sourceModel();
+    role = model && !searchBy.isEmpty() ? model->roleNames().key(searchBy.toUtf8(), -1) : -1;
+    keys.clear();
+    if (role >= 0 && model->rowCount() > 0)
+        index(0, model->rowCount() - 1);
+    search();
+}
+
+void QS3SearchModel::Private::append(int first, int last)
+{
+    // a listing streaming in, only the new rows are indexed and matched
+    index(first, last);
+    QVector<int> matched;
+    for (int row = first; row <= last; row++) {
+        if (matches(row))
+            matched.append(row);
+    }
+    if (matched.isEmpty()) return;
+    q->beginInsertRows(QModelIndex(), rows.count(), rows.count() + matched.count() - 1);
+    rows += matched;
+    q->endInsertRows();
+}
+
+void QS3SearchModel::Private::changed(int first, int last, const QVector<int> &roles)
+{
+    if (role >= 0 && (roles.isEmpty() || roles.contains(role))) {
+        q->beginResetModel();
+        rebuild();
+        q->endResetModel();
+        return;
+    }
+    QVector<int>::const_iterator begin = std::lower_bound(rows.constBegin(), rows.constEnd(), first);
+    QVector<int>::const_iterator end = std::upper_bound(begin, rows.constEnd(), last);
+    if (begin == end) return;
+    emit q->dataChanged(q->index(begin - rows.constBegin(), 0), q->index(end - rows.constBegin() - 1, q->columnCount() - 1), roles);
+}
+
+QS3SearchModel::QS3SearchModel(QObject *parent)
+    : QAbstractProxyModel(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3SearchModel::destroyed, [d]() { delete d; });
+    connect(this, &QS3SearchModel::rowsInserted, [this]() { emit countChanged(rowCount()); });
+    connect(this, &QS3SearchModel::modelReset, [this]() { emit countChanged(rowCount()); });
+}
+
+void QS3SearchModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (this->sourceModel() == sourceModel) return;
+    foreach (const QMetaObject::Connection &connection, d->connections)
+        disconnect(connection);
+    d->connections.clear();
+
+    beginResetModel();
+    QAbstractProxyModel::setSourceModel(sourceModel);
+    if (sourceModel) {
+        // anything but appending at the end renumbers the arena, so it is built again
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::rowsAboutToBeInserted, this, [this](const QModelIndex &parent, int first) {
+            if (parent.isValid() || d->role < 0 || first == d->keys.count()) return;
+            d->resetting = true;
+            beginResetModel();
+        }));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex &parent, int first, int last) {
+            if (parent.isValid() || d->role < 0) return;
+            if (d->resetting) {
+                d->rebuild();
+                d->resetting = false;
+                endResetModel();
+            } else {
+                d->append(first, last);
+            }
+        }));
+        auto aboutToReset = [this]() {
+            if (d->resetting) return;
+            d->resetting = true;
+            beginResetModel();
+        };
+        auto reset = [this]() {
+            if (!d->resetting) return;
+            d->rebuild();
+            d->resetting = false;
+            endResetModel();
+        };
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, aboutToReset));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::rowsRemoved, this, reset));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::rowsAboutToBeMoved, this, aboutToReset));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::rowsMoved, this, reset));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::modelAboutToBeReset, this, aboutToReset));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::modelReset, this, reset));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::layoutAboutToBeChanged, this, aboutToReset));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::layoutChanged, this, reset));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) {
+            if (!topLeft.parent().isValid())
+                d->changed(topLeft.row(), bottomRight.row(), roles);
+        }));
+    }
+    d->rebuild();
+    endResetModel();
+    emit sourceChanged(sourceModel);
+}
+
+QModelIndex QS3SearchModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() || row < 0 || row >= d->rows.count() || column < 0 || column >= columnCount()) return QModelIndex();
+    return createIndex(row, column);
+}
+
+QModelIndex QS3SearchModel::parent(const QModelIndex &child) const
+{
+    Q_UNUSED(child)
+    return QModelIndex();
+}
+
+int QS3SearchModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) return 0;
+    return d->rows.count();
+}
+
+int QS3SearchModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() || !sourceModel()) return 0;
+    return sourceModel()->columnCount();
+}
+
+QModelIndex QS3SearchModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!proxyIndex.isValid() || !sourceModel() || proxyIndex.row() >= d->rows.count()) return QModelIndex();
+    return sourceModel()->index(d->rows.at(proxyIndex.row()), proxyIndex.column());
+}
+
+QModelIndex QS3SearchModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!sourceIndex.isValid() || sourceIndex.parent().isValid()) return QModelIndex();
+    QVector<int>::const_iterator i = std::lower_bound(d->rows.constBegin(), d->rows.constEnd(), sourceIndex.row());
+    if (i == d->rows.constEnd() || *i != sourceIndex.row()) return QModelIndex();
+    return index(i - d->rows.constBegin(), sourceIndex.column());
+}
+
+const QString &QS3SearchModel::searchBy() const
+{
+    return d->searchBy;
+}
+
+void QS3SearchModel::setSearchBy(const QString &searchBy)
+{
+    if (d->searchBy == searchBy) return;
+    d->searchBy = searchBy;
+    beginResetModel();
+    d->rebuild();
+    endResetModel();
+    emit searchByChanged(searchBy);
+}
+
+const QString &QS3SearchModel::query() const
+{
+    return d->query;
+}
+
+void QS3SearchModel::setQuery(const QString &query)
+{
+    if (d->query == query) return;
+    d->query = query;
+    d->compile();
+    beginResetModel();
+    d->search();
+    endResetModel();
+    emit queryChanged(query);
+}
+
+QS3SearchModel::Syntax QS3SearchModel::syntax() const
+{
+    return d->syntax;
+}
+
+void QS3SearchModel::setSyntax(Syntax syntax)
+{
+    if (d->syntax == syntax) return;
+    d->syntax = syntax;
+    d->compile();
+    beginResetModel();
+    d->search();
+    endResetModel();
+    emit syntaxChanged(syntax);
+}
+
+bool QS3SearchModel::isCaseSensitive() const
+{
+    return d->caseSensitive;
+}
+
+void QS3SearchModel::setCaseSensitive(bool caseSensitive)
+{
+    if (d->caseSensitive == caseSensitive) return;
+    d->caseSensitive = caseSensitive;
+    d->compile();
+    beginResetModel();
+    d->search();
+    endResetModel();
+    emit caseSensitiveChanged(caseSensitive);
+}
+
+int QS3SearchModel::count() const
+{
+    return rowCount();
+}
+
+QVariantMap QS3SearchModel::get(int i) const
+{
+    QVariantMap ret;
+    QModelIndex index = this->index(i, 0);
+    if (!index.isValid()) return ret;
+    QHash<int, QByteArray> roleNames = this->roleNames();
+    foreach (int role, roleNames.keys())
+        ret.insert(QString::fromUtf8(roleNames.value(role)), data(index, role));
+    return ret;
+}
+
+int QS3SearchModel::sourceRow(int i) const
+{
+    if (i < 0 || i >= d->rows.count()) return -1;
+    return d->rows.at(i);
+}
@@ -0,0 +1,89 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3SEARCHMODEL_H
+#define QS3SEARCHMODEL_H
+
+#include "s3_global.h"
+
+#include <QtCore/QAbstractProxyModel>
+#include <QtCore/QVariantMap>
+
+class S3_EXPORT QS3SearchModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QAbstractItemModel *source READ sourceModel WRITE setSourceModel NOTIFY sourceChanged)
+    Q_PROPERTY(QString searchBy READ searchBy WRITE setSearchBy NOTIFY searchByChanged)
+    Q_PROPERTY(QString query READ query WRITE setQuery NOTIFY queryChanged)
+    Q_PROPERTY(Syntax syntax READ syntax WRITE setSyntax NOTIFY syntaxChanged)
+    Q_PROPERTY(bool caseSensitive READ isCaseSensitive WRITE setCaseSensitive NOTIFY caseSensitiveChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+public:
+    enum Syntax {
+        Substring,
+        Wildcard
+    };
+    Q_ENUMS(Syntax)
+
+    explicit QS3SearchModel(QObject *parent = 0);
+
+    virtual void setSourceModel(QAbstractItemModel *sourceModel);
+    virtual QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    virtual QModelIndex parent(const QModelIndex &child) const;
+    virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual QModelIndex mapToSource(const QModelIndex &proxyIndex) const;
+    virtual QModelIndex mapFromSource(const QModelIndex &sourceIndex) const;
+
+    const QString &searchBy() const;
+    const QString &query() const;
+    Syntax syntax() const;
+    bool isCaseSensitive() const;
+    int count() const;
+
+    Q_INVOKABLE QVariantMap get(int i) const;
+    Q_INVOKABLE int sourceRow(int i) const;
+
+public slots:
+    void setSearchBy(const QString &searchBy);
+    void setQuery(const QString &query);
+    void setSyntax(Syntax syntax);
+    void setCaseSensitive(bool caseSensitive);
+
+signals:
+    void sourceChanged(QAbstractItemModel *source);
+    void searchByChanged(const QString &searchBy);
+    void queryChanged(const QString &query);
+    void syntaxChanged(Syntax syntax);
+    void caseSensitiveChanged(bool caseSensitive);
+    void countChanged(int count);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3SEARCHMODEL_H
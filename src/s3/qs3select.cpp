@@ -0,0 +1,396 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3select.h"
+#include "qs3eventstreamdecoder.h"
+#include "qaccount.h"
+#include "qs3trace.h"
+
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QXmlStreamWriter>
+#include <QtNetwork/QNetworkReply>
+
+class QS3Select::Private
+{
+public:
+    Private(QS3Select *parent);
+
+    QByteArray request() const;
+    void decode(QIODevice *io);
+    void stop(QIODevice *io);
+    void records(const QByteArray &payload);
+    void stats(const QByteArray &payload);
+
+private:
+    QS3Select *q;
+
+public:
+    static QHash<int, QByteArray> roleNames;
+    QString bucket;
+    QString key;
+    QString expression;
+    Format inputFormat;
+    Format outputFormat;
+    QString fileHeaderInfo;
+    QString compressionType;
+    qint64 bytesScanned;
+    qint64 bytesProcessed;
+    qint64 bytesReturned;
+
+    QS3EventStreamDecoder decoder;
+    QByteArray partial;
+    bool ended;
+    bool stopped;
+};
+
+QHash<int, QByteArray> QS3Select::Private::roleNames;
+
+static QStringList split(const QString &record)
+{
+    // CSV output quotes fields only where needed
+    QStringList ret;
+    QString field;
+    bool quoted = false;
+    for (int i = 0; i < record.length(); i++) {
+        QChar ch = record.at(i);
+        if (quoted) {
+            if (ch == QLatin1Char('"')) {
+                if (i + 1 < record.length() && record.at(i + 1) == QLatin1Char('"'))
+                    field.append(record.at(++i));
+                else
+                    quoted = false;
+            } else {
+                field.append(ch);
+            }
+        } else if (ch == QLatin1Char('"')) {
+            quoted = true;
+        } else if (ch == QLatin1Char(',')) {
+            ret.append(field);
+            field.clear();
+        } else {
+            field.append(ch);
+        }
+    }
+    ret.append(field);
+    return ret;
+}
+
+QS3Select::Private::Private(QS3Select *parent)
+    : q(parent)
+    , inputFormat(Csv)
+    , outputFormat(Csv)
+    , fileHeaderInfo(QStringLiteral("NONE"))
+    , compressionType(QStringLiteral("NONE"))
+    , bytesScanned(0)
+    , bytesProcessed(0)
+    , bytesReturned(0)
+    , ended(false)
+    , stopped(false)
+{
+}
+
+QByteArray QS3Select::Private::request() const
+{
+    QByteArray ret;
+    QXmlStreamWriter xml(&ret);
+    xml.writeStartElement(QStringLiteral("SelectObjectContentRequest"));
+    xml.writeDefaultNamespace(QStringLiteral("http://s3.amazonaws.com/doc/2006-03-01/"));
+    xml.writeTextElement(QStringLiteral("Expression"), expression);
+    xml.writeTextElement(QStringLiteral("ExpressionType"), QStringLiteral("SQL"));
+
+    xml.writeStartElement(QStringLiteral("InputSerialization"));
+    xml.writeTextElement(QStringLiteral("CompressionType"), compressionType);
+    if (inputFormat == Csv) {
+        xml.writeStartElement(QStringLiteral("CSV"));
+        xml.writeTextElement(QStringLiteral("FileHeaderInfo"), fileHeaderInfo);
+        xml.writeEndElement();
+    } else {
+        xml.writeStartElement(QStringLiteral("JSON"));
+        xml.writeTextElement(QStringLiteral("Type"), QStringLiteral("LINES"));
+        xml.writeEndElement();
+    }
+    xml.writeEndElement();
+
+    xml.writeStartElement(QStringLiteral("OutputSerialization"));
+    xml.writeEmptyElement(outputFormat == Csv ? QStringLiteral("CSV") : QStringLiteral("JSON"));
+    xml.writeEndElement();
+
+    xml.writeStartElement(QStringLiteral("RequestProgress"));
+    xml.writeTextElement(QStringLiteral("Enabled"), QStringLiteral("true"));
+    xml.writeEndElement();
+
+    xml.writeEndElement();
+    return ret;
+}
+
+void QS3Select::Private::decode(QIODevice *io)
+{
+    if (stopped) {
+        io->readAll();
+        return;
+    }
+    decoder.feed(io->readAll());
+
+    QS3EventStreamDecoder::Message message;
+    while (decoder.next(&message)) {
+        QString messageType = message.headers.value(QStringLiteral(":message-type")).toString();
+        if (messageType == QStringLiteral("error")) {
+            emit q->error(message.headers.value(QStringLiteral(":error-code")).toString(), message.headers.value(QStringLiteral(":error-message")).toString());
+            stop(io);
+            return;
+        }
+
+        QString eventType = message.headers.value(QStringLiteral(":event-type")).toString();
+        if (eventType == QStringLiteral("Records"))
+            records(message.payload);
+        else if (eventType == QStringLiteral("Progress") || eventType == QStringLiteral("Stats"))
+            stats(message.payload);
+        else if (eventType == QStringLiteral("End"))
+            ended = true;
+    }
+    if (decoder.hasError()) {
+        emit q->error(QStringLiteral("EventStream"), decoder.errorString());
+        stop(io);
+    }
+}
+
+void QS3Select::Private::stop(QIODevice *io)
+{
+    // the error has been reported, whatever follows is not worth downloading
+    stopped = true;
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(io);
+    if (reply)
+        reply->abort();
+}
+
+void QS3Select::Private::records(const QByteArray &payload)
+{
+    // a record may span two events, keep the unterminated tail for the next one
+    partial.append(payload);
+    int end = partial.lastIndexOf('\n');
+    if (end < 0) return;
+    QStringList records = QString::fromUtf8(partial.constData(), end).split(QLatin1Char('\n'));
+    partial.remove(0, end + 1);
+
+    QList<QVariantMap> rows;
+    foreach (QString record, records) {
+        if (record.endsWith(QLatin1Char('\r')))
+            record.chop(1);
+        QVariantMap row;
+        row.insert(QStringLiteral("record"), record);
+        if (outputFormat == Csv)
+            row.insert(QStringLiteral("fields"), split(record));
+        rows.append(row);
+    }
+    q->append(rows);
+    emit q->recordsReceived(records);
+}
+
+void QS3Select::Private::stats(const QByteArray &payload)
+{
+    QXmlStreamReader xml(payload);
+    while (!xml.atEnd()) {
+        if (xml.readNext() != QXmlStreamReader::StartElement) continue;
+        if (xml.name() == QStringLiteral("BytesScanned"))
+            q->setBytesScanned(xml.readElementText().toLongLong());
+        else if (xml.name() == QStringLiteral("BytesProcessed"))
+            q->setBytesProcessed(xml.readElementText().toLongLong());
+        else if (xml.name() == QStringLiteral("BytesReturned"))
+            q->setBytesReturned(xml.readElementText().toLongLong());
+    }
+}
+
+QS3Select::QS3Select(QObject *parent)
+    : QAbstractS3Model(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3Select::destroyed, [d]() { delete d; });
+}
+
+QHash<int, QByteArray> QS3Select::roleNames() const
+{
+    if (d->roleNames.isEmpty()) {
+        int role = Qt::UserRole;
+        d->roleNames.insert(role++, "record");
+        d->roleNames.insert(role++, "fields");
+    }
+    return d->roleNames;
+}
+
+const QString &QS3Select::bucket() const
+{
+    return d->bucket;
+}
+
+void QS3Select::setBucket(const QString &bucket)
+{
+    if (d->bucket == bucket) return;
+    d->bucket = bucket;
+    emit bucketChanged(bucket);
+}
+
+const QString &QS3Select::key() const
+{
+    return d->key;
+}
+
+void QS3Select::setKey(const QString &key)
+{
+    if (d->key == key) return;
+    d->key = key;
+    emit keyChanged(key);
+}
+
+const QString &QS3Select::expression() const
+{
+    return d->expression;
+}
+
+void QS3Select::setExpression(const QString &expression)
+{
+    if (d->expression == expression) return;
+    d->expression = expression;
+    emit expressionChanged(expression);
+}
+
+QS3Select::Format QS3Select::inputFormat() const
+{
+    return d->inputFormat;
+}
+
+void QS3Select::setInputFormat(Format inputFormat)
+{
+    if (d->inputFormat == inputFormat) return;
+    d->inputFormat = inputFormat;
+    emit inputFormatChanged(inputFormat);
+}
+
+QS3Select::Format QS3Select::outputFormat() const
+{
+    return d->outputFormat;
+}
+
+void QS3Select::setOutputFormat(Format outputFormat)
+{
+    if (d->outputFormat == outputFormat) return;
+    d->outputFormat = outputFormat;
+    emit outputFormatChanged(outputFormat);
+}
+
+const QString &QS3Select::fileHeaderInfo() const
+{
+    return d->fileHeaderInfo;
+}
+
+void QS3Select::setFileHeaderInfo(const QString &fileHeaderInfo)
+{
+    if (d->fileHeaderInfo == fileHeaderInfo) return;
+    d->fileHeaderInfo = fileHeaderInfo;
+    emit fileHeaderInfoChanged(fileHeaderInfo);
+}
+
+const QString &QS3Select::compressionType() const
+{
+    return d->compressionType;
+}
+
+void QS3Select::setCompressionType(const QString &compressionType)
+{
+    if (d->compressionType == compressionType) return;
+    d->compressionType = compressionType;
+    emit compressionTypeChanged(compressionType);
+}
+
+qint64 QS3Select::bytesScanned() const
+{
+    return d->bytesScanned;
+}
+
+void QS3Select::setBytesScanned(qint64 bytesScanned)
+{
+    if (d->bytesScanned == bytesScanned) return;
+    d->bytesScanned = bytesScanned;
+    emit bytesScannedChanged(bytesScanned);
+}
+
+qint64 QS3Select::bytesProcessed() const
+{
+    return d->bytesProcessed;
+}
+
+void QS3Select::setBytesProcessed(qint64 bytesProcessed)
+{
+    if (d->bytesProcessed == bytesProcessed) return;
+    d->bytesProcessed = bytesProcessed;
+    emit bytesProcessedChanged(bytesProcessed);
+}
+
+qint64 QS3Select::bytesReturned() const
+{
+    return d->bytesReturned;
+}
+
+void QS3Select::setBytesReturned(qint64 bytesReturned)
+{
+    if (d->bytesReturned == bytesReturned) return;
+    d->bytesReturned = bytesReturned;
+    emit bytesReturnedChanged(bytesReturned);
+}
+
+void QS3Select::load()
+{
+    if (loading()) return;
+    if (!account()) return;
+    if (d->bucket.isEmpty() || d->key.isEmpty() || d->expression.isEmpty()) return;
+
+    clear();
+    d->decoder = QS3EventStreamDecoder();
+    d->partial.clear();
+    d->ended = false;
+    d->stopped = false;
+    setBytesScanned(0);
+    setBytesProcessed(0);
+    setBytesReturned(0);
+
+    QUrl url = account()->url(d->bucket, d->key);
+    url.setQuery(QStringLiteral("select&select-type=2"));
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, QStringLiteral("application/xml"));
+    start(request, QNetworkAccessManager::PostOperation, d->request());
+}
+
+void QS3Select::received(QIODevice *io)
+{
+    QS3_TRACE_SCOPE("select", "decode");
+    d->decode(io);
+}
+
+void QS3Select::finished(QIODevice *io)
+{
+    d->decode(io);
+    if (!d->ended && !d->stopped)
+        emit error(QStringLiteral("Truncated"), QStringLiteral("the event stream ended without an End event"));
+}
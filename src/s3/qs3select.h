@@ -0,0 +1,109 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3SELECT_H
+#define QS3SELECT_H
+
+#include "qabstracts3model.h"
+
+#include <QtCore/QStringList>
+
+class S3_EXPORT QS3Select : public QAbstractS3Model
+{
+    Q_OBJECT
+    Q_ENUMS(Format)
+    Q_PROPERTY(QString bucket READ bucket WRITE setBucket NOTIFY bucketChanged)
+    Q_PROPERTY(QString key READ key WRITE setKey NOTIFY keyChanged)
+    Q_PROPERTY(QString expression READ expression WRITE setExpression NOTIFY expressionChanged)
+    Q_PROPERTY(Format inputFormat READ inputFormat WRITE setInputFormat NOTIFY inputFormatChanged)
+    Q_PROPERTY(Format outputFormat READ outputFormat WRITE setOutputFormat NOTIFY outputFormatChanged)
+    Q_PROPERTY(QString fileHeaderInfo READ fileHeaderInfo WRITE setFileHeaderInfo NOTIFY fileHeaderInfoChanged)
+    Q_PROPERTY(QString compressionType READ compressionType WRITE setCompressionType NOTIFY compressionTypeChanged)
+    Q_PROPERTY(qint64 bytesScanned READ bytesScanned NOTIFY bytesScannedChanged)
+    Q_PROPERTY(qint64 bytesProcessed READ bytesProcessed NOTIFY bytesProcessedChanged)
+    Q_PROPERTY(qint64 bytesReturned READ bytesReturned NOTIFY bytesReturnedChanged)
+public:
+    enum Format {
+        Csv,
+        Json
+    };
+
+    explicit QS3Select(QObject *parent = 0);
+
+    virtual QHash<int, QByteArray> roleNames() const;
+
+    const QString &bucket() const;
+    const QString &key() const;
+    const QString &expression() const;
+    Format inputFormat() const;
+    Format outputFormat() const;
+    const QString &fileHeaderInfo() const;
+    const QString &compressionType() const;
+    qint64 bytesScanned() const;
+    qint64 bytesProcessed() const;
+    qint64 bytesReturned() const;
+
+public slots:
+    void setBucket(const QString &bucket);
+    void setKey(const QString &key);
+    void setExpression(const QString &expression);
+    void setInputFormat(Format inputFormat);
+    void setOutputFormat(Format outputFormat);
+    void setFileHeaderInfo(const QString &fileHeaderInfo);
+    void setCompressionType(const QString &compressionType);
+
+    void load();
+
+private slots:
+    void setBytesScanned(qint64 bytesScanned);
+    void setBytesProcessed(qint64 bytesProcessed);
+    void setBytesReturned(qint64 bytesReturned);
+
+signals:
+    void bucketChanged(const QString &bucket);
+    void keyChanged(const QString &key);
+    void expressionChanged(const QString &expression);
+    void inputFormatChanged(Format inputFormat);
+    void outputFormatChanged(Format outputFormat);
+    void fileHeaderInfoChanged(const QString &fileHeaderInfo);
+    void compressionTypeChanged(const QString &compressionType);
+    void bytesScannedChanged(qint64 bytesScanned);
+    void bytesProcessedChanged(qint64 bytesProcessed);
+    void bytesReturnedChanged(qint64 bytesReturned);
+
+    void recordsReceived(const QStringList &records);
+    void error(const QString &code, const QString &message);
+
+protected:
+    void received(QIODevice *io);
+    void finished(QIODevice *io);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3SELECT_H
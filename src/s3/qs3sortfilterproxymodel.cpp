@@ -0,0 +1,361 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3sortfilterproxymodel.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QVector>
+
+#include <limits>
+
+class QS3SortFilterProxyModel::Private
+{
+public:
+    enum Type {
+        Unknown,
+        Number,
+        Text
+    };
+
+    Private(QS3SortFilterProxyModel *parent);
+
+    int role(const QString &name) const;
+    void compile();
+    void update(int first, int last);
+    void insert(int first, int last);
+    void remove(int first, int last);
+    void rebuild();
+
+private:
+    QS3SortFilterProxyModel *q;
+
+public:
+    QString sortBy;
+    QString filterBy;
+    QString filterPattern;
+    FilterSyntax filterSyntax;
+    bool caseSensitive;
+
+    // indexed by source row, so that comparing two rows never goes through QVariant
+    Type type;
+    int sortRole;
+    QVector<double> numbers;
+    QVector<QString> texts;
+    int filterRole;
+    QVector<QString> filterTexts;
+    QRegularExpression expression;
+    QList<QMetaObject::Connection> connections;
+};
+
+QS3SortFilterProxyModel::Private::Private(QS3SortFilterProxyModel *parent)
+    : q(parent)
+    , filterSyntax(FixedString)
+    , caseSensitive(false)
+    , type(Unknown)
+    , sortRole(-1)
+    , filterRole(-1)
+{
+}
+
+int QS3SortFilterProxyModel::Private::role(const QString &name) const
+{
+    if (!q->sourceModel() || name.isEmpty()) return -1;
+    return q->sourceModel()->roleNames().key(name.toUtf8(), -1);
+}
+
+void QS3SortFilterProxyModel::Private::compile()
+{
+    // once per pattern, not once per row
+    QString pattern;
+    switch (filterSyntax) {
+    case FixedString:
+        expression = QRegularExpression();
+        return;
+    case Wildcard:
+        foreach (const QChar &c, filterPattern) {
+            if (c == QLatin1Char('*'))
+                pattern.append(QStringLiteral(".*"));
+            else if (c == QLatin1Char('?'))
+                pattern.append(QLatin1Char('.'));
+            else
+                pattern.append(QRegularExpression::escape(QString(c)));
+        }
+        break;
+    case RegularExpression:
+        pattern = filterPattern;
+        break;
+    }
+    expression = QRegularExpression(pattern, caseSensitive ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption);
+    expression.optimize();
+}
+
+void QS3SortFilterProxyModel::Private::update(int first, int last)
+{
+    QAbstractItemModel *model = q->sourceModel();
+    for (int row = first; row <= last; row++) {
+        QModelIndex index = model->index(row, 0);
+        if (sortRole >= 0) {
+            QVariant value = model->data(index, sortRole);
+            if (type == Unknown && value.isValid()) {
+                switch (static_cast<int>(value.type())) {
+                case QMetaType::Int:
+                case QMetaType::UInt:
+                case QMetaType::LongLong:
+                case QMetaType::ULongLong:
+                case QMetaType::Double:
+                case QMetaType::Bool:
+                case QMetaType::QDateTime:
+                    type = Number;
+                    break;
+                default:
+                    type = Text;
+                    break;
+                }
+            }
+            if (value.type() == QVariant::DateTime)
+                numbers[row] = value.toDateTime().toMSecsSinceEpoch();
+            else if (value.isValid() && type == Number)
+                numbers[row] = value.toDouble();
+            else
+                numbers[row] = -std::numeric_limits<double>::infinity();
+            if (type == Text)
+                texts[row] = caseSensitive ? value.toString() : value.toString().toCaseFolded();
+        }
+        if (filterRole >= 0)
+            filterTexts[row] = model->data(index, filterRole).toString();
+    }
+}
+
+void QS3SortFilterProxyModel::Private::insert(int first, int last)
+{
+    int count = last - first + 1;
+    numbers.insert(first, count, 0);
+    texts.insert(first, count, QString());
+    filterTexts.insert(first, count, QString());
+    Type before = type;
+    update(first, last);
+    // the first typed value decides, rows seen before it need their keys again
+    if (before != type && first > 0)
+        update(0, numbers.count() - 1);
+}
+
+void QS3SortFilterProxyModel::Private::remove(int first, int last)
+{
+    int count = last - first + 1;
+    numbers.remove(first, count);
+    texts.remove(first, count);
+    filterTexts.remove(first, count);
+}
+
+void QS3SortFilterProxyModel::Private::rebuild()
+{
+    int count = q->sourceModel() ? q->sourceModel()->rowCount() : 0;
+    type = Unknown;
+    sortRole = role(sortBy);
+    filterRole = role(filterBy);
+    numbers.fill(0, count);
+    texts.fill(QString(), count);
+    filterTexts.fill(QString(), count);
+    if (count > 0)
+        update(0, count - 1);
+}
+
+QS3SortFilterProxyModel::QS3SortFilterProxyModel(QObject *parent)
+    : QSortFilterProxyModel(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3SortFilterProxyModel::destroyed, [d]() { delete d; });
+    setDynamicSortFilter(true);
+    connect(this, &QS3SortFilterProxyModel::rowsInserted, [this]() { emit countChanged(rowCount()); });
+    connect(this, &QS3SortFilterProxyModel::rowsRemoved, [this]() { emit countChanged(rowCount()); });
+    connect(this, &QS3SortFilterProxyModel::modelReset, [this]() { emit countChanged(rowCount()); });
+    connect(this, &QS3SortFilterProxyModel::layoutChanged, [this]() { emit countChanged(rowCount()); });
+}
+
+void QS3SortFilterProxyModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (this->sourceModel() == sourceModel) return;
+    foreach (const QMetaObject::Connection &connection, d->connections)
+        disconnect(connection);
+    d->connections.clear();
+
+    // connected ahead of the base class, keys are in place before it sorts new rows in
+    if (sourceModel) {
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex &parent, int first, int last) {
+            if (!parent.isValid())
+                d->insert(first, last);
+        }));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::rowsRemoved, this, [this](const QModelIndex &parent, int first, int last) {
+            if (!parent.isValid())
+                d->remove(first, last);
+        }));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex &topLeft, const QModelIndex &bottomRight) {
+            d->update(topLeft.row(), bottomRight.row());
+        }));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::modelReset, this, [this]() { d->rebuild(); }));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::layoutChanged, this, [this]() { d->rebuild(); }));
+        d->connections.append(connect(sourceModel, &QAbstractItemModel::rowsMoved, this, [this]() { d->rebuild(); }));
+    }
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+    d->rebuild();
+    invalidate();
+    if (d->sortRole >= 0)
+        sort(0, sortOrder());
+    emit sourceChanged(sourceModel);
+    emit countChanged(rowCount());
+}
+
+const QString &QS3SortFilterProxyModel::sortBy() const
+{
+    return d->sortBy;
+}
+
+void QS3SortFilterProxyModel::setSortBy(const QString &sortBy)
+{
+    if (d->sortBy == sortBy) return;
+    d->sortBy = sortBy;
+    d->rebuild();
+    if (d->sortRole >= 0)
+        sort(0, sortOrder());
+    else
+        sort(-1);
+    emit sortByChanged(sortBy);
+}
+
+void QS3SortFilterProxyModel::setSortOrder(Qt::SortOrder sortOrder)
+{
+    if (this->sortOrder() == sortOrder) return;
+    sort(d->sortRole >= 0 ? 0 : -1, sortOrder);
+    emit sortOrderChanged(sortOrder);
+}
+
+const QString &QS3SortFilterProxyModel::filterBy() const
+{
+    return d->filterBy;
+}
+
+void QS3SortFilterProxyModel::setFilterBy(const QString &filterBy)
+{
+    if (d->filterBy == filterBy) return;
+    d->filterBy = filterBy;
+    d->rebuild();
+    invalidateFilter();
+    emit filterByChanged(filterBy);
+}
+
+const QString &QS3SortFilterProxyModel::filterPattern() const
+{
+    return d->filterPattern;
+}
+
+void QS3SortFilterProxyModel::setFilterPattern(const QString &filterPattern)
+{
+    if (d->filterPattern == filterPattern) return;
+    d->filterPattern = filterPattern;
+    d->compile();
+    invalidateFilter();
+    emit filterPatternChanged(filterPattern);
+}
+
+QS3SortFilterProxyModel::FilterSyntax QS3SortFilterProxyModel::filterSyntax() const
+{
+    return d->filterSyntax;
+}
+
+void QS3SortFilterProxyModel::setFilterSyntax(FilterSyntax filterSyntax)
+{
+    if (d->filterSyntax == filterSyntax) return;
+    d->filterSyntax = filterSyntax;
+    d->compile();
+    invalidateFilter();
+    emit filterSyntaxChanged(filterSyntax);
+}
+
+bool QS3SortFilterProxyModel::isCaseSensitive() const
+{
+    return d->caseSensitive;
+}
+
+void QS3SortFilterProxyModel::setCaseSensitive(bool caseSensitive)
+{
+    if (d->caseSensitive == caseSensitive) return;
+    d->caseSensitive = caseSensitive;
+    d->compile();
+    d->rebuild();
+    invalidate();
+    emit caseSensitiveChanged(caseSensitive);
+}
+
+int QS3SortFilterProxyModel::count() const
+{
+    return rowCount();
+}
+
+QVariantMap QS3SortFilterProxyModel::get(int i) const
+{
+    QVariantMap ret;
+    QModelIndex index = this->index(i, 0);
+    if (!index.isValid()) return ret;
+    QHash<int, QByteArray> roleNames = this->roleNames();
+    foreach (int role, roleNames.keys())
+        ret.insert(QString::fromUtf8(roleNames.value(role)), data(index, role));
+    return ret;
+}
+
+int QS3SortFilterProxyModel::sourceRow(int i) const
+{
+    return mapToSource(index(i, 0)).row();
+}
+
+bool QS3SortFilterProxyModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
+{
+    int l = left.row();
+    int r = right.row();
+    if (l >= d->numbers.count() || r >= d->numbers.count())
+        return QSortFilterProxyModel::lessThan(left, right);
+
+    if (d->type == Private::Text) {
+        int compared = d->texts.at(l).compare(d->texts.at(r));
+        if (compared != 0) return compared < 0;
+    } else if (d->numbers.at(l) != d->numbers.at(r)) {
+        return d->numbers.at(l) < d->numbers.at(r);
+    }
+    // stable, equal keys keep the listing order
+    return l < r;
+}
+
+bool QS3SortFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    Q_UNUSED(sourceParent)
+    if (d->filterRole < 0 || d->filterPattern.isEmpty()) return true;
+    if (sourceRow >= d->filterTexts.count()) return true;
+
+    const QString &text = d->filterTexts.at(sourceRow);
+    if (d->filterSyntax == FixedString)
+        return text.contains(d->filterPattern, d->caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive);
+    return d->expression.match(text).hasMatch();
+}
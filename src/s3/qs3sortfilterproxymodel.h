@@ -0,0 +1,95 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3SORTFILTERPROXYMODEL_H
+#define QS3SORTFILTERPROXYMODEL_H
+
+#include "s3_global.h"
+
+#include <QtCore/QSortFilterProxyModel>
+#include <QtCore/QVariantMap>
+
+class S3_EXPORT QS3SortFilterProxyModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QAbstractItemModel *source READ sourceModel WRITE setSourceModel NOTIFY sourceChanged)
+    Q_PROPERTY(QString sortBy READ sortBy WRITE setSortBy NOTIFY sortByChanged)
+    Q_PROPERTY(Qt::SortOrder sortOrder READ sortOrder WRITE setSortOrder NOTIFY sortOrderChanged)
+    Q_PROPERTY(QString filterBy READ filterBy WRITE setFilterBy NOTIFY filterByChanged)
+    Q_PROPERTY(QString filterPattern READ filterPattern WRITE setFilterPattern NOTIFY filterPatternChanged)
+    Q_PROPERTY(FilterSyntax filterSyntax READ filterSyntax WRITE setFilterSyntax NOTIFY filterSyntaxChanged)
+    Q_PROPERTY(bool caseSensitive READ isCaseSensitive WRITE setCaseSensitive NOTIFY caseSensitiveChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+public:
+    enum FilterSyntax {
+        FixedString,
+        Wildcard,
+        RegularExpression
+    };
+    Q_ENUMS(FilterSyntax)
+
+    explicit QS3SortFilterProxyModel(QObject *parent = 0);
+
+    virtual void setSourceModel(QAbstractItemModel *sourceModel);
+
+    const QString &sortBy() const;
+    const QString &filterBy() const;
+    const QString &filterPattern() const;
+    FilterSyntax filterSyntax() const;
+    bool isCaseSensitive() const;
+    int count() const;
+
+    Q_INVOKABLE QVariantMap get(int i) const;
+    Q_INVOKABLE int sourceRow(int i) const;
+
+public slots:
+    void setSortBy(const QString &sortBy);
+    void setSortOrder(Qt::SortOrder sortOrder);
+    void setFilterBy(const QString &filterBy);
+    void setFilterPattern(const QString &filterPattern);
+    void setFilterSyntax(FilterSyntax filterSyntax);
+    void setCaseSensitive(bool caseSensitive);
+
+signals:
+    void sourceChanged(QAbstractItemModel *source);
+    void sortByChanged(const QString &sortBy);
+    void sortOrderChanged(Qt::SortOrder sortOrder);
+    void filterByChanged(const QString &filterBy);
+    void filterPatternChanged(const QString &filterPattern);
+    void filterSyntaxChanged(FilterSyntax filterSyntax);
+    void caseSensitiveChanged(bool caseSensitive);
+    void countChanged(int count);
+
+protected:
+    virtual bool lessThan(const QModelIndex &left, const QModelIndex &right) const;
+    virtual bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const;
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3SORTFILTERPROXYMODEL_H
@@ -0,0 +1,634 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3sparsebucket.h"
+#include "qs3listbucketresult.h"
+#include "qs3networkaccessmanager.h"
+#include "qaccount.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtCore/QUrlQuery>
+#include <QtNetwork/QNetworkReply>
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+
+// keys are mapped onto [0, 1) as base 95 numbers over printable ASCII, which
+// is enough to interpolate a marker for a row nobody has listed up to yet
+static const int alphabet = 95;
+static const int digits = 8;
+
+static double position(const QString &key)
+{
+    double ret = 0;
+    double scale = 1;
+    for (int i = 0; i < digits; i++) {
+        scale /= alphabet;
+        if (i < key.length())
+            ret += (qBound(0x20, static_cast<int>(key.at(i).unicode()), 0x7e) - 0x20) * scale;
+    }
+    return ret;
+}
+
+static QString keyAt(double position)
+{
+    QString ret;
+    for (int i = 0; i < digits; i++) {
+        position *= alphabet;
+        int digit = qBound(0, static_cast<int>(position), alphabet - 1);
+        ret.append(QChar(0x20 + digit));
+        position -= digit;
+    }
+    while (ret.endsWith(QLatin1Char(' ')))
+        ret.chop(1);
+    return ret;
+}
+
+class QS3SparseBucket::Private
+{
+public:
+    struct Page {
+        QList<QVariantMap> rows;
+        bool truncated;
+        qint64 used;
+        // where the listing started, the last key of the page before or an interpolated guess
+        QString marker;
+    };
+
+    Private(QS3SparseBucket *parent);
+
+    void list(const QString &marker, int maxKeys, const std::function<void(QS3ListBucketResult *)> &done);
+    void send(const QNetworkRequest &request, const std::function<void(QS3ListBucketResult *)> &done);
+    void abort();
+
+    double position(const QVariantMap &row) const;
+    void estimate(QS3ListBucketResult *first);
+    void probe(double lower, double upper, int iteration);
+    void settle(double endPosition);
+    void resize(int count);
+
+    void touch(int page);
+    void request(int page);
+    void pump();
+    void fetch(int page);
+    void received(int page, const QString &marker, QS3ListBucketResult *result);
+    bool joins(int page) const;
+    void refetch(int page);
+    void anchor(int row, double position);
+    double interpolate(int row) const;
+    QString marker(int page) const;
+    void evict();
+
+private:
+    QS3SparseBucket *q;
+
+public:
+    static QHash<int, QByteArray> roleNames;
+    QAccount *account;
+    QString name;
+    QString prefix;
+    int pageSize;
+    int cachePages;
+    bool loading;
+    bool exact;
+    int count;
+
+    int generation;
+    QList<QNetworkReply *> replies;
+    QHash<int, Page> pages;
+    QMap<int, double> anchors;
+    double lastPosition;
+    double endPosition;
+    QList<int> queue;
+    QSet<int> fetching;
+    int last;
+    qint64 tick;
+    QTimer timer;
+    QTimer pumpTimer;
+};
+
+QHash<int, QByteArray> QS3SparseBucket::Private::roleNames;
+
+QS3SparseBucket::Private::Private(QS3SparseBucket *parent)
+    : q(parent)
+    , account(0)
+    , pageSize(1000)
+    , cachePages(16)
+    , loading(false)
+    , exact(false)
+    , count(0)
+    , generation(0)
+    , lastPosition(0)
+    , endPosition(1)
+    , last(0)
+    , tick(0)
+{
+    timer.setInterval(0);
+    timer.setSingleShot(true);
+    connect(&timer, &QTimer::timeout, parent, &QS3SparseBucket::load);
+
+    connect(parent, &QS3SparseBucket::accountChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(parent, &QS3SparseBucket::nameChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(parent, &QS3SparseBucket::prefixChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(parent, &QS3SparseBucket::pageSizeChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+    // data() only notes what is wanted, requests go out once the view is done asking
+    pumpTimer.setInterval(0);
+    pumpTimer.setSingleShot(true);
+    connect(&pumpTimer, &QTimer::timeout, [this]() { pump(); });
+}
+
+void QS3SparseBucket::Private::list(const QString &marker, int maxKeys, const std::function<void(QS3ListBucketResult *)> &done)
+{
+    QUrl url = account->url(name);
+    QUrlQuery query;
+    if (!marker.isEmpty())
+        query.addQueryItem(QStringLiteral("marker"), QString::fromLatin1(QUrl::toPercentEncoding(marker)));
+    query.addQueryItem(QStringLiteral("max-keys"), QString::number(maxKeys));
+    if (!prefix.isEmpty())
+        query.addQueryItem(QStringLiteral("prefix"), QString::fromLatin1(QUrl::toPercentEncoding(prefix)));
+    url.setQuery(query);
+
+    QNetworkRequest request(url);
+    request.setPriority(QNetworkRequest::HighPriority);
+    send(request, done);
+}
+
+void QS3SparseBucket::Private::send(const QNetworkRequest &request, const std::function<void(QS3ListBucketResult *)> &done)
+{
+    int generation = this->generation;
+    auto track = [this](QNetworkReply *reply, bool inFlight) {
+        if (inFlight)
+            replies.append(reply);
+        else
+            replies.removeOne(reply);
+    };
+    QS3NetworkAccessManager::instance().follow(account, request, QNetworkAccessManager::GetOperation, QByteArray(), q, track, [this, done, generation](QNetworkReply *reply) {
+        if (generation != this->generation) return;
+
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode == 200) {
+            QS3ListBucketResult result;
+            if (result.read(reply)) {
+                done(&result);
+                return;
+            }
+        }
+        emit q->failed(httpStatusCode);
+        done(0);
+    });
+}
+
+void QS3SparseBucket::Private::abort()
+{
+    generation++;
+    foreach (QNetworkReply *reply, replies) {
+        disconnect(reply, 0, q, 0);
+        reply->abort();
+        reply->deleteLater();
+    }
+    replies.clear();
+}
+
+double QS3SparseBucket::Private::position(const QVariantMap &row) const
+{
+    return ::position(row.value(QStringLiteral("key")).toString().mid(prefix.length()));
+}
+
+void QS3SparseBucket::Private::estimate(QS3ListBucketResult *first)
+{
+    if (!first) {
+        q->setLoading(false);
+        return;
+    }
+
+    Page page = { first->contents, first->truncated.toBool(), ++tick, QString() };
+    pages.insert(0, page);
+    if (!page.truncated || page.rows.isEmpty()) {
+        resize(page.rows.count());
+        q->setExact(true);
+        q->setLoading(false);
+        return;
+    }
+
+    anchors.insert(0, position(page.rows.first()));
+    lastPosition = position(page.rows.last());
+    probe(lastPosition, 1, 0);
+}
+
+void QS3SparseBucket::Private::probe(double lower, double upper, int iteration)
+{
+    // bisect the key space for the last key, one single key listing per step
+    if (iteration == 24 || upper - lower < 1e-9) {
+        settle(lower);
+        return;
+    }
+
+    double middle = (lower + upper) / 2;
+    list(prefix + keyAt(middle), 1, [this, lower, upper, middle, iteration](QS3ListBucketResult *result) {
+        // page 0 is there either way, the estimate just stays rougher and the listing's end corrects it
+        if (!result)
+            settle(lower);
+        else if (result->contents.isEmpty())
+            probe(lower, middle, iteration + 1);
+        else
+            probe(qMax(middle, position(result->contents.first())), upper, iteration + 1);
+    });
+}
+
+void QS3SparseBucket::Private::settle(double endPosition)
+{
+    this->endPosition = endPosition;
+    int rows = pages.value(0).rows.count();
+    double span = lastPosition - anchors.value(0);
+    double estimate = span > 0 ? rows + (endPosition - lastPosition) * (rows - 1) / span : 2.0 * rows;
+    resize(static_cast<int>(qBound<double>(rows + 1, estimate, INT_MAX / 2)));
+    q->setLoading(false);
+}
+
+void QS3SparseBucket::Private::resize(int count)
+{
+    if (this->count == count) return;
+    if (count > this->count) {
+        q->beginInsertRows(QModelIndex(), this->count, count - 1);
+        this->count = count;
+        q->endInsertRows();
+    } else {
+        q->beginRemoveRows(QModelIndex(), count, this->count - 1);
+        this->count = count;
+        foreach (int page, pages.keys()) {
+            if (page * pageSize >= count)
+                pages.remove(page);
+        }
+        foreach (int row, anchors.keys()) {
+            if (row >= count)
+                anchors.remove(row);
+        }
+        q->endRemoveRows();
+    }
+    emit q->countChanged(count);
+}
+
+void QS3SparseBucket::Private::touch(int page)
+{
+    last = page;
+    QHash<int, Page>::iterator i = pages.find(page);
+    if (i != pages.end())
+        i->used = ++tick;
+}
+
+void QS3SparseBucket::Private::request(int page)
+{
+    if (page < 0 || page * pageSize >= count) return;
+    if (pages.contains(page) || fetching.contains(page) || queue.contains(page)) return;
+    queue.append(page);
+    pumpTimer.start();
+}
+
+void QS3SparseBucket::Private::pump()
+{
+    // the view has moved on from pages far away from the last one it asked for
+    int reach = qMax(1, cachePages / 2);
+    for (int i = queue.count() - 1; i >= 0; i--) {
+        if (qAbs(queue.at(i) - last) > reach)
+            queue.removeAt(i);
+    }
+    int last = this->last;
+    std::sort(queue.begin(), queue.end(), [last](int a, int b) { return qAbs(a - last) < qAbs(b - last); });
+
+    while (fetching.count() < 2 && !queue.isEmpty())
+        fetch(queue.takeFirst());
+}
+
+void QS3SparseBucket::Private::fetch(int page)
+{
+    fetching.insert(page);
+    QString marker = this->marker(page);
+    list(marker, pageSize, [this, page, marker](QS3ListBucketResult *result) {
+        fetching.remove(page);
+        if (result)
+            received(page, marker, result);
+        pump();
+    });
+}
+
+void QS3SparseBucket::Private::received(int page, const QString &marker, QS3ListBucketResult *result)
+{
+    int first = page * pageSize;
+    if (first >= count) return;
+
+    Page entry = { result->contents, result->truncated.toBool(), ++tick, marker };
+    pages.insert(page, entry);
+    // the page before turned up while this one was guessed, list it again from where that one ends
+    if (!joins(page)) {
+        refetch(page);
+        return;
+    }
+    if (!joins(page + 1))
+        refetch(page + 1);
+    if (!entry.rows.isEmpty())
+        anchor(first, position(entry.rows.first()));
+
+    if (!entry.truncated) {
+        // the end of the listing, wherever the estimate put it
+        resize(first + entry.rows.count());
+        q->setExact(true);
+    } else if (first + pageSize >= count) {
+        resize(first + 2 * pageSize);
+    }
+
+    int end = qMin(first + pageSize, count) - 1;
+    if (end >= first)
+        emit q->dataChanged(q->index(first), q->index(end));
+    evict();
+}
+
+bool QS3SparseBucket::Private::joins(int page) const
+{
+    // an interpolated marker lands anywhere, rows would be skipped or shown twice at the seam
+    QHash<int, Page>::const_iterator current = pages.find(page);
+    QHash<int, Page>::const_iterator previous = pages.find(page - 1);
+    if (current == pages.constEnd() || previous == pages.constEnd()) return true;
+    if (!previous->truncated || previous->rows.isEmpty()) return true;
+    return current->marker == previous->rows.last().value(QStringLiteral("key")).toString();
+}
+
+void QS3SparseBucket::Private::refetch(int page)
+{
+    pages.remove(page);
+    int first = page * pageSize;
+    int end = qMin(first + pageSize, count) - 1;
+    if (end >= first)
+        emit q->dataChanged(q->index(first), q->index(end));
+    request(page);
+}
+
+void QS3SparseBucket::Private::anchor(int row, double position)
+{
+    // only positions that keep the anchors monotonic, a skewed page must not fold the mapping
+    QMap<int, double>::const_iterator upper = anchors.upperBound(row);
+    if (upper != anchors.constEnd() && upper.value() <= position) return;
+    if (upper != anchors.constBegin()) {
+        QMap<int, double>::const_iterator lower = upper - 1;
+        if (lower.key() == row) {
+            if (lower != anchors.constBegin() && (lower - 1).value() >= position) return;
+        } else if (lower.value() >= position) {
+            return;
+        }
+    }
+    if (position >= endPosition) return;
+    anchors.insert(row, position);
+}
+
+double QS3SparseBucket::Private::interpolate(int row) const
+{
+    int lowerRow = 0;
+    double lowerPosition = anchors.value(0);
+    int upperRow = count;
+    double upperPosition = endPosition;
+
+    QMap<int, double>::const_iterator upper = anchors.upperBound(row);
+    if (upper != anchors.constEnd()) {
+        upperRow = upper.key();
+        upperPosition = upper.value();
+    }
+    if (upper != anchors.constBegin()) {
+        --upper;
+        lowerRow = upper.key();
+        lowerPosition = upper.value();
+    }
+    if (upperRow <= lowerRow) return lowerPosition;
+    return lowerPosition + (upperPosition - lowerPosition) * (row - lowerRow) / (upperRow - lowerRow);
+}
+
+QString QS3SparseBucket::Private::marker(int page) const
+{
+    if (page == 0) return QString();
+
+    // continue exactly where the previous page stopped when it is at hand
+    QHash<int, Page>::const_iterator previous = pages.find(page - 1);
+    if (previous != pages.constEnd() && previous->truncated && !previous->rows.isEmpty())
+        return previous->rows.last().value(QStringLiteral("key")).toString();
+    return prefix + keyAt(interpolate(page * pageSize));
+}
+
+void QS3SparseBucket::Private::evict()
+{
+    while (pages.count() > qMax(2, cachePages)) {
+        int victim = -1;
+        foreach (int page, pages.keys()) {
+            if (victim < 0 || qAbs(page - last) > qAbs(victim - last)
+                    || (qAbs(page - last) == qAbs(victim - last) && pages.value(page).used < pages.value(victim).used))
+                victim = page;
+        }
+        pages.remove(victim);
+        int first = victim * pageSize;
+        int end = qMin(first + pageSize, count) - 1;
+        if (end >= first)
+            emit q->dataChanged(q->index(first), q->index(end));
+    }
+}
+
+QS3SparseBucket::QS3SparseBucket(QObject *parent)
+    : QAbstractListModel(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3SparseBucket::destroyed, [d]() {
+        d->abort();
+        delete d;
+    });
+}
+
+int QS3SparseBucket::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return d->count;
+}
+
+QVariant QS3SparseBucket::data(const QModelIndex &index, int role) const
+{
+    int row = index.row();
+    if (row < 0 || row >= d->count) return QVariant();
+
+    int page = row / d->pageSize;
+    d->touch(page);
+    QHash<int, Private::Page>::const_iterator i = d->pages.constFind(page);
+    if (i != d->pages.constEnd()) {
+        int offset = row - page * d->pageSize;
+        if (offset < i->rows.count()) {
+            QByteArray roleName = roleNames().value(role);
+            if (roleName == "placeholder")
+                return false;
+            return i->rows.at(offset).value(QString::fromUtf8(roleName));
+        }
+    } else {
+        d->request(page);
+        d->request(page + 1);
+    }
+    return roleNames().value(role) == "placeholder" ? QVariant(true) : QVariant();
+}
+
+QHash<int, QByteArray> QS3SparseBucket::roleNames() const
+{
+    if (d->roleNames.isEmpty()) {
+        int role = Qt::UserRole;
+        d->roleNames.insert(role++, "key");
+        d->roleNames.insert(role++, "lastModified");
+        d->roleNames.insert(role++, "eTag");
+        d->roleNames.insert(role++, "size");
+        d->roleNames.insert(role++, "storageClass");
+        d->roleNames.insert(role++, "owner");
+        d->roleNames.insert(role++, "placeholder");
+    }
+    return d->roleNames;
+}
+
+QVariantMap QS3SparseBucket::get(int i) const
+{
+    QVariantMap ret;
+    QModelIndex index = this->index(i);
+    QHash<int, QByteArray> roleNames = this->roleNames();
+    foreach (int role, roleNames.keys())
+        ret.insert(QString::fromUtf8(roleNames.value(role)), data(index, role));
+    return ret;
+}
+
+QAccount *QS3SparseBucket::account() const
+{
+    return d->account;
+}
+
+void QS3SparseBucket::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    d->account = account;
+    emit accountChanged(account);
+}
+
+const QString &QS3SparseBucket::name() const
+{
+    return d->name;
+}
+
+void QS3SparseBucket::setName(const QString &name)
+{
+    if (d->name == name) return;
+    d->name = name;
+    emit nameChanged(name);
+}
+
+const QString &QS3SparseBucket::prefix() const
+{
+    return d->prefix;
+}
+
+void QS3SparseBucket::setPrefix(const QString &prefix)
+{
+    if (d->prefix == prefix) return;
+    d->prefix = prefix;
+    emit prefixChanged(prefix);
+}
+
+int QS3SparseBucket::pageSize() const
+{
+    return d->pageSize;
+}
+
+void QS3SparseBucket::setPageSize(int pageSize)
+{
+    pageSize = qBound(1, pageSize, 1000);
+    if (d->pageSize == pageSize) return;
+    d->pageSize = pageSize;
+    emit pageSizeChanged(pageSize);
+}
+
+int QS3SparseBucket::cachePages() const
+{
+    return d->cachePages;
+}
+
+void QS3SparseBucket::setCachePages(int cachePages)
+{
+    if (d->cachePages == cachePages) return;
+    d->cachePages = cachePages;
+    emit cachePagesChanged(cachePages);
+    d->evict();
+}
+
+bool QS3SparseBucket::loading() const
+{
+    return d->loading;
+}
+
+void QS3SparseBucket::setLoading(bool loading)
+{
+    if (d->loading == loading) return;
+    d->loading = loading;
+    emit loadingChanged(loading);
+}
+
+bool QS3SparseBucket::isExact() const
+{
+    return d->exact;
+}
+
+void QS3SparseBucket::setExact(bool exact)
+{
+    if (d->exact == exact) return;
+    d->exact = exact;
+    emit exactChanged(exact);
+}
+
+int QS3SparseBucket::count() const
+{
+    return d->count;
+}
+
+void QS3SparseBucket::load()
+{
+    if (!d->account) return;
+    if (d->name.isEmpty()) return;
+
+    d->abort();
+    beginResetModel();
+    d->pages.clear();
+    d->anchors.clear();
+    d->queue.clear();
+    d->fetching.clear();
+    d->count = 0;
+    d->last = 0;
+    d->endPosition = 1;
+    endResetModel();
+    emit countChanged(0);
+
+    setExact(false);
+    setLoading(true);
+    d->list(QString(), d->pageSize, [this](QS3ListBucketResult *result) { d->estimate(result); });
+}
@@ -0,0 +1,95 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3SPARSEBUCKET_H
+#define QS3SPARSEBUCKET_H
+
+#include "s3_global.h"
+
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QVariantMap>
+
+class QAccount;
+
+class S3_EXPORT QS3SparseBucket : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QAccount *account READ account WRITE setAccount NOTIFY accountChanged)
+    Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
+    Q_PROPERTY(QString prefix READ prefix WRITE setPrefix NOTIFY prefixChanged)
+    Q_PROPERTY(int pageSize READ pageSize WRITE setPageSize NOTIFY pageSizeChanged)
+    Q_PROPERTY(int cachePages READ cachePages WRITE setCachePages NOTIFY cachePagesChanged)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+    Q_PROPERTY(bool exact READ isExact NOTIFY exactChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+public:
+    explicit QS3SparseBucket(QObject *parent = 0);
+
+    virtual int rowCount(const QModelIndex &parent) const;
+    virtual QVariant data(const QModelIndex &index, int role) const;
+    virtual QHash<int, QByteArray> roleNames() const;
+
+    QAccount *account() const;
+    const QString &name() const;
+    const QString &prefix() const;
+    int pageSize() const;
+    int cachePages() const;
+    bool loading() const;
+    bool isExact() const;
+    int count() const;
+
+    Q_INVOKABLE QVariantMap get(int i) const;
+
+public slots:
+    void setAccount(QAccount *account);
+    void setName(const QString &name);
+    void setPrefix(const QString &prefix);
+    void setPageSize(int pageSize);
+    void setCachePages(int cachePages);
+
+    void load();
+
+private slots:
+    void setLoading(bool loading);
+    void setExact(bool exact);
+
+signals:
+    void accountChanged(QAccount *account);
+    void nameChanged(const QString &name);
+    void prefixChanged(const QString &prefix);
+    void pageSizeChanged(int pageSize);
+    void cachePagesChanged(int cachePages);
+    void loadingChanged(bool loading);
+    void exactChanged(bool exact);
+    void countChanged(int count);
+    void failed(int httpStatusCode);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3SPARSEBUCKET_H
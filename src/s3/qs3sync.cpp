@@ -0,0 +1,571 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3sync.h"
+
+#include "qaccount.h"
+#include "qbucket.h"
+#include "qs3filesource.h"
+#include "qs3networkaccessmanager.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QSaveFile>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtNetwork/QNetworkReply>
+
+class QS3Sync::Private
+{
+public:
+    struct File {
+        QString path;
+        QString fileName;
+        qint64 size;
+        bool compare;
+        QByteArray md5;
+        // the remote ETag going in, the same one computed locally coming out
+        QString eTag;
+    };
+
+    struct Object {
+        qint64 size;
+        QString eTag;
+    };
+
+    enum Operation {
+        PutObject,
+        GetObject,
+        DeleteObject,
+        RemoveFile
+    };
+
+    struct Job {
+        Operation operation;
+        QString path;
+    };
+
+    Private(QS3Sync *parent);
+
+    void list();
+    void compare();
+    void transfer(const QString &path);
+    void pump();
+    void done(const Job &job, int httpStatusCode);
+    void finish();
+    QString fileName(const QString &path) const;
+
+    static QList<File> scan(const QString &localPath);
+    static File hash(const File &file);
+
+private:
+    QS3Sync *q;
+
+public:
+    QAccount *account;
+    QString bucket;
+    QString prefix;
+    QString localPath;
+    Direction direction;
+    bool deleteExtraneous;
+    int concurrency;
+    bool running;
+    int progress;
+
+    QBucket *listing;
+    int listed;
+    bool listingDone;
+    bool listingFailed;
+    bool scanDone;
+    QFutureWatcher<QList<File> > scanner;
+    QFutureWatcher<File> hasher;
+    QMap<QString, File> files;
+    QMap<QString, Object> objects;
+
+    QList<Job> queue;
+    QList<QNetworkReply *> replies;
+    int total;
+    int completed;
+};
+
+QS3Sync::Private::Private(QS3Sync *parent)
+    : q(parent)
+    , account(0)
+    , direction(Upload)
+    , deleteExtraneous(false)
+    , concurrency(64)
+    , running(false)
+    , progress(0)
+    , listing(0)
+    , listed(0)
+    , listingDone(false)
+    , listingFailed(false)
+    , scanDone(false)
+    , total(0)
+    , completed(0)
+{
+    connect(&QS3NetworkAccessManager::instance(), &QS3NetworkAccessManager::windowAvailable, q, [this]() {
+        if (!queue.isEmpty())
+            pump();
+    });
+
+    connect(&scanner, &QFutureWatcher<QList<File> >::finished, [this]() {
+        if (!running) return;
+        foreach (const File &file, scanner.result())
+            files.insert(file.path, file);
+        scanDone = true;
+        compare();
+    });
+
+    connect(&hasher, &QFutureWatcher<File>::finished, [this]() {
+        if (!running) return;
+        foreach (const File &file, hasher.future().results()) {
+            files[file.path].md5 = file.md5;
+            if (!file.compare || file.eTag != objects.value(file.path).eTag)
+                transfer(file.path);
+        }
+        total = queue.count();
+        if (total == 0)
+            finish();
+        else
+            pump();
+    });
+}
+
+void QS3Sync::Private::list()
+{
+    listed = 0;
+    listingDone = false;
+    listingFailed = false;
+    listing = new QBucket(q);
+    listing->setPrefix(prefix);
+    listing->setAccount(account);
+    listing->setName(bucket);
+
+    connect(listing, &QBucket::loadingChanged, [this](bool loading) {
+        if (loading || !running || listingFailed) return;
+        int count = listing->count();
+        for (; listed < count; listed++) {
+            QVariantMap content = listing->get(listed);
+            QString key = content.value(QStringLiteral("key")).toString();
+            if (!key.startsWith(prefix) || key.endsWith(QLatin1Char('/'))) continue;
+            if (fileName(key.mid(prefix.length())).isEmpty()) {
+                emit q->failed(key, 0);
+                continue;
+            }
+            Object object;
+            object.size = content.value(QStringLiteral("size")).toLongLong();
+            object.eTag = content.value(QStringLiteral("eTag")).toString().remove(QLatin1Char('"'));
+            objects.insert(key.mid(prefix.length()), object);
+        }
+        if (listing->isTruncated() && count > 0) {
+            listing->setMarker(listing->get(count - 1).value(QStringLiteral("key")).toString());
+            listing->load();
+        } else {
+            listingDone = true;
+            compare();
+        }
+    });
+    // a partial listing must never turn into deletions, the sync stops at the first failed page
+    connect(listing, &QBucket::failed, [this](int httpStatusCode) {
+        if (!running) return;
+        listingFailed = true;
+        emit q->failed(prefix, httpStatusCode);
+        finish();
+    });
+}
+
+void QS3Sync::Private::compare()
+{
+    if (!listingDone || listingFailed || !scanDone) return;
+
+    // files about to be uploaded are hashed as well for their Content-MD5
+    QList<File> candidates;
+    foreach (File file, files) {
+        if (objects.contains(file.path)) {
+            const Object &object = objects[file.path];
+            file.compare = object.size == file.size;
+            file.eTag = object.eTag;
+            if (file.compare || direction == Upload)
+                candidates.append(file);
+            else
+                transfer(file.path);
+        } else if (direction == Upload) {
+            file.compare = false;
+            candidates.append(file);
+        } else if (deleteExtraneous) {
+            Job job = { RemoveFile, file.path };
+            queue.append(job);
+        }
+    }
+    foreach (const QString &path, objects.keys()) {
+        if (files.contains(path)) continue;
+        if (direction == Download) {
+            transfer(path);
+        } else if (deleteExtraneous) {
+            Job job = { DeleteObject, path };
+            queue.append(job);
+        }
+    }
+
+    if (!candidates.isEmpty()) {
+        hasher.setFuture(QtConcurrent::mapped(candidates, &Private::hash));
+        return;
+    }
+    total = queue.count();
+    if (total == 0)
+        finish();
+    else
+        pump();
+}
+
+void QS3Sync::Private::transfer(const QString &path)
+{
+    Job job = { direction == Upload ? PutObject : GetObject, path };
+    queue.append(job);
+}
+
+void QS3Sync::Private::pump()
+{
+    QS3NetworkAccessManager &networkAccessManager = QS3NetworkAccessManager::instance();
+    while (running && replies.count() < concurrency && !queue.isEmpty()) {
+        // the adaptive window of the host and prefix has the final say
+        if (queue.first().operation != RemoveFile && networkAccessManager.isSaturated(account->url(bucket, prefix + queue.first().path))) break;
+        Job job = queue.takeFirst();
+        QNetworkRequest request(account->url(bucket, prefix + job.path));
+        // mirroring is background work, it goes into the low priority bandwidth class
+        request.setPriority(QNetworkRequest::LowPriority);
+        QString fileName = this->fileName(job.path);
+        if (fileName.isEmpty()) {
+            done(job, 0);
+            continue;
+        }
+        QNetworkReply *reply = 0;
+        QIODevice *device = 0;
+
+        switch (job.operation) {
+        case PutObject: {
+            QS3FileSource *source = new QS3FileSource(fileName);
+            if (!source->open(QIODevice::ReadOnly)) {
+                delete source;
+                done(job, 0);
+                continue;
+            }
+            reply = networkAccessManager.send(account, request, QNetworkAccessManager::PutOperation, source, files.value(job.path).md5);
+            source->setParent(reply);
+            break; }
+        case GetObject: {
+            QDir().mkpath(QFileInfo(fileName).absolutePath());
+            QSaveFile *file = new QSaveFile(fileName);
+            if (!file->open(QFile::WriteOnly)) {
+                delete file;
+                done(job, 0);
+                continue;
+            }
+            // keep the stored bytes, even for objects with a Content-Encoding
+            request.setRawHeader("Accept-Encoding", "identity");
+            reply = networkAccessManager.send(account, request, QNetworkAccessManager::GetOperation);
+            file->setParent(reply);
+            device = networkAccessManager.throttled(reply, account);
+            connect(device, &QIODevice::readyRead, [device, file]() {
+                file->write(device->readAll());
+            });
+            connect(device, &QIODevice::readChannelFinished, [reply, device, file]() {
+                if (reply->error() == QNetworkReply::NoError && reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 200) {
+                    file->write(device->readAll());
+                    file->commit();
+                }
+            });
+            break; }
+        case DeleteObject:
+            reply = networkAccessManager.send(account, request, QNetworkAccessManager::DeleteOperation);
+            break;
+        case RemoveFile:
+            done(job, QFile::remove(fileName) ? 200 : 0);
+            continue;
+        }
+
+        replies.append(reply);
+        auto complete = [this, reply, job]() {
+            replies.removeOne(reply);
+            reply->deleteLater();
+            if (!running) return;
+            done(job, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+            pump();
+        };
+        // a throttled body may still be draining when the reply itself is finished
+        if (device)
+            connect(device, &QIODevice::readChannelFinished, complete);
+        else
+            connect(reply, &QNetworkReply::finished, complete);
+    }
+}
+
+void QS3Sync::Private::done(const Job &job, int httpStatusCode)
+{
+    completed++;
+    if (httpStatusCode < 200 || httpStatusCode > 299)
+        emit q->failed(prefix + job.path, httpStatusCode);
+    q->setProgress(completed * 100 / total);
+    if (completed == total)
+        finish();
+}
+
+void QS3Sync::Private::finish()
+{
+    if (listing) {
+        listing->deleteLater();
+        listing = 0;
+    }
+    q->setRunning(false);
+    emit q->finished();
+}
+
+QString QS3Sync::Private::fileName(const QString &path) const
+{
+    // keys are remote input, one with .. in it must not reach outside localPath
+    QString root = QDir(localPath).absolutePath();
+    if (!root.endsWith(QLatin1Char('/')))
+        root.append(QLatin1Char('/'));
+    QString ret = QDir::cleanPath(root + path);
+    if (!ret.startsWith(root)) return QString();
+    return ret;
+}
+
+QList<QS3Sync::Private::File> QS3Sync::Private::scan(const QString &localPath)
+{
+    QList<File> ret;
+    QDir dir(localPath);
+    QDirIterator it(localPath, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        File file;
+        file.fileName = it.filePath();
+        file.path = dir.relativeFilePath(file.fileName);
+        file.size = it.fileInfo().size();
+        file.compare = false;
+        ret.append(file);
+    }
+    return ret;
+}
+
+static QList<qint64> partSizes(qint64 size, int parts)
+{
+    // the part size is not recorded anywhere, try the usual ones that give the right part count
+    const qint64 MiB = 1024 * 1024;
+    QList<qint64> candidates;
+    candidates << 8 * MiB << qMax(8 * MiB, (size + 9999) / 10000) << 5 * MiB << 16 * MiB
+               << ((size + parts - 1) / parts + MiB - 1) / MiB * MiB;
+    for (qint64 partSize = 32 * MiB; partSize <= 512 * MiB; partSize *= 2)
+        candidates << partSize;
+
+    QList<qint64> ret;
+    foreach (qint64 partSize, candidates) {
+        if ((size + partSize - 1) / partSize == parts && !ret.contains(partSize))
+            ret.append(partSize);
+    }
+    return ret;
+}
+
+QS3Sync::Private::File QS3Sync::Private::hash(const File &file)
+{
+    File ret(file);
+    QString eTag = file.eTag;
+    ret.eTag.clear();
+    QS3FileSource source(file.fileName);
+    if (!source.open(QIODevice::ReadOnly))
+        return ret;
+    ret.md5 = source.md5();
+    ret.eTag = QString::fromLatin1(ret.md5.toHex());
+
+    // a multipart ETag is the MD5 of the part MD5s followed by the part count
+    int dash = eTag.indexOf(QLatin1Char('-'));
+    if (!file.compare || dash < 0) return ret;
+    int parts = eTag.mid(dash + 1).toInt();
+    if (parts <= 0) return ret;
+    foreach (qint64 partSize, partSizes(file.size, parts)) {
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        foreach (const QByteArray &md5, source.md5(partSize))
+            hash.addData(md5);
+        QString multipart = QString::fromLatin1(hash.result().toHex()) + QLatin1Char('-') + QString::number(parts);
+        if (multipart == eTag) {
+            ret.eTag = multipart;
+            break;
+        }
+    }
+    return ret;
+}
+
+QS3Sync::QS3Sync(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3Sync::destroyed, [d]() { delete d; });
+}
+
+QAccount *QS3Sync::account() const
+{
+    return d->account;
+}
+
+void QS3Sync::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    d->account = account;
+    emit accountChanged(account);
+}
+
+const QString &QS3Sync::bucket() const
+{
+    return d->bucket;
+}
+
+void QS3Sync::setBucket(const QString &bucket)
+{
+    if (d->bucket == bucket) return;
+    d->bucket = bucket;
+    emit bucketChanged(bucket);
+}
+
+const QString &QS3Sync::prefix() const
+{
+    return d->prefix;
+}
+
+void QS3Sync::setPrefix(const QString &prefix)
+{
+    if (d->prefix == prefix) return;
+    d->prefix = prefix;
+    emit prefixChanged(prefix);
+}
+
+const QString &QS3Sync::localPath() const
+{
+    return d->localPath;
+}
+
+void QS3Sync::setLocalPath(const QString &localPath)
+{
+    if (d->localPath == localPath) return;
+    d->localPath = localPath;
+    emit localPathChanged(localPath);
+}
+
+QS3Sync::Direction QS3Sync::direction() const
+{
+    return d->direction;
+}
+
+void QS3Sync::setDirection(Direction direction)
+{
+    if (d->direction == direction) return;
+    d->direction = direction;
+    emit directionChanged(direction);
+}
+
+bool QS3Sync::deleteExtraneous() const
+{
+    return d->deleteExtraneous;
+}
+
+void QS3Sync::setDeleteExtraneous(bool deleteExtraneous)
+{
+    if (d->deleteExtraneous == deleteExtraneous) return;
+    d->deleteExtraneous = deleteExtraneous;
+    emit deleteExtraneousChanged(deleteExtraneous);
+}
+
+int QS3Sync::concurrency() const
+{
+    return d->concurrency;
+}
+
+void QS3Sync::setConcurrency(int concurrency)
+{
+    if (d->concurrency == concurrency) return;
+    d->concurrency = concurrency;
+    emit concurrencyChanged(concurrency);
+    d->pump();
+}
+
+bool QS3Sync::running() const
+{
+    return d->running;
+}
+
+void QS3Sync::setRunning(bool running)
+{
+    if (d->running == running) return;
+    d->running = running;
+    emit runningChanged(running);
+}
+
+int QS3Sync::progress() const
+{
+    return d->progress;
+}
+
+void QS3Sync::setProgress(int progress)
+{
+    if (d->progress == progress) return;
+    d->progress = progress;
+    emit progressChanged(progress);
+}
+
+void QS3Sync::start()
+{
+    if (d->running) return;
+    if (!d->account) return;
+    if (d->bucket.isEmpty() || d->localPath.isEmpty()) return;
+
+    setRunning(true);
+    setProgress(0);
+    d->files.clear();
+    d->objects.clear();
+    d->queue.clear();
+    d->total = 0;
+    d->completed = 0;
+    d->scanDone = false;
+    d->scanner.setFuture(QtConcurrent::run(&Private::scan, d->localPath));
+    d->list();
+}
+
+void QS3Sync::cancel()
+{
+    if (!d->running) return;
+    d->queue.clear();
+    setRunning(false);
+    d->scanner.cancel();
+    d->hasher.cancel();
+    foreach (QNetworkReply *reply, d->replies)
+        reply->abort();
+    d->finish();
+}
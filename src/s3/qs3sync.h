@@ -0,0 +1,102 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3SYNC_H
+#define QS3SYNC_H
+
+#include "s3_global.h"
+
+#include <QtCore/QObject>
+
+class QAccount;
+
+class S3_EXPORT QS3Sync : public QObject
+{
+    Q_OBJECT
+    Q_ENUMS(Direction)
+    Q_PROPERTY(QAccount *account READ account WRITE setAccount NOTIFY accountChanged)
+    Q_PROPERTY(QString bucket READ bucket WRITE setBucket NOTIFY bucketChanged)
+    Q_PROPERTY(QString prefix READ prefix WRITE setPrefix NOTIFY prefixChanged)
+    Q_PROPERTY(QString localPath READ localPath WRITE setLocalPath NOTIFY localPathChanged)
+    Q_PROPERTY(Direction direction READ direction WRITE setDirection NOTIFY directionChanged)
+    Q_PROPERTY(bool deleteExtraneous READ deleteExtraneous WRITE setDeleteExtraneous NOTIFY deleteExtraneousChanged)
+    Q_PROPERTY(int concurrency READ concurrency WRITE setConcurrency NOTIFY concurrencyChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(int progress READ progress NOTIFY progressChanged)
+public:
+    enum Direction {
+        Upload,
+        Download
+    };
+
+    explicit QS3Sync(QObject *parent = 0);
+
+    QAccount *account() const;
+    const QString &bucket() const;
+    const QString &prefix() const;
+    const QString &localPath() const;
+    Direction direction() const;
+    bool deleteExtraneous() const;
+    int concurrency() const;
+    bool running() const;
+    int progress() const;
+
+public slots:
+    void setAccount(QAccount *account);
+    void setBucket(const QString &bucket);
+    void setPrefix(const QString &prefix);
+    void setLocalPath(const QString &localPath);
+    void setDirection(Direction direction);
+    void setDeleteExtraneous(bool deleteExtraneous);
+    void setConcurrency(int concurrency);
+
+    void start();
+    void cancel();
+
+private slots:
+    void setRunning(bool running);
+    void setProgress(int progress);
+
+signals:
+    void accountChanged(QAccount *account);
+    void bucketChanged(const QString &bucket);
+    void prefixChanged(const QString &prefix);
+    void localPathChanged(const QString &localPath);
+    void directionChanged(Direction direction);
+    void deleteExtraneousChanged(bool deleteExtraneous);
+    void concurrencyChanged(int concurrency);
+    void runningChanged(bool running);
+    void progressChanged(int progress);
+
+    void failed(const QString &key, int httpStatusCode);
+    void finished();
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3SYNC_H
@@ -0,0 +1,141 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3throttleddevice.h"
+#include "qs3networkaccessmanager.h"
+#include "qaccount.h"
+
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+
+class QS3ThrottledDevice::Private
+{
+public:
+    Private(QS3ThrottledDevice *parent, QIODevice *source, QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction);
+
+    void sourceFinished();
+    void checkFinished();
+
+private:
+    QS3ThrottledDevice *q;
+
+public:
+    QPointer<QIODevice> source;
+    QPointer<QAccount> account;
+    QNetworkRequest::Priority priority;
+    QS3TokenBucket::Direction direction;
+    QTimer refill;
+    bool finished;
+    bool finishEmitted;
+};
+
+QS3ThrottledDevice::Private::Private(QS3ThrottledDevice *parent, QIODevice *source, QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction)
+    : q(parent)
+    , source(source)
+    , account(account)
+    , priority(priority)
+    , direction(direction)
+    , finished(false)
+    , finishEmitted(false)
+{
+    refill.setSingleShot(true);
+    connect(&refill, &QTimer::timeout, q, &QS3ThrottledDevice::readyRead);
+    connect(source, &QIODevice::readyRead, q, &QS3ThrottledDevice::readyRead);
+    connect(source, &QIODevice::readChannelFinished, q, [this]() { sourceFinished(); });
+}
+
+void QS3ThrottledDevice::Private::sourceFinished()
+{
+    finished = true;
+    checkFinished();
+}
+
+void QS3ThrottledDevice::Private::checkFinished()
+{
+    if (!finished || finishEmitted || q->bytesAvailable() > 0) return;
+    finishEmitted = true;
+    // never from inside a read()
+    QMetaObject::invokeMethod(q, "readChannelFinished", Qt::QueuedConnection);
+}
+
+QS3ThrottledDevice::QS3ThrottledDevice(QIODevice *source, QAccount *account, QNetworkRequest::Priority priority, QS3TokenBucket::Direction direction, QObject *parent)
+    : QIODevice(parent)
+    , d(new Private(this, source, account, priority, direction))
+{
+    connect(this, &QS3ThrottledDevice::destroyed, [d]() { delete d; });
+    // QIODevice's read-ahead would bypass the bucket
+    open(ReadOnly | Unbuffered);
+}
+
+bool QS3ThrottledDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 QS3ThrottledDevice::size() const
+{
+    if (!d->source || d->source->isSequential()) return 0;
+    return d->source->size();
+}
+
+qint64 QS3ThrottledDevice::bytesAvailable() const
+{
+    if (!d->source) return 0;
+    return d->source->bytesAvailable();
+}
+
+bool QS3ThrottledDevice::atEnd() const
+{
+    return !d->source || d->source->atEnd();
+}
+
+qint64 QS3ThrottledDevice::readData(char *data, qint64 maxSize)
+{
+    if (!d->source) return -1;
+
+    qint64 wanted = qMin(maxSize, d->source->bytesAvailable());
+    if (wanted <= 0) {
+        if (!d->source->isSequential() && d->source->atEnd()) return -1;
+        return 0;
+    }
+
+    QS3NetworkAccessManager &networkAccessManager = QS3NetworkAccessManager::instance();
+    qint64 granted = networkAccessManager.acquire(d->account, d->priority, d->direction, wanted);
+    if (granted < wanted && !d->refill.isActive())
+        d->refill.start(networkAccessManager.delay(d->account, d->priority, d->direction, wanted - granted));
+    if (granted == 0) return 0;
+
+    qint64 ret = d->source->read(data, granted);
+    d->checkFinished();
+    return ret;
+}
+
+qint64 QS3ThrottledDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+}
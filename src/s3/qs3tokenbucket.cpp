@@ -0,0 +1,111 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3tokenbucket.h"
+
+QS3TokenBucket::QS3TokenBucket()
+    : limit(0)
+    , burst(0)
+    , tokens(0)
+    , refilled(0)
+    , windowStart(0)
+    , windowBytes(0)
+    , measured(0)
+{
+    timer.start();
+}
+
+qint64 QS3TokenBucket::rate() const
+{
+    return limit;
+}
+
+void QS3TokenBucket::setRate(qint64 bytesPerSecond)
+{
+    limit = qMax<qint64>(0, bytesPerSecond);
+    // allow a quarter of a second worth of data in one go
+    burst = qMax<qint64>(limit / 4, 4096);
+    tokens = qMin(tokens, burst);
+    refilled = timer.elapsed();
+}
+
+bool QS3TokenBucket::isLimited() const
+{
+    return limit > 0;
+}
+
+void QS3TokenBucket::refill()
+{
+    qint64 now = timer.elapsed();
+    if (limit > 0 && now > refilled) {
+        tokens = qMin(burst, tokens + (now - refilled) * limit / 1000);
+        refilled = now;
+    }
+}
+
+qint64 QS3TokenBucket::available(qint64 bytes)
+{
+    if (limit == 0) return bytes;
+    refill();
+    return qBound<qint64>(0, tokens, bytes);
+}
+
+void QS3TokenBucket::take(qint64 bytes)
+{
+    if (limit > 0) {
+        refill();
+        tokens -= bytes;
+    }
+}
+
+void QS3TokenBucket::measure(qint64 bytes)
+{
+    qint64 now = timer.elapsed();
+    windowBytes += bytes;
+    if (now - windowStart >= 1000) {
+        measured = windowBytes * 1000 / (now - windowStart);
+        windowStart = now;
+        windowBytes = 0;
+    }
+}
+
+int QS3TokenBucket::wait(qint64 bytes)
+{
+    if (limit == 0) return 0;
+    refill();
+    qint64 missing = qMin(bytes, burst) - tokens;
+    if (missing <= 0) return 0;
+    return qMax<qint64>(1, (missing * 1000 + limit - 1) / limit);
+}
+
+qint64 QS3TokenBucket::throughput() const
+{
+    // an overdue window means traffic slowed down or stopped, what it holds so far is the better estimate
+    qint64 elapsed = timer.elapsed() - windowStart;
+    if (elapsed >= 1000)
+        return windowBytes * 1000 / elapsed;
+    return measured;
+}
@@ -0,0 +1,67 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3TOKENBUCKET_H
+#define QS3TOKENBUCKET_H
+
+#include "s3_global.h"
+
+#include <QtCore/QElapsedTimer>
+
+class S3_EXPORT QS3TokenBucket
+{
+public:
+    enum Direction {
+        Download,
+        Upload
+    };
+
+    QS3TokenBucket();
+
+    qint64 rate() const;
+    void setRate(qint64 bytesPerSecond);
+    bool isLimited() const;
+
+    qint64 available(qint64 bytes);
+    void take(qint64 bytes);
+    void measure(qint64 bytes);
+    int wait(qint64 bytes);
+    qint64 throughput() const;
+
+private:
+    void refill();
+
+    qint64 limit;
+    qint64 burst;
+    qint64 tokens;
+    QElapsedTimer timer;
+    qint64 refilled;
+    qint64 windowStart;
+    qint64 windowBytes;
+    qint64 measured;
+};
+
+#endif // QS3TOKENBUCKET_H
@@ -0,0 +1,293 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3trace.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+struct Event {
+    const char *category;
+    const char *name;
+    char phase;
+    qint64 timestamp;
+    qint64 duration;
+    quintptr id;
+    QByteArray args;
+};
+
+// written by its own thread only, the lock is uncontended unless someone is exporting
+struct Buffer {
+    Buffer() : events(capacity), next(0), wrapped(false) {}
+
+    static const int capacity = 32 * 1024;
+
+    QMutex mutex;
+    QVector<Event> events;
+    int next;
+    bool wrapped;
+    quintptr thread;
+    QString threadName;
+};
+
+struct Registry {
+    Registry();
+    ~Registry();
+
+    // finished threads whose events are kept, the oldest buffer is reused after that
+    static const int maximumRetired = 16;
+
+    Buffer *buffer();
+    void retire(Buffer *buffer);
+    void add(const char *category, const char *name, char phase, qint64 timestamp, qint64 duration, const void *id, const QByteArray &args);
+
+    QMutex mutex;
+    QList<Buffer *> buffers;
+    QList<Buffer *> retired;
+    QElapsedTimer clock;
+    QString fileName;
+};
+
+static Registry registry;
+
+QBasicAtomicInt QS3Trace::enabled = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+Registry::Registry()
+{
+    clock.start();
+    // QS3_TRACE=trace.json records from startup and writes the file on exit
+    fileName = QString::fromLocal8Bit(qgetenv("QS3_TRACE"));
+    if (!fileName.isEmpty())
+        QS3Trace::setEnabled(true);
+}
+
+Registry::~Registry()
+{
+    if (!fileName.isEmpty())
+        QS3Trace::save(fileName);
+    qDeleteAll(buffers);
+}
+
+// hands the buffer back when its thread exits
+struct Owner {
+    Owner() : buffer(0) {}
+    ~Owner() { if (buffer) registry.retire(buffer); }
+
+    Buffer *buffer;
+};
+
+Buffer *Registry::buffer()
+{
+    static thread_local Owner owner;
+    Buffer *ret = owner.buffer;
+    if (!ret) {
+        QThread *thread = QThread::currentThread();
+        QString threadName = thread->objectName();
+        if (threadName.isEmpty())
+            threadName = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread() ? QStringLiteral("main") : QString::fromLatin1(thread->metaObject()->className());
+
+        // buffers outlive their threads so that a trace still shows finished workers, but only the last few
+        QMutexLocker locker(&mutex);
+        if (retired.count() > maximumRetired) {
+            ret = retired.takeFirst();
+        } else {
+            ret = new Buffer;
+            buffers.append(ret);
+        }
+        QMutexLocker bufferLocker(&ret->mutex);
+        ret->next = 0;
+        ret->wrapped = false;
+        ret->thread = reinterpret_cast<quintptr>(QThread::currentThreadId());
+        ret->threadName = threadName;
+        owner.buffer = ret;
+    }
+    return ret;
+}
+
+void Registry::retire(Buffer *buffer)
+{
+    QMutexLocker locker(&mutex);
+    retired.append(buffer);
+}
+
+void Registry::add(const char *category, const char *name, char phase, qint64 timestamp, qint64 duration, const void *id, const QByteArray &args)
+{
+    Buffer *buffer = this->buffer();
+    QMutexLocker locker(&buffer->mutex);
+    Event &event = buffer->events[buffer->next];
+    event.category = category;
+    event.name = name;
+    event.phase = phase;
+    event.timestamp = timestamp;
+    event.duration = duration;
+    event.id = reinterpret_cast<quintptr>(id);
+    event.args = args;
+    if (++buffer->next == Buffer::capacity) {
+        buffer->next = 0;
+        buffer->wrapped = true;
+    }
+}
+
+void QS3Trace::setEnabled(bool enabled)
+{
+    QS3Trace::enabled.store(enabled);
+}
+
+qint64 QS3Trace::now()
+{
+    return registry.clock.nsecsElapsed() / 1000;
+}
+
+void QS3Trace::complete(const char *category, const char *name, qint64 start, const QByteArray &args)
+{
+    if (!isEnabled()) return;
+    registry.add(category, name, 'X', start, now() - start, 0, args);
+}
+
+void QS3Trace::instant(const char *category, const char *name, const QByteArray &args)
+{
+    if (!isEnabled()) return;
+    registry.add(category, name, 'i', now(), 0, 0, args);
+}
+
+void QS3Trace::asyncBegin(const char *category, const char *name, const void *id, const QByteArray &args)
+{
+    if (!isEnabled()) return;
+    registry.add(category, name, 'b', now(), 0, id, args);
+}
+
+void QS3Trace::asyncStep(const char *category, const char *name, const void *id, const QByteArray &args)
+{
+    if (!isEnabled()) return;
+    registry.add(category, name, 'n', now(), 0, id, args);
+}
+
+void QS3Trace::asyncEnd(const char *category, const char *name, const void *id, const QByteArray &args)
+{
+    if (!isEnabled()) return;
+    registry.add(category, name, 'e', now(), 0, id, args);
+}
+
+static QByteArray quote(const QByteArray &value)
+{
+    QByteArray ret = "\"";
+    foreach (char c, value) {
+        switch (c) {
+        case '"': ret.append("\\\""); break;
+        case '\\': ret.append("\\\\"); break;
+        case '\n': ret.append("\\n"); break;
+        default:
+            if (static_cast<uchar>(c) < 0x20)
+                ret.append("\\u00").append(QByteArray::number(c, 16).rightJustified(2, '0'));
+            else
+                ret.append(c);
+            break;
+        }
+    }
+    ret.append('"');
+    return ret;
+}
+
+QByteArray QS3Trace::argument(const char *name, const QString &value)
+{
+    return quote(name) + ':' + quote(value.toUtf8());
+}
+
+QByteArray QS3Trace::argument(const char *name, qint64 value)
+{
+    return quote(name) + ':' + QByteArray::number(value);
+}
+
+QByteArray QS3Trace::toJson()
+{
+    // the Trace Event Format, loads in chrome://tracing and Perfetto
+    QByteArray ret = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    bool first = true;
+    QMutexLocker registryLocker(&registry.mutex);
+    foreach (Buffer *buffer, registry.buffers) {
+        QMutexLocker locker(&buffer->mutex);
+        QByteArray tid = QByteArray::number(buffer->thread);
+        if (!first)
+            ret.append(',');
+        first = false;
+        ret.append("\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":").append(pid).append(",\"tid\":").append(tid);
+        ret.append(",\"args\":{\"name\":").append(quote(buffer->threadName.toUtf8())).append("}}");
+
+        int count = buffer->wrapped ? Buffer::capacity : buffer->next;
+        int start = buffer->wrapped ? buffer->next : 0;
+        for (int i = 0; i < count; i++) {
+            const Event &event = buffer->events.at((start + i) % Buffer::capacity);
+            ret.append(",\n{\"cat\":").append(quote(event.category)).append(",\"name\":").append(quote(event.name));
+            ret.append(",\"ph\":\"").append(event.phase).append("\",\"ts\":").append(QByteArray::number(event.timestamp));
+            ret.append(",\"pid\":").append(pid).append(",\"tid\":").append(tid);
+            switch (event.phase) {
+            case 'X':
+                ret.append(",\"dur\":").append(QByteArray::number(event.duration));
+                break;
+            case 'i':
+                ret.append(",\"s\":\"t\"");
+                break;
+            default:
+                ret.append(",\"id\":\"0x").append(QByteArray::number(event.id, 16)).append('"');
+                break;
+            }
+            if (!event.args.isEmpty())
+                ret.append(",\"args\":{").append(event.args).append('}');
+            ret.append('}');
+        }
+    }
+    ret.append("\n]}\n");
+    return ret;
+}
+
+bool QS3Trace::save(const QString &fileName)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << Q_FUNC_INFO << fileName << file.errorString();
+        return false;
+    }
+    file.write(toJson());
+    return file.commit();
+}
+
+void QS3Trace::clear()
+{
+    QMutexLocker registryLocker(&registry.mutex);
+    foreach (Buffer *buffer, registry.buffers) {
+        QMutexLocker locker(&buffer->mutex);
+        buffer->next = 0;
+        buffer->wrapped = false;
+    }
+}
@@ -0,0 +1,78 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3TRACE_H
+#define QS3TRACE_H
+
+#include "s3_global.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+class S3_EXPORT QS3Trace
+{
+public:
+    static bool isEnabled() { return enabled.load(); }
+    static void setEnabled(bool enabled);
+
+    static qint64 now();
+    static void complete(const char *category, const char *name, qint64 start, const QByteArray &args = QByteArray());
+    static void instant(const char *category, const char *name, const QByteArray &args = QByteArray());
+    static void asyncBegin(const char *category, const char *name, const void *id, const QByteArray &args = QByteArray());
+    static void asyncStep(const char *category, const char *name, const void *id, const QByteArray &args = QByteArray());
+    static void asyncEnd(const char *category, const char *name, const void *id, const QByteArray &args = QByteArray());
+
+    static QByteArray argument(const char *name, const QString &value);
+    static QByteArray argument(const char *name, qint64 value);
+
+    static QByteArray toJson();
+    static bool save(const QString &fileName);
+    static void clear();
+
+private:
+    static QBasicAtomicInt enabled;
+};
+
+class QS3TraceScope
+{
+public:
+    QS3TraceScope(const char *category, const char *name)
+        : category(category), name(name), start(QS3Trace::isEnabled() ? QS3Trace::now() : -1) {}
+    ~QS3TraceScope() { if (start >= 0) QS3Trace::complete(category, name, start); }
+
+private:
+    Q_DISABLE_COPY(QS3TraceScope)
+    const char *category;
+    const char *name;
+    qint64 start;
+};
+
+#define QS3_TRACE_CONCAT_(a, b) a##b
+#define QS3_TRACE_CONCAT(a, b) QS3_TRACE_CONCAT_(a, b)
+#define QS3_TRACE_SCOPE(category, name) QS3TraceScope QS3_TRACE_CONCAT(qs3TraceScope, __LINE__)(category, name)
+
+#endif // QS3TRACE_H
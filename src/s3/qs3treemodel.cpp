@@ -0,0 +1,473 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3treemodel.h"
+
+#include "qaccount.h"
+#include "qs3listbucketresult.h"
+#include "qs3networkaccessmanager.h"
+#include "qs3trace.h"
+
+#include <QtCore/QTimer>
+#include <QtCore/QUrlQuery>
+#include <QtNetwork/QNetworkReply>
+
+class QS3TreeModel::Private
+{
+public:
+    struct Node {
+        Node(Node *parent, int row, const QString &key, bool folder)
+            : parent(parent), row(row), key(key), folder(folder), listed(false), reply(0), used(0) {}
+        ~Node() { qDeleteAll(children); }
+
+        Node *parent;
+        int row;
+        QString key;
+        bool folder;
+        QVariantMap content;
+
+        QList<Node *> children;
+        bool listed;
+        QString marker;
+        QNetworkReply *reply;
+        qint64 used;
+    };
+
+    Private(QS3TreeModel *parent);
+    ~Private();
+
+    Node *node(const QModelIndex &index) const;
+    QModelIndex index(Node *node) const;
+    QString name(Node *node) const;
+
+    void list(Node *node);
+    void send(Node *node, const QNetworkRequest &request);
+    void received(Node *node, const QS3ListBucketResult &result);
+    void release(Node *node);
+    void touch(Node *node);
+    void evict();
+    void updateLoading();
+
+private:
+    QS3TreeModel *q;
+
+public:
+    static QHash<int, QByteArray> roleNames;
+    QAccount *account;
+    QString name;
+    QString prefix;
+    QString delimiter;
+    int pageSize;
+    int cacheSize;
+    bool loading;
+
+    Node *root;
+    QList<Node *> fetching;
+    QList<Node *> expanded;
+    qint64 tick;
+    QTimer timer;
+};
+
+QHash<int, QByteArray> QS3TreeModel::Private::roleNames;
+
+QS3TreeModel::Private::Private(QS3TreeModel *parent)
+    : q(parent)
+    , account(0)
+    , delimiter(QStringLiteral("/"))
+    , pageSize(1000)
+    , cacheSize(64)
+    , loading(false)
+    , root(new Node(0, 0, QString(), true))
+    , tick(0)
+{
+    timer.setInterval(0);
+    timer.setSingleShot(true);
+    connect(&timer, &QTimer::timeout, parent, &QS3TreeModel::load);
+
+    connect(parent, &QS3TreeModel::accountChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(parent, &QS3TreeModel::nameChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(parent, &QS3TreeModel::prefixChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(parent, &QS3TreeModel::delimiterChanged, &timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+}
+
+QS3TreeModel::Private::~Private()
+{
+    release(root);
+    delete root;
+}
+
+QS3TreeModel::Private::Node *QS3TreeModel::Private::node(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<Node *>(index.internalPointer()) : root;
+}
+
+QModelIndex QS3TreeModel::Private::index(Node *node) const
+{
+    if (!node || node == root) return QModelIndex();
+    return q->createIndex(node->row, 0, node);
+}
+
+QString QS3TreeModel::Private::name(Node *node) const
+{
+    // the last path component, folders keep their trailing delimiter
+    return node->key.mid(node->parent->key.length());
+}
+
+void QS3TreeModel::Private::list(Node *node)
+{
+    QUrl url = account->url(name);
+    QUrlQuery query;
+    if (!delimiter.isEmpty())
+        query.addQueryItem(QStringLiteral("delimiter"), QString::fromLatin1(QUrl::toPercentEncoding(delimiter)));
+    if (!node->marker.isEmpty())
+        query.addQueryItem(QStringLiteral("marker"), QString::fromLatin1(QUrl::toPercentEncoding(node->marker)));
+    query.addQueryItem(QStringLiteral("max-keys"), QString::number(pageSize));
+    if (!node->key.isEmpty())
+        query.addQueryItem(QStringLiteral("prefix"), QString::fromLatin1(QUrl::toPercentEncoding(node->key)));
+    url.setQuery(query);
+
+    QNetworkRequest request(url);
+    // expanding a folder is interactive
+    request.setPriority(QNetworkRequest::HighPriority);
+    send(node, request);
+}
+
+void QS3TreeModel::Private::send(Node *node, const QNetworkRequest &request)
+{
+    if (!fetching.contains(node))
+        fetching.append(node);
+    updateLoading();
+
+    auto track = [node](QNetworkReply *reply, bool inFlight) {
+        node->reply = inFlight ? reply : 0;
+    };
+    QS3NetworkAccessManager::instance().follow(account, request, QNetworkAccessManager::GetOperation, QByteArray(), q, track, [this, node](QNetworkReply *reply) {
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode == 200) {
+            QS3ListBucketResult result;
+            if (result.read(reply)) {
+                fetching.removeOne(node);
+                received(node, result);
+                updateLoading();
+                return;
+            }
+        }
+        fetching.removeOne(node);
+        updateLoading();
+        emit q->failed(httpStatusCode);
+    });
+}
+
+void QS3TreeModel::Private::received(Node *node, const QS3ListBucketResult &result)
+{
+    QS3_TRACE_SCOPE("tree", "received");
+    QList<Node *> children;
+    int row = node->children.count();
+    QString last;
+    foreach (const QVariantMap &commonPrefix, result.commonPrefixes) {
+        QString key = commonPrefix.value(QStringLiteral("key")).toString();
+        last = qMax(last, key);
+        children.append(new Node(node, row++, key, true));
+    }
+    foreach (const QVariantMap &content, result.contents) {
+        QString key = content.value(QStringLiteral("key")).toString();
+        last = qMax(last, key);
+        // the empty object consoles create to stand for the folder itself
+        if (key == node->key) continue;
+        Node *child = new Node(node, row++, key, false);
+        child->content = content;
+        children.append(child);
+    }
+
+    // NextMarker is only sent along with a delimiter, otherwise continue after the last key
+    node->marker.clear();
+    if (result.truncated.toBool())
+        node->marker = result.nextMarker.isValid() ? result.nextMarker.toString() : last;
+    node->listed = node->marker.isEmpty();
+
+    if (!children.isEmpty()) {
+        if (node->children.isEmpty() && node != root)
+            expanded.append(node);
+        q->beginInsertRows(index(node), node->children.count(), node->children.count() + children.count() - 1);
+        node->children.append(children);
+        q->endInsertRows();
+    }
+    touch(node);
+    evict();
+}
+
+void QS3TreeModel::Private::release(Node *node)
+{
+    // forget everything below node before it is deleted
+    if (node->reply) {
+        disconnect(node->reply, 0, q, 0);
+        node->reply->abort();
+        node->reply->deleteLater();
+        node->reply = 0;
+    }
+    fetching.removeOne(node);
+    expanded.removeOne(node);
+    foreach (Node *child, node->children)
+        release(child);
+}
+
+void QS3TreeModel::Private::touch(Node *node)
+{
+    // a visible row keeps its whole ancestry warm
+    qint64 now = ++tick;
+    for (; node; node = node->parent)
+        node->used = now;
+}
+
+void QS3TreeModel::Private::evict()
+{
+    while (expanded.count() > cacheSize) {
+        // the least recently used subtree goes, it is listed again on the next expansion
+        Node *victim = expanded.first();
+        foreach (Node *node, expanded) {
+            if (node->used < victim->used)
+                victim = node;
+        }
+        QList<Node *> children = victim->children;
+        release(victim);
+        q->beginRemoveRows(index(victim), 0, children.count() - 1);
+        victim->children.clear();
+        victim->listed = false;
+        victim->marker.clear();
+        q->endRemoveRows();
+        qDeleteAll(children);
+    }
+    updateLoading();
+}
+
+void QS3TreeModel::Private::updateLoading()
+{
+    q->setLoading(!fetching.isEmpty());
+}
+
+QS3TreeModel::QS3TreeModel(QObject *parent)
+    : QAbstractItemModel(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3TreeModel::destroyed, [d]() { delete d; });
+}
+
+QModelIndex QS3TreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    Private::Node *node = d->node(parent);
+    if (column != 0 || row < 0 || row >= node->children.count()) return QModelIndex();
+    return createIndex(row, column, node->children.at(row));
+}
+
+QModelIndex QS3TreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid()) return QModelIndex();
+    return d->index(d->node(child)->parent);
+}
+
+int QS3TreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0) return 0;
+    return d->node(parent)->children.count();
+}
+
+int QS3TreeModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return 1;
+}
+
+bool QS3TreeModel::hasChildren(const QModelIndex &parent) const
+{
+    // folders have children until a listing says otherwise, that is what makes them expandable
+    Private::Node *node = d->node(parent);
+    if (!node->folder) return false;
+    return !node->listed || !node->children.isEmpty();
+}
+
+QVariant QS3TreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) return QVariant();
+    Private::Node *node = d->node(index);
+    d->touch(node->parent);
+
+    if (role == Qt::DisplayRole)
+        role = Qt::UserRole;
+    switch (role - Qt::UserRole) {
+    case 0:
+        return d->name(node);
+    case 1:
+        return node->key;
+    case 2:
+        return node->folder;
+    default:
+        return node->content.value(QString::fromUtf8(roleNames().value(role)));
+    }
+}
+
+QHash<int, QByteArray> QS3TreeModel::roleNames() const
+{
+    if (d->roleNames.isEmpty()) {
+        int role = Qt::UserRole;
+        d->roleNames.insert(role++, "name");
+        d->roleNames.insert(role++, "key");
+        d->roleNames.insert(role++, "folder");
+        d->roleNames.insert(role++, "lastModified");
+        d->roleNames.insert(role++, "eTag");
+        d->roleNames.insert(role++, "size");
+        d->roleNames.insert(role++, "storageClass");
+        d->roleNames.insert(role++, "owner");
+    }
+    return d->roleNames;
+}
+
+bool QS3TreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    Private::Node *node = d->node(parent);
+    if (!node->folder || node->reply) return false;
+    return !node->listed;
+}
+
+void QS3TreeModel::fetchMore(const QModelIndex &parent)
+{
+    if (!d->account || d->name.isEmpty()) return;
+    if (!canFetchMore(parent)) return;
+    Private::Node *node = d->node(parent);
+    d->touch(node);
+    d->list(node);
+}
+
+QAccount *QS3TreeModel::account() const
+{
+    return d->account;
+}
+
+void QS3TreeModel::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    d->account = account;
+    emit accountChanged(account);
+}
+
+const QString &QS3TreeModel::name() const
+{
+    return d->name;
+}
+
+void QS3TreeModel::setName(const QString &name)
+{
+    if (d->name == name) return;
+    d->name = name;
+    emit nameChanged(name);
+}
+
+const QString &QS3TreeModel::prefix() const
+{
+    return d->prefix;
+}
+
+void QS3TreeModel::setPrefix(const QString &prefix)
+{
+    if (d->prefix == prefix) return;
+    d->prefix = prefix;
+    emit prefixChanged(prefix);
+}
+
+const QString &QS3TreeModel::delimiter() const
+{
+    return d->delimiter;
+}
+
+void QS3TreeModel::setDelimiter(const QString &delimiter)
+{
+    if (d->delimiter == delimiter) return;
+    d->delimiter = delimiter;
+    emit delimiterChanged(delimiter);
+}
+
+int QS3TreeModel::pageSize() const
+{
+    return d->pageSize;
+}
+
+void QS3TreeModel::setPageSize(int pageSize)
+{
+    if (d->pageSize == pageSize) return;
+    d->pageSize = pageSize;
+    emit pageSizeChanged(pageSize);
+}
+
+int QS3TreeModel::cacheSize() const
+{
+    return d->cacheSize;
+}
+
+void QS3TreeModel::setCacheSize(int cacheSize)
+{
+    if (d->cacheSize == cacheSize) return;
+    d->cacheSize = cacheSize;
+    emit cacheSizeChanged(cacheSize);
+    d->evict();
+}
+
+bool QS3TreeModel::loading() const
+{
+    return d->loading;
+}
+
+void QS3TreeModel::setLoading(bool loading)
+{
+    if (d->loading == loading) return;
+    d->loading = loading;
+    emit loadingChanged(loading);
+}
+
+void QS3TreeModel::fetch(const QModelIndex &index)
+{
+    if (canFetchMore(index))
+        fetchMore(index);
+}
+
+QVariantMap QS3TreeModel::get(const QModelIndex &index) const
+{
+    QVariantMap ret;
+    if (!index.isValid()) return ret;
+    QHash<int, QByteArray> roleNames = this->roleNames();
+    foreach (int role, roleNames.keys())
+        ret.insert(QString::fromUtf8(roleNames.value(role)), data(index, role));
+    return ret;
+}
+
+void QS3TreeModel::load()
+{
+    beginResetModel();
+    d->release(d->root);
+    delete d->root;
+    d->root = new Private::Node(0, 0, d->prefix, true);
+    endResetModel();
+    d->updateLoading();
+    fetchMore(QModelIndex());
+}
@@ -0,0 +1,579 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3upload.h"
+
+#include "qaccount.h"
+#include "qs3filesource.h"
+#include "qs3metrics.h"
+#include "qs3networkaccessmanager.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QMap>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QTimer>
+#include <QtCore/QXmlStreamReader>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtNetwork/QNetworkReply>
+
+static QByteArray partMd5(const QString &fileName, qint64 offset, qint64 length)
+{
+    QS3FileSource source(fileName, offset, length);
+    if (!source.open(QIODevice::ReadOnly)) return QByteArray();
+    return source.md5();
+}
+
+class QS3Upload::Private
+{
+public:
+    Private(QS3Upload *parent);
+
+    QString journalName() const;
+    bool readJournal();
+    void writeJournal();
+
+    QUrl url(const QString &query) const;
+    qint64 length(int number) const;
+    int count() const;
+
+    void initiate();
+    void listParts(int marker);
+    void schedule();
+    void pump();
+    void uploadPart(int number, const QByteArray &md5);
+    void complete();
+    void fail(int httpStatusCode);
+
+private:
+    QS3Upload *q;
+
+public:
+    QAccount *account;
+    QString bucket;
+    QString key;
+    QString fileName;
+    qint64 partSize;
+    int concurrency;
+    bool running;
+    qint64 bytesSent;
+    qint64 bytesTotal;
+
+    qint64 size;
+    qint64 lastModified;
+    QString uploadId;
+    QMap<int, QByteArray> parts;
+    QMap<int, QByteArray> listed;
+    QList<int> pending;
+    QMap<int, int> retries;
+    QList<QNetworkReply *> replies;
+    int active;
+};
+
+QS3Upload::Private::Private(QS3Upload *parent)
+    : q(parent)
+    , account(0)
+    , partSize(8 * 1024 * 1024)
+    , concurrency(32)
+    , running(false)
+    , bytesSent(0)
+    , bytesTotal(0)
+    , size(0)
+    , lastModified(0)
+    , active(0)
+{
+    connect(&QS3NetworkAccessManager::instance(), &QS3NetworkAccessManager::windowAvailable, q, [this]() {
+        if (!pending.isEmpty())
+            pump();
+    });
+}
+
+QString QS3Upload::Private::journalName() const
+{
+    QByteArray id = bucket.toUtf8() + '\n' + key.toUtf8() + '\n' + QFileInfo(fileName).absoluteFilePath().toUtf8();
+    return QDir(journalPath()).filePath(QString::fromLatin1(QCryptographicHash::hash(id, QCryptographicHash::Sha1).toHex()) + QStringLiteral(".json"));
+}
+
+bool QS3Upload::Private::readJournal()
+{
+    QFile file(journalName());
+    if (!file.open(QFile::ReadOnly)) return false;
+
+    QJsonObject journal = QJsonDocument::fromJson(file.readAll()).object();
+    if (journal.value(QStringLiteral("bucket")).toString() != bucket) return false;
+    if (journal.value(QStringLiteral("key")).toString() != key) return false;
+    if (static_cast<qint64>(journal.value(QStringLiteral("size")).toDouble()) != size) return false;
+    if (static_cast<qint64>(journal.value(QStringLiteral("lastModified")).toDouble()) != lastModified) return false;
+
+    qint64 partSize = static_cast<qint64>(journal.value(QStringLiteral("partSize")).toDouble());
+    uploadId = journal.value(QStringLiteral("uploadId")).toString();
+    if (uploadId.isEmpty() || partSize <= 0) return false;
+
+    q->setPartSize(partSize);
+    QJsonObject parts = journal.value(QStringLiteral("parts")).toObject();
+    foreach (const QString &number, parts.keys())
+        this->parts.insert(number.toInt(), parts.value(number).toString().toUtf8());
+    return true;
+}
+
+void QS3Upload::Private::writeJournal()
+{
+    QJsonObject parts;
+    foreach (int number, this->parts.keys())
+        parts.insert(QString::number(number), QString::fromUtf8(this->parts.value(number)));
+
+    QJsonObject journal;
+    journal.insert(QStringLiteral("bucket"), bucket);
+    journal.insert(QStringLiteral("key"), key);
+    journal.insert(QStringLiteral("fileName"), QFileInfo(fileName).absoluteFilePath());
+    journal.insert(QStringLiteral("size"), static_cast<double>(size));
+    journal.insert(QStringLiteral("lastModified"), static_cast<double>(lastModified));
+    journal.insert(QStringLiteral("partSize"), static_cast<double>(partSize));
+    journal.insert(QStringLiteral("uploadId"), uploadId);
+    journal.insert(QStringLiteral("parts"), parts);
+
+    QDir().mkpath(journalPath());
+    QSaveFile file(journalName());
+    if (!file.open(QFile::WriteOnly)) {
+        qWarning() << Q_FUNC_INFO << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(journal).toJson(QJsonDocument::Compact));
+    file.commit();
+}
+
+QUrl QS3Upload::Private::url(const QString &query) const
+{
+    QUrl ret = account->url(bucket, key);
+    ret.setQuery(query);
+    return ret;
+}
+
+qint64 QS3Upload::Private::length(int number) const
+{
+    return qMin(partSize, size - (number - 1) * partSize);
+}
+
+int QS3Upload::Private::count() const
+{
+    return qMax<qint64>(1, (size + partSize - 1) / partSize);
+}
+
+void QS3Upload::Private::initiate()
+{
+    uploadId.clear();
+    parts.clear();
+
+    QNetworkRequest request(url(QStringLiteral("uploads")));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, QByteArrayLiteral("application/xml"));
+    QNetworkReply *reply = QS3NetworkAccessManager::instance().send(account, request, QNetworkAccessManager::PostOperation);
+    replies.append(reply);
+    connect(reply, &QNetworkReply::finished, [this, reply]() {
+        replies.removeOne(reply);
+        reply->deleteLater();
+        if (!running) return;
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode != 200) {
+            fail(httpStatusCode);
+            return;
+        }
+        QXmlStreamReader xml(reply);
+        while (!xml.atEnd()) {
+            if (xml.readNext() == QXmlStreamReader::StartElement && xml.name() == QStringLiteral("UploadId"))
+                uploadId = xml.readElementText();
+        }
+        if (uploadId.isEmpty()) {
+            fail(httpStatusCode);
+            return;
+        }
+        writeJournal();
+        schedule();
+    });
+}
+
+void QS3Upload::Private::listParts(int marker)
+{
+    QString query = QStringLiteral("uploadId=%1").arg(QString::fromLatin1(QUrl::toPercentEncoding(uploadId)));
+    if (marker > 0)
+        query.append(QStringLiteral("&part-number-marker=%1").arg(marker));
+    QNetworkReply *reply = QS3NetworkAccessManager::instance().send(account, QNetworkRequest(url(query)), QNetworkAccessManager::GetOperation);
+    replies.append(reply);
+    connect(reply, &QNetworkReply::finished, [this, reply]() {
+        replies.removeOne(reply);
+        reply->deleteLater();
+        if (!running) return;
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        switch (httpStatusCode) {
+        case 200:
+            break;
+        case 404:
+            // the upload is gone, most likely aborted by a janitor
+            initiate();
+            return;
+        default:
+            fail(httpStatusCode);
+            return;
+        }
+
+        bool truncated = false;
+        int next = 0;
+        int number = 0;
+        QXmlStreamReader xml(reply);
+        while (!xml.atEnd()) {
+            if (xml.readNext() != QXmlStreamReader::StartElement) continue;
+            if (xml.name() == QStringLiteral("PartNumber"))
+                number = xml.readElementText().toInt();
+            else if (xml.name() == QStringLiteral("ETag"))
+                listed.insert(number, xml.readElementText().toUtf8());
+            else if (xml.name() == QStringLiteral("IsTruncated"))
+                truncated = xml.readElementText() == QStringLiteral("true");
+            else if (xml.name() == QStringLiteral("NextPartNumberMarker"))
+                next = xml.readElementText().toInt();
+        }
+        if (truncated && next > 0) {
+            listParts(next);
+            return;
+        }
+
+        // a part counts as done only if the server and the journal agree on it
+        foreach (int number, parts.keys()) {
+            if (listed.value(number) != parts.value(number))
+                parts.remove(number);
+        }
+        writeJournal();
+        schedule();
+    });
+}
+
+void QS3Upload::Private::schedule()
+{
+    pending.clear();
+    qint64 sent = 0;
+    for (int number = 1; number <= count(); number++) {
+        if (parts.contains(number))
+            sent += length(number);
+        else
+            pending.append(number);
+    }
+    q->setBytesSent(sent);
+    if (pending.isEmpty())
+        complete();
+    else
+        pump();
+}
+
+void QS3Upload::Private::pump()
+{
+    QS3NetworkAccessManager &networkAccessManager = QS3NetworkAccessManager::instance();
+    QUrl target = account->url(bucket, key);
+    while (running && active < concurrency && !pending.isEmpty()) {
+        // parts still being hashed count against the window they are about to enter
+        if (active - replies.count() + networkAccessManager.inFlight(target) >= networkAccessManager.window(target)) break;
+        int number = pending.takeFirst();
+        active++;
+        QFutureWatcher<QByteArray> *watcher = new QFutureWatcher<QByteArray>(q);
+        connect(watcher, &QFutureWatcher<QByteArray>::finished, [this, watcher, number]() {
+            watcher->deleteLater();
+            if (!running) {
+                active--;
+                return;
+            }
+            uploadPart(number, watcher->result());
+        });
+        watcher->setFuture(QtConcurrent::run(partMd5, fileName, (number - 1) * partSize, length(number)));
+    }
+}
+
+void QS3Upload::Private::uploadPart(int number, const QByteArray &md5)
+{
+    QS3FileSource *source = new QS3FileSource(fileName, (number - 1) * partSize, length(number));
+    if (md5.isEmpty() || !source->open(QIODevice::ReadOnly)) {
+        delete source;
+        active--;
+        fail(0);
+        return;
+    }
+
+    QString query = QStringLiteral("partNumber=%1&uploadId=%2").arg(number).arg(QString::fromLatin1(QUrl::toPercentEncoding(uploadId)));
+    QNetworkReply *reply = QS3NetworkAccessManager::instance().send(account, QNetworkRequest(url(query)), QNetworkAccessManager::PutOperation, source, md5);
+    source->setParent(reply);
+    replies.append(reply);
+    connect(reply, &QNetworkReply::finished, [this, reply, number]() {
+        replies.removeOne(reply);
+        reply->deleteLater();
+        active--;
+        if (!running) return;
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode == 200) {
+            parts.insert(number, reply->rawHeader("ETag"));
+            writeJournal();
+            q->setBytesSent(bytesSent + length(number));
+        } else if (retries[number]++ < 3) {
+            QS3Metrics::instance().increment(QS3Metrics::Retries);
+            // 500 ms, 1 s, then 2 s, a 503 Slow Down is S3 asking for exactly that
+            QString uploadId = this->uploadId;
+            QTimer::singleShot(250 << retries.value(number), q, [this, number, uploadId]() {
+                if (!running || uploadId != this->uploadId) return;
+                pending.prepend(number);
+                pump();
+            });
+        } else {
+            fail(httpStatusCode);
+            return;
+        }
+        if (parts.count() == count())
+            complete();
+        else
+            pump();
+    });
+}
+
+void QS3Upload::Private::complete()
+{
+    QByteArray body("<CompleteMultipartUpload>");
+    foreach (int number, parts.keys()) {
+        body.append("<Part><PartNumber>");
+        body.append(QByteArray::number(number));
+        body.append("</PartNumber><ETag>");
+        body.append(parts.value(number));
+        body.append("</ETag></Part>");
+    }
+    body.append("</CompleteMultipartUpload>");
+
+    QNetworkRequest request(url(QStringLiteral("uploadId=%1").arg(QString::fromLatin1(QUrl::toPercentEncoding(uploadId)))));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, QByteArrayLiteral("application/xml"));
+    QNetworkReply *reply = QS3NetworkAccessManager::instance().send(account, request, QNetworkAccessManager::PostOperation, body);
+    replies.append(reply);
+    connect(reply, &QNetworkReply::finished, [this, reply]() {
+        replies.removeOne(reply);
+        reply->deleteLater();
+        if (!running) return;
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode != 200) {
+            fail(httpStatusCode);
+            return;
+        }
+        // CompleteMultipartUpload can fail after the 200 status line was sent
+        QXmlStreamReader xml(reply);
+        if (xml.readNextStartElement() && xml.name() == QStringLiteral("Error")) {
+            fail(httpStatusCode);
+            return;
+        }
+        QFile::remove(journalName());
+        uploadId.clear();
+        parts.clear();
+        q->setRunning(false);
+        emit q->finished();
+    });
+}
+
+void QS3Upload::Private::fail(int httpStatusCode)
+{
+    q->setRunning(false);
+    foreach (QNetworkReply *reply, replies)
+        reply->abort();
+    emit q->failed(httpStatusCode);
+}
+
+QS3Upload::QS3Upload(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3Upload::destroyed, [d]() { delete d; });
+}
+
+QString QS3Upload::journalPath()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::DataLocation)).filePath(QStringLiteral("s3uploads"));
+}
+
+QAccount *QS3Upload::account() const
+{
+    return d->account;
+}
+
+void QS3Upload::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    d->account = account;
+    emit accountChanged(account);
+}
+
+const QString &QS3Upload::bucket() const
+{
+    return d->bucket;
+}
+
+void QS3Upload::setBucket(const QString &bucket)
+{
+    if (d->bucket == bucket) return;
+    d->bucket = bucket;
+    emit bucketChanged(bucket);
+}
+
+const QString &QS3Upload::key() const
+{
+    return d->key;
+}
+
+void QS3Upload::setKey(const QString &key)
+{
+    if (d->key == key) return;
+    d->key = key;
+    emit keyChanged(key);
+}
+
+const QString &QS3Upload::fileName() const
+{
+    return d->fileName;
+}
+
+void QS3Upload::setFileName(const QString &fileName)
+{
+    if (d->fileName == fileName) return;
+    d->fileName = fileName;
+    emit fileNameChanged(fileName);
+}
+
+qint64 QS3Upload::partSize() const
+{
+    return d->partSize;
+}
+
+void QS3Upload::setPartSize(qint64 partSize)
+{
+    if (d->partSize == partSize) return;
+    d->partSize = partSize;
+    emit partSizeChanged(partSize);
+}
+
+int QS3Upload::concurrency() const
+{
+    return d->concurrency;
+}
+
+void QS3Upload::setConcurrency(int concurrency)
+{
+    if (d->concurrency == concurrency) return;
+    d->concurrency = concurrency;
+    emit concurrencyChanged(concurrency);
+    d->pump();
+}
+
+bool QS3Upload::running() const
+{
+    return d->running;
+}
+
+void QS3Upload::setRunning(bool running)
+{
+    if (d->running == running) return;
+    d->running = running;
+    emit runningChanged(running);
+}
+
+qint64 QS3Upload::bytesSent() const
+{
+    return d->bytesSent;
+}
+
+void QS3Upload::setBytesSent(qint64 bytesSent)
+{
+    if (d->bytesSent == bytesSent) return;
+    d->bytesSent = bytesSent;
+    emit bytesSentChanged(bytesSent);
+}
+
+qint64 QS3Upload::bytesTotal() const
+{
+    return d->bytesTotal;
+}
+
+void QS3Upload::setBytesTotal(qint64 bytesTotal)
+{
+    if (d->bytesTotal == bytesTotal) return;
+    d->bytesTotal = bytesTotal;
+    emit bytesTotalChanged(bytesTotal);
+}
+
+void QS3Upload::start()
+{
+    if (d->running) return;
+    if (!d->account) return;
+    if (d->bucket.isEmpty() || d->key.isEmpty() || d->fileName.isEmpty()) return;
+
+    QFileInfo info(d->fileName);
+    if (!info.isFile()) {
+        emit failed(0);
+        return;
+    }
+    d->size = info.size();
+    d->lastModified = info.lastModified().toMSecsSinceEpoch();
+    d->uploadId.clear();
+    d->parts.clear();
+    d->listed.clear();
+    d->retries.clear();
+    d->active = 0;
+    setBytesTotal(d->size);
+    setRunning(true);
+
+    if (d->readJournal()) {
+        d->listParts(0);
+    } else {
+        // S3 accepts at most 10000 parts
+        setPartSize(qMax(d->partSize, (d->size + 9999) / 10000));
+        d->initiate();
+    }
+}
+
+void QS3Upload::abort()
+{
+    if (!d->running) return;
+    setRunning(false);
+    foreach (QNetworkReply *reply, d->replies)
+        reply->abort();
+}
+
+void QS3Upload::discard()
+{
+    abort();
+    if (d->uploadId.isEmpty() || !d->account) return;
+
+    QString query = QStringLiteral("uploadId=%1").arg(QString::fromLatin1(QUrl::toPercentEncoding(d->uploadId)));
+    QNetworkReply *reply = QS3NetworkAccessManager::instance().send(d->account, QNetworkRequest(d->url(query)), QNetworkAccessManager::DeleteOperation);
+    connect(reply, &QNetworkReply::finished, reply, &QNetworkReply::deleteLater);
+    QFile::remove(d->journalName());
+    d->uploadId.clear();
+    d->parts.clear();
+}
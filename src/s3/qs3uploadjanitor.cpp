@@ -0,0 +1,319 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3uploadjanitor.h"
+
+#include "qaccount.h"
+#include "qs3networkaccessmanager.h"
+#include "qs3upload.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QSet>
+#include <QtCore/QXmlStreamReader>
+#include <QtNetwork/QNetworkReply>
+
+class QS3UploadJanitor::Private
+{
+public:
+    Private(QS3UploadJanitor *parent);
+
+    void scan();
+    void list(const QString &keyMarker, const QString &uploadIdMarker);
+    void abort(const QString &key, const QString &uploadId);
+    bool sweeps() const;
+    void check();
+
+private:
+    QS3UploadJanitor *q;
+
+public:
+    QAccount *account;
+    QString bucket;
+    QString prefix;
+    QString initiator;
+    int maxAge;
+    bool running;
+
+    QSet<QString> referenced;
+    bool listed;
+    int pending;
+};
+
+QS3UploadJanitor::Private::Private(QS3UploadJanitor *parent)
+    : q(parent)
+    , account(0)
+    , maxAge(0)
+    , running(false)
+    , listed(false)
+    , pending(0)
+{
+}
+
+void QS3UploadJanitor::Private::scan()
+{
+    referenced.clear();
+    QDir dir(QS3Upload::journalPath());
+    foreach (const QFileInfo &info, dir.entryInfoList(QStringList() << QStringLiteral("*.json"), QDir::Files)) {
+        QFile file(info.absoluteFilePath());
+        if (!file.open(QFile::ReadOnly)) continue;
+        QJsonObject journal = QJsonDocument::fromJson(file.readAll()).object();
+        if (journal.value(QStringLiteral("bucket")).toString() != bucket) continue;
+
+        QString key = journal.value(QStringLiteral("key")).toString();
+        QString uploadId = journal.value(QStringLiteral("uploadId")).toString();
+        QFileInfo source(journal.value(QStringLiteral("fileName")).toString());
+        bool stale = !source.isFile()
+                || source.size() != static_cast<qint64>(journal.value(QStringLiteral("size")).toDouble())
+                || source.lastModified().toMSecsSinceEpoch() != static_cast<qint64>(journal.value(QStringLiteral("lastModified")).toDouble());
+        if (!stale) {
+            referenced.insert(uploadId);
+            continue;
+        }
+        // the upload can never be resumed
+        file.close();
+        QFile::remove(info.absoluteFilePath());
+        if (!uploadId.isEmpty())
+            abort(key, uploadId);
+    }
+}
+
+void QS3UploadJanitor::Private::list(const QString &keyMarker, const QString &uploadIdMarker)
+{
+    QString query = QStringLiteral("uploads");
+    if (!prefix.isEmpty())
+        query.append(QStringLiteral("&prefix=%1").arg(QString::fromLatin1(QUrl::toPercentEncoding(prefix))));
+    if (!keyMarker.isEmpty())
+        query.append(QStringLiteral("&key-marker=%1").arg(QString::fromLatin1(QUrl::toPercentEncoding(keyMarker))));
+    if (!uploadIdMarker.isEmpty())
+        query.append(QStringLiteral("&upload-id-marker=%1").arg(QString::fromLatin1(QUrl::toPercentEncoding(uploadIdMarker))));
+    QUrl url = account->url(bucket);
+    url.setQuery(query);
+
+    pending++;
+    QNetworkReply *reply = QS3NetworkAccessManager::instance().send(account, QNetworkRequest(url), QNetworkAccessManager::GetOperation);
+    connect(reply, &QNetworkReply::finished, [this, reply]() {
+        reply->deleteLater();
+        pending--;
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode != 200) {
+            emit q->failed(httpStatusCode);
+            listed = true;
+            check();
+            return;
+        }
+
+        QDateTime expired = QDateTime::currentDateTimeUtc().addSecs(-maxAge);
+        bool truncated = false;
+        QString nextKeyMarker;
+        QString nextUploadIdMarker;
+        QString key;
+        QString uploadId;
+        QString initiatorId;
+        QDateTime initiated;
+        bool inInitiator = false;
+        QXmlStreamReader xml(reply);
+        while (!xml.atEnd()) {
+            switch (xml.readNext()) {
+            case QXmlStreamReader::StartElement:
+                if (xml.name() == QStringLiteral("Upload")) {
+                    key.clear();
+                    uploadId.clear();
+                    initiatorId.clear();
+                    initiated = QDateTime();
+                } else if (xml.name() == QStringLiteral("Key")) {
+                    key = xml.readElementText();
+                } else if (xml.name() == QStringLiteral("UploadId")) {
+                    uploadId = xml.readElementText();
+                } else if (xml.name() == QStringLiteral("Initiator")) {
+                    inInitiator = true;
+                } else if (xml.name() == QStringLiteral("ID") && inInitiator) {
+                    initiatorId = xml.readElementText();
+                } else if (xml.name() == QStringLiteral("Initiated")) {
+                    initiated = QDateTime::fromString(xml.readElementText(), QStringLiteral("yyyy-MM-ddThh:mm:ss.zzzZ"));
+                    initiated.setTimeSpec(Qt::UTC);
+                } else if (xml.name() == QStringLiteral("IsTruncated")) {
+                    truncated = xml.readElementText() == QStringLiteral("true");
+                } else if (xml.name() == QStringLiteral("NextKeyMarker")) {
+                    nextKeyMarker = xml.readElementText();
+                } else if (xml.name() == QStringLiteral("NextUploadIdMarker")) {
+                    nextUploadIdMarker = xml.readElementText();
+                }
+                break;
+            case QXmlStreamReader::EndElement:
+                if (xml.name() == QStringLiteral("Initiator")) {
+                    inInitiator = false;
+                } else if (xml.name() == QStringLiteral("Upload")) {
+                    // uploads of other hosts and tools are left alone, only our own initiator is trusted
+                    bool ours = initiator.isEmpty() || initiatorId == initiator;
+                    if (ours && initiated.isValid() && initiated < expired && !referenced.contains(uploadId))
+                        abort(key, uploadId);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        if (truncated)
+            list(nextKeyMarker, nextUploadIdMarker);
+        else
+            listed = true;
+        check();
+    });
+}
+
+void QS3UploadJanitor::Private::abort(const QString &key, const QString &uploadId)
+{
+    QUrl url = account->url(bucket, key);
+    url.setQuery(QStringLiteral("uploadId=%1").arg(QString::fromLatin1(QUrl::toPercentEncoding(uploadId))));
+
+    pending++;
+    QNetworkReply *reply = QS3NetworkAccessManager::instance().send(account, QNetworkRequest(url), QNetworkAccessManager::DeleteOperation);
+    connect(reply, &QNetworkReply::finished, [this, reply, key, uploadId]() {
+        reply->deleteLater();
+        pending--;
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode == 204)
+            emit q->aborted(key, uploadId);
+        else if (httpStatusCode != 404)
+            emit q->failed(httpStatusCode);
+        check();
+    });
+}
+
+bool QS3UploadJanitor::Private::sweeps() const
+{
+    // aborting what nobody here knows about is opt in and needs a scope this client owns
+    return maxAge > 0 && (!prefix.isEmpty() || !initiator.isEmpty());
+}
+
+void QS3UploadJanitor::Private::check()
+{
+    if (!listed || pending > 0) return;
+    q->setRunning(false);
+    emit q->finished();
+}
+
+QS3UploadJanitor::QS3UploadJanitor(QObject *parent)
+    : QObject(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3UploadJanitor::destroyed, [d]() { delete d; });
+}
+
+QAccount *QS3UploadJanitor::account() const
+{
+    return d->account;
+}
+
+void QS3UploadJanitor::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    d->account = account;
+    emit accountChanged(account);
+}
+
+const QString &QS3UploadJanitor::bucket() const
+{
+    return d->bucket;
+}
+
+void QS3UploadJanitor::setBucket(const QString &bucket)
+{
+    if (d->bucket == bucket) return;
+    d->bucket = bucket;
+    emit bucketChanged(bucket);
+}
+
+const QString &QS3UploadJanitor::prefix() const
+{
+    return d->prefix;
+}
+
+void QS3UploadJanitor::setPrefix(const QString &prefix)
+{
+    if (d->prefix == prefix) return;
+    d->prefix = prefix;
+    emit prefixChanged(prefix);
+}
+
+const QString &QS3UploadJanitor::initiator() const
+{
+    return d->initiator;
+}
+
+void QS3UploadJanitor::setInitiator(const QString &initiator)
+{
+    if (d->initiator == initiator) return;
+    d->initiator = initiator;
+    emit initiatorChanged(initiator);
+}
+
+int QS3UploadJanitor::maxAge() const
+{
+    return d->maxAge;
+}
+
+void QS3UploadJanitor::setMaxAge(int maxAge)
+{
+    if (d->maxAge == maxAge) return;
+    d->maxAge = maxAge;
+    emit maxAgeChanged(maxAge);
+}
+
+bool QS3UploadJanitor::running() const
+{
+    return d->running;
+}
+
+void QS3UploadJanitor::setRunning(bool running)
+{
+    if (d->running == running) return;
+    d->running = running;
+    emit runningChanged(running);
+}
+
+void QS3UploadJanitor::start()
+{
+    if (d->running) return;
+    if (!d->account) return;
+    if (d->bucket.isEmpty()) return;
+
+    setRunning(true);
+    d->listed = false;
+    d->pending = 0;
+    d->scan();
+    if (d->sweeps())
+        d->list(QString(), QString());
+    else
+        d->listed = true;
+    d->check();
+}
@@ -0,0 +1,84 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef QS3UPLOADJANITOR_H
+#define QS3UPLOADJANITOR_H
+
+#include "s3_global.h"
+
+#include <QtCore/QObject>
+
+class QAccount;
+
+class S3_EXPORT QS3UploadJanitor : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QAccount *account READ account WRITE setAccount NOTIFY accountChanged)
+    Q_PROPERTY(QString bucket READ bucket WRITE setBucket NOTIFY bucketChanged)
+    Q_PROPERTY(QString prefix READ prefix WRITE setPrefix NOTIFY prefixChanged)
+    Q_PROPERTY(QString initiator READ initiator WRITE setInitiator NOTIFY initiatorChanged)
+    Q_PROPERTY(int maxAge READ maxAge WRITE setMaxAge NOTIFY maxAgeChanged)
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+public:
+    explicit QS3UploadJanitor(QObject *parent = 0);
+
+    QAccount *account() const;
+    const QString &bucket() const;
+    const QString &prefix() const;
+    const QString &initiator() const;
+    int maxAge() const;
+    bool running() const;
+
+public slots:
+    void setAccount(QAccount *account);
+    void setBucket(const QString &bucket);
+    void setPrefix(const QString &prefix);
+    void setInitiator(const QString &initiator);
+    void setMaxAge(int maxAge);
+
+    void start();
+
+private slots:
+    void setRunning(bool running);
+
+signals:
+    void accountChanged(QAccount *account);
+    void bucketChanged(const QString &bucket);
+    void prefixChanged(const QString &prefix);
+    void initiatorChanged(const QString &initiator);
+    void maxAgeChanged(int maxAge);
+    void runningChanged(bool running);
+
+    void aborted(const QString &key, const QString &uploadId);
+    void failed(int httpStatusCode);
+    void finished();
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // QS3UPLOADJANITOR_H
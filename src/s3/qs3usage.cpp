@@ -0,0 +1,526 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "qs3usage.h"
+
+#include "qaccount.h"
+#include "qs3listbucketresult.h"
+#include "qs3metrics.h"
+#include "qs3networkaccessmanager.h"
+#include "qs3trace.h"
+
+#include <QtCore/QTimer>
+#include <QtCore/QUrlQuery>
+#include <QtNetwork/QNetworkReply>
+
+class QS3Usage::Private
+{
+public:
+    struct Totals {
+        Totals() : objects(0), bytes(0) {}
+        qint64 objects;
+        qint64 bytes;
+    };
+
+    struct Row {
+        QString prefix;
+        int depth;
+        Totals totals;
+        QHash<QString, Totals> storageClasses;
+    };
+
+    // a prefix listed page by page, with a delimiter while it is shallower than depth
+    struct Task {
+        QString prefix;
+        int level;
+        QString marker;
+        int attempts;
+    };
+
+    Private(QS3Usage *parent);
+
+    int row(const QString &prefix, int depth);
+    void add(int row, qint64 size, const QString &storageClass);
+    void add(const QVariantMap &content);
+    void pump();
+    void list(const Task &task);
+    void send(const Task &task, const QNetworkRequest &request);
+    void received(Task task, const QS3ListBucketResult &result);
+    void retry(Task task, int httpStatusCode);
+    void done();
+    void flush();
+
+private:
+    QS3Usage *q;
+
+public:
+    static QHash<int, QByteArray> roleNames;
+    QAccount *account;
+    QString name;
+    QString prefix;
+    QString delimiter;
+    int depth;
+    int concurrency;
+    bool loading;
+
+    QVector<Row> rows;
+    QHash<QString, int> index;
+    int published;
+    int dirtyFirst;
+    int dirtyLast;
+    qint64 objects;
+    qint64 bytes;
+
+    QList<Task> queue;
+    QList<QNetworkReply *> replies;
+    // tasks sitting out their backoff, neither queued nor in flight
+    int waiting;
+    int generation;
+    QTimer timer;
+};
+
+QHash<int, QByteArray> QS3Usage::Private::roleNames;
+
+QS3Usage::Private::Private(QS3Usage *parent)
+    : q(parent)
+    , account(0)
+    , delimiter(QStringLiteral("/"))
+    , depth(1)
+    , concurrency(8)
+    , loading(false)
+    , published(0)
+    , dirtyFirst(-1)
+    , dirtyLast(-1)
+    , objects(0)
+    , bytes(0)
+    , waiting(0)
+    , generation(0)
+{
+    // totals move with every page, views see them a few times a second
+    timer.setInterval(250);
+    timer.setSingleShot(true);
+    connect(&timer, &QTimer::timeout, [this]() { flush(); });
+    connect(&QS3NetworkAccessManager::instance(), &QS3NetworkAccessManager::windowAvailable, parent, [this]() {
+        if (!queue.isEmpty())
+            pump();
+    });
+}
+
+int QS3Usage::Private::row(const QString &prefix, int depth)
+{
+    QHash<QString, int>::const_iterator i = index.constFind(prefix);
+    if (i != index.constEnd()) return i.value();
+    Row row;
+    row.prefix = prefix;
+    row.depth = depth;
+    rows.append(row);
+    index.insert(prefix, rows.count() - 1);
+    if (!timer.isActive())
+        timer.start();
+    return rows.count() - 1;
+}
+
+void QS3Usage::Private::add(int row, qint64 size, const QString &storageClass)
+{
+    Row &r = rows[row];
+    r.totals.objects++;
+    r.totals.bytes += size;
+    Totals &totals = r.storageClasses[storageClass];
+    totals.objects++;
+    totals.bytes += size;
+    if (row < published) {
+        dirtyFirst = dirtyFirst < 0 ? row : qMin(dirtyFirst, row);
+        dirtyLast = qMax(dirtyLast, row);
+    }
+}
+
+void QS3Usage::Private::add(const QVariantMap &content)
+{
+    QString key = content.value(QStringLiteral("key")).toString();
+    qint64 size = content.value(QStringLiteral("size")).toLongLong();
+    QString storageClass = content.value(QStringLiteral("storageClass")).toString();
+
+    // every object counts towards each enclosing prefix down to depth
+    add(0, size, storageClass);
+    int from = prefix.length();
+    for (int level = 1; level <= depth && !delimiter.isEmpty(); level++) {
+        int at = key.indexOf(delimiter, from);
+        if (at < 0) break;
+        from = at + delimiter.length();
+        add(row(key.left(from), level), size, storageClass);
+    }
+    if (!timer.isActive())
+        timer.start();
+}
+
+void QS3Usage::Private::pump()
+{
+    while (replies.count() < concurrency && !queue.isEmpty()) {
+        QUrl url = account->url(name);
+        if (QS3NetworkAccessManager::instance().isSaturated(url)) break;
+        list(queue.takeFirst());
+    }
+    if (replies.isEmpty() && queue.isEmpty() && waiting == 0)
+        done();
+}
+
+void QS3Usage::Private::list(const Task &task)
+{
+    QUrl url = account->url(name);
+    QUrlQuery query;
+    // below depth the totals roll up, so the rest of the subtree is listed flat
+    if (task.level < depth && !delimiter.isEmpty())
+        query.addQueryItem(QStringLiteral("delimiter"), QString::fromLatin1(QUrl::toPercentEncoding(delimiter)));
+    if (!task.marker.isEmpty())
+        query.addQueryItem(QStringLiteral("marker"), QString::fromLatin1(QUrl::toPercentEncoding(task.marker)));
+    query.addQueryItem(QStringLiteral("max-keys"), QStringLiteral("1000"));
+    if (!task.prefix.isEmpty())
+        query.addQueryItem(QStringLiteral("prefix"), QString::fromLatin1(QUrl::toPercentEncoding(task.prefix)));
+    url.setQuery(query);
+
+    QNetworkRequest request(url);
+    // a crawl is bulk work, it should not get in the way of browsing
+    request.setPriority(QNetworkRequest::LowPriority);
+    send(task, request);
+}
+
+void QS3Usage::Private::send(const Task &task, const QNetworkRequest &request)
+{
+    int generation = this->generation;
+    auto track = [this](QNetworkReply *reply, bool inFlight) {
+        if (inFlight)
+            replies.append(reply);
+        else
+            replies.removeOne(reply);
+    };
+    QS3NetworkAccessManager::instance().follow(account, request, QNetworkAccessManager::GetOperation, QByteArray(), q, track, [this, task, generation](QNetworkReply *reply) {
+        if (generation != this->generation) return;
+
+        int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (httpStatusCode == 200) {
+            QS3ListBucketResult result;
+            if (result.read(reply)) {
+                received(task, result);
+                return;
+            }
+        }
+        retry(task, httpStatusCode);
+    });
+}
+
+void QS3Usage::Private::received(Task task, const QS3ListBucketResult &result)
+{
+    QS3_TRACE_SCOPE("usage", "aggregate");
+    QString last;
+    foreach (const QVariantMap &content, result.contents) {
+        add(content);
+        last = qMax(last, content.value(QStringLiteral("key")).toString());
+    }
+    // folders found on the way are crawled side by side
+    foreach (const QVariantMap &commonPrefix, result.commonPrefixes) {
+        QString key = commonPrefix.value(QStringLiteral("key")).toString();
+        last = qMax(last, key);
+        row(key, task.level + 1);
+        Task child;
+        child.prefix = key;
+        child.level = task.level + 1;
+        child.attempts = 0;
+        queue.append(child);
+    }
+
+    if (result.truncated.toBool()) {
+        task.marker = result.nextMarker.isValid() ? result.nextMarker.toString() : last;
+        task.attempts = 0;
+        // finishing a prefix first keeps the number of half done prefixes low
+        queue.prepend(task);
+    }
+    pump();
+}
+
+void QS3Usage::Private::retry(Task task, int httpStatusCode)
+{
+    if (++task.attempts < 3) {
+        QS3Metrics::instance().increment(QS3Metrics::Retries);
+        // 500 ms, then 1 s, a 503 Slow Down wants the bucket left alone for a moment
+        int generation = this->generation;
+        waiting++;
+        QTimer::singleShot(250 << task.attempts, q, [this, task, generation]() {
+            if (generation != this->generation) return;
+            waiting--;
+            queue.prepend(task);
+            pump();
+        });
+        return;
+    }
+    q->abort();
+    emit q->failed(httpStatusCode);
+}
+
+void QS3Usage::Private::done()
+{
+    if (!loading) return;
+    timer.stop();
+    flush();
+    q->setLoading(false);
+    emit q->finished();
+}
+
+void QS3Usage::Private::flush()
+{
+    if (dirtyFirst >= 0) {
+        emit q->dataChanged(q->index(dirtyFirst), q->index(dirtyLast));
+        dirtyFirst = dirtyLast = -1;
+    }
+    if (published < rows.count()) {
+        q->beginInsertRows(QModelIndex(), published, rows.count() - 1);
+        published = rows.count();
+        q->endInsertRows();
+        emit q->countChanged(published);
+    }
+    if (rows.isEmpty()) return;
+    const Totals &totals = rows.first().totals;
+    if (objects != totals.objects) {
+        objects = totals.objects;
+        emit q->objectsChanged(objects);
+    }
+    if (bytes != totals.bytes) {
+        bytes = totals.bytes;
+        emit q->bytesChanged(bytes);
+    }
+}
+
+QS3Usage::QS3Usage(QObject *parent)
+    : QAbstractListModel(parent)
+    , d(new Private(this))
+{
+    connect(this, &QS3Usage::destroyed, [d]() { delete d; });
+}
+
+int QS3Usage::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return d->published;
+}
+
+QVariant QS3Usage::data(const QModelIndex &index, int role) const
+{
+    int row = index.row();
+    if (row < 0 || row >= d->published) return QVariant();
+    const Private::Row &r = d->rows.at(row);
+    switch (role - Qt::UserRole) {
+    case 0:
+        return r.prefix;
+    case 1:
+        return r.depth;
+    case 2:
+        return r.totals.objects;
+    case 3:
+        return r.totals.bytes;
+    case 4: {
+        QVariantMap ret;
+        for (QHash<QString, Private::Totals>::const_iterator i = r.storageClasses.constBegin(); i != r.storageClasses.constEnd(); ++i) {
+            QVariantMap totals;
+            totals.insert(QStringLiteral("objects"), i.value().objects);
+            totals.insert(QStringLiteral("bytes"), i.value().bytes);
+            ret.insert(i.key(), totals);
+        }
+        return ret; }
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+QHash<int, QByteArray> QS3Usage::roleNames() const
+{
+    if (d->roleNames.isEmpty()) {
+        int role = Qt::UserRole;
+        d->roleNames.insert(role++, "prefix");
+        d->roleNames.insert(role++, "depth");
+        d->roleNames.insert(role++, "objects");
+        d->roleNames.insert(role++, "bytes");
+        d->roleNames.insert(role++, "storageClasses");
+    }
+    return d->roleNames;
+}
+
+QAccount *QS3Usage::account() const
+{
+    return d->account;
+}
+
+void QS3Usage::setAccount(QAccount *account)
+{
+    if (d->account == account) return;
+    d->account = account;
+    emit accountChanged(account);
+}
+
+const QString &QS3Usage::name() const
+{
+    return d->name;
+}
+
+void QS3Usage::setName(const QString &name)
+{
+    if (d->name == name) return;
+    d->name = name;
+    emit nameChanged(name);
+}
+
+const QString &QS3Usage::prefix() const
+{
+    return d->prefix;
+}
+
+void QS3Usage::setPrefix(const QString &prefix)
+{
+    if (d->prefix == prefix) return;
+    d->prefix = prefix;
+    emit prefixChanged(prefix);
+}
+
+const QString &QS3Usage::delimiter() const
+{
+    return d->delimiter;
+}
+
+void QS3Usage::setDelimiter(const QString &delimiter)
+{
+    if (d->delimiter == delimiter) return;
+    d->delimiter = delimiter;
+    emit delimiterChanged(delimiter);
+}
+
+int QS3Usage::depth() const
+{
+    return d->depth;
+}
+
+void QS3Usage::setDepth(int depth)
+{
+    if (d->depth == depth) return;
+    d->depth = depth;
+    emit depthChanged(depth);
+}
+
+int QS3Usage::concurrency() const
+{
+    return d->concurrency;
+}
+
+void QS3Usage::setConcurrency(int concurrency)
+{
+    if (d->concurrency == concurrency) return;
+    d->concurrency = concurrency;
+    emit concurrencyChanged(concurrency);
+    if (d->loading)
+        d->pump();
+}
+
+bool QS3Usage::loading() const
+{
+    return d->loading;
+}
+
+void QS3Usage::setLoading(bool loading)
+{
+    if (d->loading == loading) return;
+    d->loading = loading;
+    emit loadingChanged(loading);
+}
+
+qint64 QS3Usage::objects() const
+{
+    return d->objects;
+}
+
+qint64 QS3Usage::bytes() const
+{
+    return d->bytes;
+}
+
+int QS3Usage::count() const
+{
+    return d->published;
+}
+
+QVariantMap QS3Usage::get(int i) const
+{
+    QVariantMap ret;
+    if (i < 0 || i >= d->published) return ret;
+    QHash<int, QByteArray> roleNames = this->roleNames();
+    foreach (int role, roleNames.keys())
+        ret.insert(QString::fromUtf8(roleNames.value(role)), data(index(i), role));
+    return ret;
+}
+
+QVariantMap QS3Usage::totals(const QString &prefix) const
+{
+    int row = d->index.value(prefix, -1);
+    if (row < 0 || row >= d->published) return QVariantMap();
+    return get(row);
+}
+
+void QS3Usage::load()
+{
+    if (!d->account) return;
+    if (d->name.isEmpty()) return;
+
+    abort();
+    beginResetModel();
+    d->rows.clear();
+    d->index.clear();
+    d->published = 0;
+    d->dirtyFirst = d->dirtyLast = -1;
+    d->row(d->prefix, 0);
+    endResetModel();
+    emit countChanged(0);
+
+    Private::Task task;
+    task.prefix = d->prefix;
+    task.level = 0;
+    task.attempts = 0;
+    d->queue.append(task);
+    setLoading(true);
+    d->pump();
+}
+
+void QS3Usage::abort()
+{
+    d->generation++;
+    foreach (QNetworkReply *reply, d->replies) {
+        disconnect(reply, 0, this, 0);
+        reply->abort();
+        reply->deleteLater();
+    }
+    d->replies.clear();
+    d->queue.clear();
+    d->waiting = 0;
+    d->timer.stop();
+    d->flush();
+    setLoading(false);
+}
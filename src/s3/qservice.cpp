@@ -94,7 +94,8 @@ void QService::setOwner(const QVariantMap &owner)
 void QService::load()
 {
     if (loading()) return;
-    start(QUrl(QStringLiteral("http://s3.amazonaws.com/")), QNetworkAccessManager::GetOperation);
+    if (!account()) return;
+    start(account()->url(), QNetworkAccessManager::GetOperation);
 }
 
 void QService::finished(QIODevice *io)
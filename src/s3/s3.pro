@@ -1,18 +1,71 @@
 TARGET = QtAmazonS3
 MODULE = amazons3
-QT = core network
+QT = core network concurrent
 
 load(qt_module)
 
-PUBLIC_HEADERS = qaccount.h qservice.h qbucket.h
+PUBLIC_HEADERS = qaccount.h qservice.h qbucket.h \
+    qs3sync.h \
+    qs3filesource.h \
+    qs3gzipdevice.h \
+    qs3download.h \
+    qs3upload.h \
+    qs3uploadjanitor.h \
+    qs3tokenbucket.h \
+    qs3networkaccessmanager.h \
+    qs3presigner.h \
+    qs3object.h \
+    qs3randomaccessdevice.h \
+    qs3blockcache.h \
+    qs3eventstreamdecoder.h \
+    qs3select.h \
+    qs3inventory.h \
+    qs3metrics.h \
+    qs3trace.h \
+    qs3sparsebucket.h \
+    qs3sortfilterproxymodel.h \
+    qs3treemodel.h \
+    qs3searchmodel.h \
+    qs3usage.h \
+    qs3federatedmodel.h
 HEADERS = $$PUBLIC_HEADERS \
     qabstracts3model.h \
-    qs3networkaccessmanager.h
+    qs3keyindex.h \
+    qs3listbucketresult.h \
+    qs3queuedreply.h \
+    qs3throttleddevice.h
 SOURCES = qaccount.cpp qservice.cpp qbucket.cpp \
+    qs3sync.cpp \
+    qs3filesource.cpp \
+    qs3gzipdevice.cpp \
+    qs3download.cpp \
+    qs3upload.cpp \
+    qs3uploadjanitor.cpp \
+    qs3tokenbucket.cpp \
+    qs3presigner.cpp \
+    qs3object.cpp \
+    qs3randomaccessdevice.cpp \
+    qs3blockcache.cpp \
+    qs3eventstreamdecoder.cpp \
+    qs3select.cpp \
+    qs3inventory.cpp \
+    qs3metrics.cpp \
+    qs3trace.cpp \
+    qs3sparsebucket.cpp \
+    qs3sortfilterproxymodel.cpp \
+    qs3treemodel.cpp \
+    qs3searchmodel.cpp \
+    qs3usage.cpp \
+    qs3federatedmodel.cpp \
     qabstracts3model.cpp \
-    qs3networkaccessmanager.cpp
+    qs3keyindex.cpp \
+    qs3listbucketresult.cpp \
+    qs3networkaccessmanager.cpp \
+    qs3queuedreply.cpp \
+    qs3throttleddevice.cpp
 
 DEFINES += S3_LIBRARY
+LIBS_PRIVATE += -lz
 
 HEADERS += \
     abstractapi.h \
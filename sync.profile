@@ -8,7 +8,30 @@
 %classnames = (
     "qaccount.h" => "QAccount",
     "qservice.h" => "QService",
-    "qbucket.h" => "QBucket"
+    "qbucket.h" => "QBucket",
+    "qs3sync.h" => "QS3Sync",
+    "qs3filesource.h" => "QS3FileSource",
+    "qs3gzipdevice.h" => "QS3GzipDevice",
+    "qs3download.h" => "QS3Download",
+    "qs3upload.h" => "QS3Upload",
+    "qs3uploadjanitor.h" => "QS3UploadJanitor",
+    "qs3tokenbucket.h" => "QS3TokenBucket",
+    "qs3networkaccessmanager.h" => "QS3NetworkAccessManager",
+    "qs3presigner.h" => "QS3Presigner",
+    "qs3object.h" => "QS3Object",
+    "qs3randomaccessdevice.h" => "QS3RandomAccessDevice",
+    "qs3blockcache.h" => "QS3BlockCache",
+    "qs3eventstreamdecoder.h" => "QS3EventStreamDecoder",
+    "qs3select.h" => "QS3Select",
+    "qs3inventory.h" => "QS3Inventory",
+    "qs3metrics.h" => "QS3Metrics",
+    "qs3trace.h" => "QS3Trace",
+    "qs3sparsebucket.h" => "QS3SparseBucket",
+    "qs3sortfilterproxymodel.h" => "QS3SortFilterProxyModel",
+    "qs3treemodel.h" => "QS3TreeModel",
+    "qs3searchmodel.h" => "QS3SearchModel",
+    "qs3usage.h" => "QS3Usage",
+    "qs3federatedmodel.h" => "QS3FederatedModel"
 );
 %dependencies = (
     "qtbase" => "refs/heads/dev",
@@ -0,0 +1,7 @@
+TEMPLATE = subdirs
+SUBDIRS = \
+    eventstreamdecoder \
+    download \
+    sync \
+    select \
+    listing
@@ -0,0 +1,177 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest/QtTest>
+
+#include <QtAmazonS3/QAccount>
+#include <QtAmazonS3/QS3BlockCache>
+#include <QtAmazonS3/QS3Download>
+#include <QtAmazonS3/QS3Metrics>
+
+#include "mocks3server.h"
+
+class tst_QS3Download : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+
+    void download();
+    void resume();
+    void changed();
+    void complete();
+    void cached();
+
+private:
+    void writePartial(const QByteArray &data, const QByteArray &eTag);
+    bool run();
+
+    MockS3Server server;
+    QAccount account;
+    QTemporaryDir dir;
+    QString key;
+    QString fileName;
+    QByteArray content;
+};
+
+void tst_QS3Download::initTestCase()
+{
+    server.setCredentials("mock", "mock");
+    server.addBucket(QStringLiteral("mock"), 10, 100000);
+    QVERIFY(server.start());
+    account.setAwsAccessKeyId("mock");
+    account.setAwsSecretAccessKey("mock");
+    account.setEndpoint(QUrl(QStringLiteral("http://127.0.0.1:%1/").arg(server.serverPort())));
+
+    QVERIFY(dir.isValid());
+    // only cached() uses the block cache, and never the one of the user
+    QS3BlockCache::instance().setDirectory(QString());
+    key = QStringLiteral("dir0000/object00000003");
+    content = MockS3Server::content(key, 100000);
+}
+
+void tst_QS3Download::init()
+{
+    fileName = dir.filePath(QString::fromLatin1(QTest::currentTestFunction()));
+}
+
+void tst_QS3Download::writePartial(const QByteArray &data, const QByteArray &eTag)
+{
+    // what an interrupted run leaves behind
+    QFile partial(fileName + QStringLiteral(".part"));
+    QVERIFY(partial.open(QFile::WriteOnly));
+    partial.write(data);
+
+    QJsonObject journal;
+    journal.insert(QStringLiteral("bucket"), QStringLiteral("mock"));
+    journal.insert(QStringLiteral("key"), key);
+    journal.insert(QStringLiteral("offset"), static_cast<double>(data.size()));
+    journal.insert(QStringLiteral("eTag"), QString::fromLatin1(eTag));
+    journal.insert(QStringLiteral("lastModified"), QString());
+    QFile file(fileName + QStringLiteral(".s3journal"));
+    QVERIFY(file.open(QFile::WriteOnly));
+    file.write(QJsonDocument(journal).toJson(QJsonDocument::Compact));
+}
+
+bool tst_QS3Download::run()
+{
+    QS3Download download;
+    download.setAccount(&account);
+    download.setBucket(QStringLiteral("mock"));
+    download.setKey(key);
+    download.setFileName(fileName);
+    QSignalSpy finished(&download, &QS3Download::finished);
+    QSignalSpy failed(&download, &QS3Download::failed);
+    download.start();
+    if (!QTest::qWaitFor([&]() { return finished.count() + failed.count() > 0; }, 10000)) return false;
+    return finished.count() == 1 && failed.isEmpty() && download.bytesTotal() == content.size();
+}
+
+void tst_QS3Download::download()
+{
+    QVERIFY(run());
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::ReadOnly));
+    QCOMPARE(file.readAll(), content);
+    QVERIFY(!QFile::exists(fileName + QStringLiteral(".part")));
+    QVERIFY(!QFile::exists(fileName + QStringLiteral(".s3journal")));
+}
+
+void tst_QS3Download::resume()
+{
+    writePartial(content.left(40000), server.eTag(key, content.size()));
+    QVERIFY(run());
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::ReadOnly));
+    QCOMPARE(file.readAll(), content);
+}
+
+void tst_QS3Download::changed()
+{
+    // 412, the partial belongs to an older version and is thrown away
+    writePartial(QByteArray(40000, 'x'), "\"0123456789abcdef0123456789abcdef\"");
+    QVERIFY(run());
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::ReadOnly));
+    QCOMPARE(file.readAll(), content);
+}
+
+void tst_QS3Download::complete()
+{
+    // 416, the last run got every byte and stopped before the rename
+    writePartial(content, server.eTag(key, content.size()));
+    QVERIFY(run());
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::ReadOnly));
+    QCOMPARE(file.readAll(), content);
+    QVERIFY(!QFile::exists(fileName + QStringLiteral(".s3journal")));
+}
+
+void tst_QS3Download::cached()
+{
+    QTemporaryDir cache;
+    QVERIFY(cache.isValid());
+    QS3BlockCache::instance().setDirectory(cache.path());
+
+    // the first run leaves the object in the block cache, the resume of a second one takes it from there
+    QVERIFY(run());
+    fileName = dir.filePath(QStringLiteral("cached2"));
+    writePartial(QByteArray(), server.eTag(key, content.size()));
+    qint64 hits = QS3Metrics::instance().cacheHits();
+    QVERIFY(run());
+    QS3BlockCache::instance().setDirectory(QString());
+
+    QVERIFY(QS3Metrics::instance().cacheHits() > hits);
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::ReadOnly));
+    QCOMPARE(file.readAll(), content);
+}
+
+QTEST_MAIN(tst_QS3Download)
+
+#include "tst_qs3download.moc"
@@ -0,0 +1,4 @@
+TARGET = tst_qs3eventstreamdecoder
+QT = core network testlib amazons3
+
+SOURCES = tst_qs3eventstreamdecoder.cpp
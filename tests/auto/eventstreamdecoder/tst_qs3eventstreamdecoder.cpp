@@ -0,0 +1,148 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest/QtTest>
+
+#include <QtAmazonS3/QS3EventStreamDecoder>
+
+class tst_QS3EventStreamDecoder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void split();
+    void checksum();
+    void headersLength_data();
+    void headersLength();
+
+private:
+    static quint32 crc32(const QByteArray &data);
+    static QByteArray prelude(quint32 totalLength, quint32 headersLength);
+    static QVariantMap headers(const QString &eventType);
+};
+
+quint32 tst_QS3EventStreamDecoder::crc32(const QByteArray &data)
+{
+    // the plain CRC-32 of the prelude, so that a forged length gets past the checksum
+    quint32 ret = 0xffffffff;
+    foreach (char c, data) {
+        ret ^= static_cast<uchar>(c);
+        for (int bit = 0; bit < 8; bit++)
+            ret = ret & 1 ? (ret >> 1) ^ 0xedb88320 : ret >> 1;
+    }
+    return ~ret;
+}
+
+QByteArray tst_QS3EventStreamDecoder::prelude(quint32 totalLength, quint32 headersLength)
+{
+    QByteArray ret(12, Qt::Uninitialized);
+    uchar *p = reinterpret_cast<uchar *>(ret.data());
+    qToBigEndian<quint32>(totalLength, p);
+    qToBigEndian<quint32>(headersLength, p + 4);
+    qToBigEndian<quint32>(crc32(ret.left(8)), p + 8);
+    return ret;
+}
+
+QVariantMap tst_QS3EventStreamDecoder::headers(const QString &eventType)
+{
+    QVariantMap ret;
+    ret.insert(QStringLiteral(":message-type"), QStringLiteral("event"));
+    ret.insert(QStringLiteral(":event-type"), eventType);
+    return ret;
+}
+
+void tst_QS3EventStreamDecoder::roundTrip()
+{
+    QS3EventStreamDecoder decoder;
+    decoder.feed(QS3EventStreamDecoder::encode(headers(QStringLiteral("Records")), "a,1\nb,2\n"));
+    decoder.feed(QS3EventStreamDecoder::encode(headers(QStringLiteral("End")), QByteArray()));
+
+    QS3EventStreamDecoder::Message message;
+    QVERIFY(decoder.next(&message));
+    QCOMPARE(message.headers, headers(QStringLiteral("Records")));
+    QCOMPARE(message.payload, QByteArray("a,1\nb,2\n"));
+    QVERIFY(decoder.next(&message));
+    QCOMPARE(message.headers, headers(QStringLiteral("End")));
+    QVERIFY(message.payload.isEmpty());
+    QVERIFY(!decoder.next(&message));
+    QVERIFY(!decoder.hasError());
+}
+
+void tst_QS3EventStreamDecoder::split()
+{
+    // the network cuts messages anywhere, prelude included
+    QByteArray data = QS3EventStreamDecoder::encode(headers(QStringLiteral("Records")), "record\n");
+    QS3EventStreamDecoder decoder;
+    QS3EventStreamDecoder::Message message;
+    for (int i = 0; i < data.size() - 1; i++) {
+        decoder.feed(data.mid(i, 1));
+        QVERIFY(!decoder.next(&message));
+    }
+    decoder.feed(data.right(1));
+    QVERIFY(decoder.next(&message));
+    QCOMPARE(message.payload, QByteArray("record\n"));
+    QVERIFY(!decoder.hasError());
+}
+
+void tst_QS3EventStreamDecoder::checksum()
+{
+    QByteArray data = QS3EventStreamDecoder::encode(headers(QStringLiteral("Records")), "record\n");
+    data[data.size() - 6] = 'X';
+
+    QS3EventStreamDecoder decoder;
+    decoder.feed(data);
+    QS3EventStreamDecoder::Message message;
+    QVERIFY(!decoder.next(&message));
+    QVERIFY(decoder.hasError());
+}
+
+void tst_QS3EventStreamDecoder::headersLength_data()
+{
+    QTest::addColumn<quint32>("totalLength");
+    QTest::addColumn<quint32>("headersLength");
+    QTest::newRow("too short") << quint32(15) << quint32(0);
+    QTest::newRow("headers past the end") << quint32(32) << quint32(17);
+    // 16 + headersLength wraps around to 8 in 32 bits
+    QTest::newRow("overflow") << quint32(32) << quint32(0xfffffff8);
+    QTest::newRow("too long") << quint32(64 * 1024 * 1024) << quint32(0);
+}
+
+void tst_QS3EventStreamDecoder::headersLength()
+{
+    QFETCH(quint32, totalLength);
+    QFETCH(quint32, headersLength);
+
+    QS3EventStreamDecoder decoder;
+    decoder.feed(prelude(totalLength, headersLength) + QByteArray(20, '\0'));
+    QS3EventStreamDecoder::Message message;
+    QVERIFY(!decoder.next(&message));
+    QVERIFY(decoder.hasError());
+}
+
+QTEST_MAIN(tst_QS3EventStreamDecoder)
+
+#include "tst_qs3eventstreamdecoder.moc"
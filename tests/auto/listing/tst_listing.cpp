@@ -0,0 +1,129 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest/QtTest>
+
+#include <QtAmazonS3/QAccount>
+#include <QtAmazonS3/QBucket>
+#include <QtAmazonS3/QS3TreeModel>
+
+#include "mocks3server.h"
+
+class tst_Listing : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void flat();
+    void commonPrefixes();
+    void tree();
+
+private:
+    MockS3Server server;
+    QAccount account;
+};
+
+void tst_Listing::initTestCase()
+{
+    // dir0000/ to dir0002/, the last one half full
+    server.setCredentials("mock", "mock");
+    server.addBucket(QStringLiteral("mock"), 2500, 16);
+    QVERIFY(server.start());
+    account.setAwsAccessKeyId("mock");
+    account.setAwsSecretAccessKey("mock");
+    account.setEndpoint(QUrl(QStringLiteral("http://127.0.0.1:%1/").arg(server.serverPort())));
+}
+
+void tst_Listing::flat()
+{
+    QBucket bucket;
+    bucket.setAccount(&account);
+    bucket.setName(QStringLiteral("mock"));
+    bucket.setPrefix(QStringLiteral("dir0002/"));
+    bucket.load();
+    QTRY_VERIFY_WITH_TIMEOUT(!bucket.loading(), 10000);
+
+    QCOMPARE(bucket.count(), 500);
+    QVERIFY(!bucket.isTruncated());
+    QCOMPARE(bucket.get(0).value(QStringLiteral("key")).toString(), QStringLiteral("dir0002/object00002000"));
+    QCOMPARE(bucket.get(0).value(QStringLiteral("size")).toLongLong(), qint64(16));
+}
+
+void tst_Listing::commonPrefixes()
+{
+    // a page that ends on a common prefix continues after everything below it
+    QBucket bucket;
+    bucket.setAccount(&account);
+    bucket.setName(QStringLiteral("mock"));
+    bucket.setDelimiter(QStringLiteral("/"));
+    bucket.setMaxKeys(2);
+    bucket.load();
+    QTRY_VERIFY_WITH_TIMEOUT(!bucket.loading(), 10000);
+    QCOMPARE(bucket.count(), 2);
+    QVERIFY(bucket.isTruncated());
+
+    bucket.setMarker(bucket.get(1).value(QStringLiteral("key")).toString());
+    bucket.load();
+    QTRY_VERIFY_WITH_TIMEOUT(!bucket.loading(), 10000);
+    QCOMPARE(bucket.count(), 3);
+    QVERIFY(!bucket.isTruncated());
+    QStringList keys;
+    for (int i = 0; i < bucket.count(); i++)
+        keys.append(bucket.get(i).value(QStringLiteral("key")).toString());
+    QCOMPARE(keys, QStringList() << QStringLiteral("dir0000/") << QStringLiteral("dir0001/") << QStringLiteral("dir0002/"));
+}
+
+void tst_Listing::tree()
+{
+    QS3TreeModel model;
+    model.setPageSize(2);
+    model.setAccount(&account);
+    model.setName(QStringLiteral("mock"));
+    QTRY_VERIFY_WITH_TIMEOUT(model.rowCount() == 2 && !model.loading(), 10000);
+
+    // the root is listed a page at a time
+    QVERIFY(model.canFetchMore(QModelIndex()));
+    model.fetchMore(QModelIndex());
+    QTRY_VERIFY_WITH_TIMEOUT(!model.loading(), 10000);
+    QCOMPARE(model.rowCount(), 3);
+    QVERIFY(!model.canFetchMore(QModelIndex()));
+
+    QModelIndex folder = model.index(2, 0);
+    QCOMPARE(model.get(folder).value(QStringLiteral("key")).toString(), QStringLiteral("dir0002/"));
+    QVERIFY(model.get(folder).value(QStringLiteral("folder")).toBool());
+    model.setPageSize(1000);
+    model.fetch(folder);
+    QTRY_VERIFY_WITH_TIMEOUT(!model.loading(), 10000);
+    QCOMPARE(model.rowCount(folder), 500);
+    QCOMPARE(model.get(model.index(0, 0, folder)).value(QStringLiteral("name")).toString(), QStringLiteral("object00002000"));
+    QCOMPARE(model.parent(model.index(0, 0, folder)), folder);
+}
+
+QTEST_MAIN(tst_Listing)
+
+#include "tst_listing.moc"
@@ -0,0 +1,98 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest/QtTest>
+
+#include <QtAmazonS3/QAccount>
+#include <QtAmazonS3/QS3Select>
+
+#include "mocks3server.h"
+
+class tst_QS3Select : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void select();
+    void missing();
+
+private:
+    MockS3Server server;
+    QAccount account;
+};
+
+void tst_QS3Select::initTestCase()
+{
+    server.setCredentials("mock", "mock");
+    server.addBucket(QStringLiteral("mock"), 10, 64);
+    QVERIFY(server.start());
+    account.setAwsAccessKeyId("mock");
+    account.setAwsSecretAccessKey("mock");
+    account.setEndpoint(QUrl(QStringLiteral("http://127.0.0.1:%1/").arg(server.serverPort())));
+}
+
+void tst_QS3Select::select()
+{
+    // the mock answers any expression with the keys of the bucket and their size
+    QS3Select select;
+    select.setAccount(&account);
+    select.setBucket(QStringLiteral("mock"));
+    select.setKey(QStringLiteral("dir0000/object00000000"));
+    select.setExpression(QStringLiteral("SELECT * FROM S3Object"));
+    QSignalSpy error(&select, &QS3Select::error);
+    QSignalSpy failed(&select, &QS3Select::failed);
+    select.load();
+    QVERIFY(select.loading());
+    QTRY_VERIFY_WITH_TIMEOUT(!select.loading(), 10000);
+
+    QCOMPARE(error.count(), 0);
+    QCOMPARE(failed.count(), 0);
+    QCOMPARE(select.count(), 10);
+    QCOMPARE(select.get(0).value(QStringLiteral("record")).toString(), QStringLiteral("dir0000/object00000000,64"));
+    QCOMPARE(select.get(9).value(QStringLiteral("fields")).toStringList(), QStringList() << QStringLiteral("dir0000/object00000009") << QStringLiteral("64"));
+    QCOMPARE(select.bytesScanned(), qint64(64));
+    QVERIFY(select.bytesReturned() > 0);
+}
+
+void tst_QS3Select::missing()
+{
+    QS3Select select;
+    select.setAccount(&account);
+    select.setBucket(QStringLiteral("mock"));
+    select.setKey(QStringLiteral("missing"));
+    select.setExpression(QStringLiteral("SELECT * FROM S3Object"));
+    QSignalSpy failed(&select, &QS3Select::failed);
+    select.load();
+    QTRY_COMPARE_WITH_TIMEOUT(failed.count(), 1, 10000);
+    QCOMPARE(failed.first().first().toInt(), 404);
+    QCOMPARE(select.count(), 0);
+}
+
+QTEST_MAIN(tst_QS3Select)
+
+#include "tst_qs3select.moc"
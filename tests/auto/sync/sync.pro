@@ -0,0 +1,6 @@
+TARGET = tst_qs3sync
+QT = core network testlib amazons3
+
+include(../../shared/mocks3server.pri)
+
+SOURCES += tst_qs3sync.cpp
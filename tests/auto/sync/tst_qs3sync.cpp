@@ -0,0 +1,220 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest/QtTest>
+
+#include <QtAmazonS3/QAccount>
+#include <QtAmazonS3/QS3Sync>
+
+#include "mocks3server.h"
+
+class tst_QS3Sync : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void download();
+    void deleteExtraneous();
+    void listingFailed_data();
+    void listingFailed();
+    void traversal();
+
+private:
+    static QString key(int i);
+    static void write(const QString &fileName, const QByteArray &data, const QDateTime &lastModified);
+
+    MockS3Server server;
+    QAccount account;
+};
+
+QString tst_QS3Sync::key(int i)
+{
+    return QStringLiteral("dir0000/object%1").arg(i, 8, 10, QLatin1Char('0'));
+}
+
+void tst_QS3Sync::write(const QString &fileName, const QByteArray &data, const QDateTime &lastModified)
+{
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::WriteOnly));
+    file.write(data);
+    // written out first, or closing the file would touch it again
+    file.flush();
+    QVERIFY(file.setFileTime(lastModified, QFileDevice::FileModificationTime));
+}
+
+void tst_QS3Sync::initTestCase()
+{
+    server.setCredentials("mock", "mock");
+    server.addBucket(QStringLiteral("mock"), 5, 1000);
+    QVERIFY(server.start());
+    account.setAwsAccessKeyId("mock");
+    account.setAwsSecretAccessKey("mock");
+    account.setEndpoint(QUrl(QStringLiteral("http://127.0.0.1:%1/").arg(server.serverPort())));
+}
+
+void tst_QS3Sync::download()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString prefix = QStringLiteral("dir0000/");
+    QDateTime old(QDate(2015, 1, 1), QTime(12, 0), Qt::UTC);
+
+    // up to date, same size but different bytes, missing, and a file the bucket does not know
+    write(dir.filePath(key(0).mid(prefix.length())), MockS3Server::content(key(0), 1000), old);
+    write(dir.filePath(key(1).mid(prefix.length())), QByteArray(1000, 'x'), old);
+    write(dir.filePath(QStringLiteral("extra")), "extra", old);
+
+    QS3Sync sync;
+    sync.setAccount(&account);
+    sync.setBucket(QStringLiteral("mock"));
+    sync.setPrefix(prefix);
+    sync.setLocalPath(dir.path());
+    sync.setDirection(QS3Sync::Download);
+    QSignalSpy finished(&sync, &QS3Sync::finished);
+    QSignalSpy failed(&sync, &QS3Sync::failed);
+    sync.start();
+    QTRY_COMPARE_WITH_TIMEOUT(finished.count(), 1, 10000);
+    QCOMPARE(failed.count(), 0);
+
+    // the matching ETag left the first file alone
+    QCOMPARE(QFileInfo(dir.filePath(key(0).mid(prefix.length()))).lastModified().toUTC(), old);
+    for (int i = 0; i < 5; i++) {
+        QFile file(dir.filePath(key(i).mid(prefix.length())));
+        QVERIFY2(file.open(QFile::ReadOnly), qPrintable(file.fileName()));
+        QCOMPARE(file.readAll(), MockS3Server::content(key(i), 1000));
+    }
+    QVERIFY(QFile::exists(dir.filePath(QStringLiteral("extra"))));
+}
+
+void tst_QS3Sync::deleteExtraneous()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString prefix = QStringLiteral("dir0000/");
+    QDateTime old(QDate(2015, 1, 1), QTime(12, 0), Qt::UTC);
+    write(dir.filePath(QStringLiteral("extra")), "extra", old);
+
+    QS3Sync sync;
+    sync.setAccount(&account);
+    sync.setBucket(QStringLiteral("mock"));
+    sync.setPrefix(prefix);
+    sync.setLocalPath(dir.path());
+    sync.setDirection(QS3Sync::Download);
+    sync.setDeleteExtraneous(true);
+    QSignalSpy finished(&sync, &QS3Sync::finished);
+    QSignalSpy failed(&sync, &QS3Sync::failed);
+    sync.start();
+    QTRY_COMPARE_WITH_TIMEOUT(finished.count(), 1, 10000);
+    QCOMPARE(failed.count(), 0);
+
+    QVERIFY(!QFile::exists(dir.filePath(QStringLiteral("extra"))));
+    for (int i = 0; i < 5; i++)
+        QVERIFY(QFile::exists(dir.filePath(key(i).mid(prefix.length()))));
+}
+
+void tst_QS3Sync::listingFailed_data()
+{
+    QTest::addColumn<int>("httpStatusCode");
+    QTest::newRow("forbidden") << 403;
+    QTest::newRow("slow down") << 503;
+}
+
+void tst_QS3Sync::listingFailed()
+{
+    QFETCH(int, httpStatusCode);
+
+    // a failure taken for an empty listing would make every file extraneous
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString prefix = QStringLiteral("dir0000/");
+    QDateTime old(QDate(2015, 1, 1), QTime(12, 0), Qt::UTC);
+    write(dir.filePath(key(0).mid(prefix.length())), MockS3Server::content(key(0), 1000), old);
+    write(dir.filePath(QStringLiteral("extra")), "extra", old);
+
+    QAccount forbidden;
+    forbidden.setAwsAccessKeyId("mock");
+    forbidden.setAwsSecretAccessKey("wrong");
+    forbidden.setEndpoint(account.endpoint());
+    if (httpStatusCode == 503)
+        server.setThrottleRate(1);
+
+    QS3Sync sync;
+    sync.setAccount(httpStatusCode == 403 ? &forbidden : &account);
+    sync.setBucket(QStringLiteral("mock"));
+    sync.setPrefix(prefix);
+    sync.setLocalPath(dir.path());
+    sync.setDirection(QS3Sync::Download);
+    sync.setDeleteExtraneous(true);
+    QSignalSpy finished(&sync, &QS3Sync::finished);
+    QSignalSpy failed(&sync, &QS3Sync::failed);
+    sync.start();
+    QTest::qWaitFor([&]() { return finished.count() > 0; }, 10000);
+    server.setThrottleRate(0);
+
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(failed.count(), 1);
+    QCOMPARE(failed.first().at(0).toString(), prefix);
+    QCOMPARE(failed.first().at(1).toInt(), httpStatusCode);
+    QVERIFY(QFile::exists(dir.filePath(key(0).mid(prefix.length()))));
+    QVERIFY(QFile::exists(dir.filePath(QStringLiteral("extra"))));
+}
+
+void tst_QS3Sync::traversal()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString prefix = QStringLiteral("dir0000/");
+    // a sibling of the sync directory, reached through the key
+    QString escaped = QFileInfo(dir.path()).fileName() + QStringLiteral("-escaped");
+    QString traversal = prefix + QStringLiteral("../") + escaped;
+    server.addBucket(QStringLiteral("traversal"), 2, 1000);
+    server.addKey(QStringLiteral("traversal"), traversal);
+
+    QS3Sync sync;
+    sync.setAccount(&account);
+    sync.setBucket(QStringLiteral("traversal"));
+    sync.setPrefix(prefix);
+    sync.setLocalPath(dir.path());
+    sync.setDirection(QS3Sync::Download);
+    sync.setDeleteExtraneous(true);
+    QSignalSpy finished(&sync, &QS3Sync::finished);
+    QSignalSpy failed(&sync, &QS3Sync::failed);
+    sync.start();
+    QTRY_COMPARE_WITH_TIMEOUT(finished.count(), 1, 10000);
+
+    QCOMPARE(failed.count(), 1);
+    QCOMPARE(failed.first().at(0).toString(), traversal);
+    QCOMPARE(failed.first().at(1).toInt(), 0);
+    QVERIFY(!QFile::exists(QDir(dir.path()).absoluteFilePath(QStringLiteral("../") + escaped)));
+    QVERIFY(QFile::exists(dir.filePath(key(0).mid(prefix.length()))));
+    QVERIFY(QFile::exists(dir.filePath(key(1).mid(prefix.length()))));
+}
+
+QTEST_MAIN(tst_QS3Sync)
+
+#include "tst_qs3sync.moc"
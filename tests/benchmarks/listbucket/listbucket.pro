@@ -0,0 +1,4 @@
+TARGET = tst_bench_listbucket
+QT = core network testlib amazons3
+
+SOURCES = tst_bench_listbucket.cpp
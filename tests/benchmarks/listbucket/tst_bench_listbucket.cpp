@@ -0,0 +1,114 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest/QtTest>
+#include <QtCore/QBuffer>
+
+#include <QtAmazonS3/QBucket>
+
+class Bucket : public QBucket
+{
+public:
+    void parse(QIODevice *io) { finished(io); }
+};
+
+class tst_Bench_ListBucket : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void parse_data();
+    void parse();
+
+private:
+    static QByteArray listBucketResult(int keys, int prefixes);
+
+    QHash<int, QByteArray> fixtures;
+};
+
+QByteArray tst_Bench_ListBucket::listBucketResult(int keys, int prefixes)
+{
+    // shaped like a real response, keys vary in length and depth like a photo library
+    QByteArray ret;
+    ret.reserve(keys * 400);
+    ret.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    ret.append("<ListBucketResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">");
+    ret.append("<Name>examplebucket</Name><Prefix></Prefix><Marker></Marker>");
+    ret.append("<MaxKeys>").append(QByteArray::number(keys)).append("</MaxKeys><Delimiter>/</Delimiter><IsTruncated>false</IsTruncated>");
+    for (int i = 0; i < keys; i++) {
+        ret.append("<Contents><Key>photos/");
+        ret.append(QByteArray::number(2000 + i % 20)).append('/');
+        ret.append(QByteArray::number(i % 12 + 1)).append("/IMG_");
+        ret.append(QByteArray::number(i).rightJustified(8, '0')).append(".jpg</Key>");
+        ret.append("<LastModified>2015-06-");
+        ret.append(QByteArray::number(i % 28 + 1).rightJustified(2, '0'));
+        ret.append("T12:34:56.000Z</LastModified>");
+        ret.append("<ETag>&quot;").append(QCryptographicHash::hash(QByteArray::number(i), QCryptographicHash::Md5).toHex()).append("&quot;</ETag>");
+        ret.append("<Size>").append(QByteArray::number(qint64(i) * 7919 % 10000000)).append("</Size>");
+        ret.append("<Owner><ID>75aa57f09aa0c8caeab4f8c24e99d10f8e7faeebf76c078efc7c6caea54ba06a</ID><DisplayName>owner</DisplayName></Owner>");
+        ret.append("<StorageClass>STANDARD</StorageClass></Contents>");
+    }
+    for (int i = 0; i < prefixes; i++)
+        ret.append("<CommonPrefixes><Prefix>album").append(QByteArray::number(i)).append("/</Prefix></CommonPrefixes>");
+    ret.append("</ListBucketResult>");
+    return ret;
+}
+
+void tst_Bench_ListBucket::initTestCase()
+{
+    fixtures.insert(1000, listBucketResult(1000, 10));
+    fixtures.insert(100000, listBucketResult(100000, 1000));
+}
+
+void tst_Bench_ListBucket::parse_data()
+{
+    QTest::addColumn<int>("keys");
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("100k") << 100000;
+}
+
+void tst_Bench_ListBucket::parse()
+{
+    QFETCH(int, keys);
+    QByteArray xml = fixtures.value(keys);
+
+    // the model is part of the cost, QBucket::finished() parses straight into it
+    int count = 0;
+    QBENCHMARK {
+        Bucket bucket;
+        QBuffer buffer(&xml);
+        buffer.open(QIODevice::ReadOnly);
+        bucket.parse(&buffer);
+        count = bucket.count();
+    }
+    QCOMPARE(count, keys + keys / 100);
+}
+
+QTEST_MAIN(tst_Bench_ListBucket)
+
+#include "tst_bench_listbucket.moc"
@@ -0,0 +1,4 @@
+TARGET = tst_bench_model
+QT = core network testlib amazons3
+
+SOURCES = tst_bench_model.cpp
@@ -0,0 +1,247 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest/QtTest>
+
+#include <QtAmazonS3/QBucket>
+#include <QtAmazonS3/QS3SearchModel>
+#include <QtAmazonS3/QS3SortFilterProxyModel>
+
+class Model : public QBucket
+{
+public:
+    using QBucket::append;
+    using QBucket::clear;
+};
+
+class tst_Bench_Model : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void append_data();
+    void append();
+    void data_data();
+    void data();
+    void get();
+    void roleNames();
+    void roleLookup();
+    void sort_data();
+    void sort();
+    void filter_data();
+    void filter();
+    void search_data();
+    void search();
+    void searchAppend();
+
+private:
+    QList<QVariantMap> rows;
+};
+
+void tst_Bench_Model::initTestCase()
+{
+    for (int i = 0; i < 100000; i++) {
+        QVariantMap row;
+        row.insert(QStringLiteral("key"), QStringLiteral("photos/%1/IMG_%2.jpg").arg(2000 + i % 20).arg(i, 8, 10, QLatin1Char('0')));
+        row.insert(QStringLiteral("lastModified"), QDateTime(QDate(2015, 6, i % 28 + 1), QTime(12, 34, 56), Qt::UTC));
+        row.insert(QStringLiteral("eTag"), QString::fromLatin1(QCryptographicHash::hash(QByteArray::number(i), QCryptographicHash::Md5).toHex()));
+        row.insert(QStringLiteral("size"), qint64(i) * 7919 % 10000000);
+        row.insert(QStringLiteral("storageClass"), QStringLiteral("STANDARD"));
+        rows.append(row);
+    }
+}
+
+void tst_Bench_Model::append_data()
+{
+    // one page of a listing, and a whole huge bucket appended a page at a time
+    QTest::addColumn<int>("total");
+    QTest::addColumn<int>("batch");
+    QTest::newRow("1k") << 1000 << 1000;
+    QTest::newRow("100k") << 100000 << 1000;
+}
+
+void tst_Bench_Model::append()
+{
+    QFETCH(int, total);
+    QFETCH(int, batch);
+
+    QList<QList<QVariantMap> > batches;
+    for (int i = 0; i < total; i += batch)
+        batches.append(rows.mid(i, batch));
+
+    QBENCHMARK {
+        Model model;
+        foreach (const QList<QVariantMap> &rows, batches)
+            model.append(rows);
+    }
+}
+
+void tst_Bench_Model::data_data()
+{
+    QTest::addColumn<QByteArray>("role");
+    QTest::newRow("key") << QByteArray("key");
+    QTest::newRow("size") << QByteArray("size");
+    QTest::newRow("lastModified") << QByteArray("lastModified");
+}
+
+void tst_Bench_Model::data()
+{
+    QFETCH(QByteArray, role);
+
+    Model model;
+    model.append(rows);
+    int r = model.roleNames().key(role);
+    QBENCHMARK {
+        for (int i = 0; i < model.rowCount(QModelIndex()); i++)
+            model.data(model.index(i), r);
+    }
+}
+
+void tst_Bench_Model::get()
+{
+    Model model;
+    model.append(rows);
+    QBENCHMARK {
+        for (int i = 0; i < model.count(); i++)
+            model.get(i);
+    }
+}
+
+void tst_Bench_Model::roleNames()
+{
+    Model model;
+    QBENCHMARK {
+        model.roleNames();
+    }
+}
+
+void tst_Bench_Model::roleLookup()
+{
+    // what a delegate binding costs on top of data()
+    Model model;
+    QBENCHMARK {
+        model.roleNames().key("lastModified");
+    }
+}
+
+void tst_Bench_Model::sort_data()
+{
+    QTest::addColumn<QString>("role");
+    QTest::newRow("size") << QStringLiteral("size");
+    QTest::newRow("lastModified") << QStringLiteral("lastModified");
+    QTest::newRow("key") << QStringLiteral("key");
+}
+
+void tst_Bench_Model::sort()
+{
+    QFETCH(QString, role);
+
+    Model model;
+    model.append(rows);
+    QS3SortFilterProxyModel proxy;
+    proxy.setSourceModel(&model);
+    QBENCHMARK {
+        proxy.setSortBy(QString());
+        proxy.setSortBy(role);
+    }
+    QCOMPARE(proxy.count(), rows.count());
+}
+
+void tst_Bench_Model::filter_data()
+{
+    QTest::addColumn<int>("syntax");
+    QTest::addColumn<QString>("pattern");
+    QTest::newRow("fixed") << int(QS3SortFilterProxyModel::FixedString) << QStringLiteral("IMG_0001");
+    QTest::newRow("wildcard") << int(QS3SortFilterProxyModel::Wildcard) << QStringLiteral("2007/*_0001?");
+    QTest::newRow("regexp") << int(QS3SortFilterProxyModel::RegularExpression) << QStringLiteral("20(0|1)7/IMG_0001\\d");
+}
+
+void tst_Bench_Model::filter()
+{
+    QFETCH(int, syntax);
+    QFETCH(QString, pattern);
+
+    Model model;
+    model.append(rows);
+    QS3SortFilterProxyModel proxy;
+    proxy.setSourceModel(&model);
+    proxy.setFilterBy(QStringLiteral("key"));
+    proxy.setFilterSyntax(static_cast<QS3SortFilterProxyModel::FilterSyntax>(syntax));
+    QBENCHMARK {
+        proxy.setFilterPattern(QString());
+        proxy.setFilterPattern(pattern);
+    }
+}
+
+void tst_Bench_Model::search_data()
+{
+    // a substring and a glob query, and one too short for the trigram index
+    QTest::addColumn<int>("syntax");
+    QTest::addColumn<QString>("query");
+    QTest::newRow("substring") << int(QS3SearchModel::Substring) << QStringLiteral("IMG_0001");
+    QTest::newRow("wildcard") << int(QS3SearchModel::Wildcard) << QStringLiteral("*2007/*_0001?*");
+    QTest::newRow("short") << int(QS3SearchModel::Substring) << QStringLiteral("7/");
+}
+
+void tst_Bench_Model::search()
+{
+    QFETCH(int, syntax);
+    QFETCH(QString, query);
+
+    Model model;
+    model.append(rows);
+    QS3SearchModel search;
+    search.setSourceModel(&model);
+    search.setSyntax(static_cast<QS3SearchModel::Syntax>(syntax));
+    QBENCHMARK {
+        search.setQuery(QString());
+        search.setQuery(query);
+    }
+}
+
+void tst_Bench_Model::searchAppend()
+{
+    // indexing while a listing streams in under a live query
+    QList<QList<QVariantMap> > batches;
+    for (int i = 0; i < rows.count(); i += 1000)
+        batches.append(rows.mid(i, 1000));
+
+    QBENCHMARK {
+        Model model;
+        QS3SearchModel search;
+        search.setSourceModel(&model);
+        search.setQuery(QStringLiteral("IMG_0001"));
+        foreach (const QList<QVariantMap> &rows, batches)
+            model.append(rows);
+        QCOMPARE(search.count(), 10000);
+    }
+}
+
+QTEST_MAIN(tst_Bench_Model)
+
+#include "tst_bench_model.moc"
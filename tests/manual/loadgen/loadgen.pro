@@ -0,0 +1,7 @@
+TARGET = loadgen
+QT = core network amazons3
+CONFIG += console
+
+include(../../shared/mocks3server.pri)
+
+SOURCES += main.cpp
@@ -0,0 +1,254 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMap>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtNetwork/QNetworkReply>
+
+#include <QtAmazonS3/QAccount>
+#include <QtAmazonS3/QS3Metrics>
+#include <QtAmazonS3/QS3NetworkAccessManager>
+
+#include "mocks3server.h"
+
+#include <algorithm>
+#include <functional>
+#include <random>
+
+struct Statistics {
+    Statistics() : issued(0), completed(0), failed(0), skipped(0), redirects(0), bytes(0) {}
+
+    qint64 issued;
+    qint64 completed;
+    qint64 failed;
+    qint64 skipped;
+    qint64 redirects;
+    qint64 bytes;
+    QVector<double> latencies;
+    QMap<int, qint64> statuses;
+};
+
+static double percentile(const QVector<double> &sorted, double p)
+{
+    if (sorted.isEmpty()) return 0;
+    return sorted.at(qMin(sorted.count() - 1, static_cast<int>(p * sorted.count())));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Drives QtAmazonS3 at a fixed request rate and reports throughput and latency."));
+    parser.addHelpOption();
+    QCommandLineOption endpoint(QStringLiteral("endpoint"), QStringLiteral("S3 compatible endpoint, an in-process mock is started when omitted."), QStringLiteral("url"));
+    QCommandLineOption accessKey(QStringLiteral("access-key"), QStringLiteral("Access key id."), QStringLiteral("id"), QStringLiteral("mock"));
+    QCommandLineOption secretKey(QStringLiteral("secret-key"), QStringLiteral("Secret access key."), QStringLiteral("secret"), QStringLiteral("mock"));
+    QCommandLineOption bucket(QStringLiteral("bucket"), QStringLiteral("Bucket to load."), QStringLiteral("name"), QStringLiteral("mock"));
+    QCommandLineOption keys(QStringLiteral("keys"), QStringLiteral("Number of keys in the bucket, as the mock names them."), QStringLiteral("count"), QStringLiteral("10000"));
+    QCommandLineOption objectSize(QStringLiteral("object-size"), QStringLiteral("Object size of the in-process mock."), QStringLiteral("bytes"), QStringLiteral("16384"));
+    QCommandLineOption operation(QStringLiteral("operation"), QStringLiteral("get, head, list or mixed."), QStringLiteral("operation"), QStringLiteral("mixed"));
+    QCommandLineOption rate(QStringLiteral("rate"), QStringLiteral("Target requests per second."), QStringLiteral("rate"), QStringLiteral("200"));
+    QCommandLineOption duration(QStringLiteral("duration"), QStringLiteral("Seconds to issue requests for."), QStringLiteral("secs"), QStringLiteral("10"));
+    QCommandLineOption maxInFlight(QStringLiteral("max-in-flight"), QStringLiteral("Requests outstanding before new ones are skipped."), QStringLiteral("count"), QStringLiteral("1000"));
+    QCommandLineOption latency(QStringLiteral("latency"), QStringLiteral("Latency the in-process mock adds, in milliseconds."), QStringLiteral("msecs"), QStringLiteral("20"));
+    QCommandLineOption jitter(QStringLiteral("jitter"), QStringLiteral("Random extra latency of the in-process mock."), QStringLiteral("msecs"), QStringLiteral("10"));
+    QCommandLineOption redirects(QStringLiteral("redirect-rate"), QStringLiteral("Fraction of 307s from the in-process mock."), QStringLiteral("rate"), QStringLiteral("0"));
+    QCommandLineOption throttle(QStringLiteral("throttle-rate"), QStringLiteral("Fraction of 503s from the in-process mock."), QStringLiteral("rate"), QStringLiteral("0"));
+    QCommandLineOption metrics(QStringLiteral("metrics"), QStringLiteral("Write the library metrics in Prometheus format to this file."), QStringLiteral("file"));
+    parser.addOptions(QList<QCommandLineOption>() << endpoint << accessKey << secretKey << bucket << keys << objectSize << operation
+                      << rate << duration << maxInFlight << latency << jitter << redirects << throttle << metrics);
+    parser.process(app);
+
+    QTextStream out(stdout);
+
+    // the mock gets its own thread, so that serving does not compete with the client's event loop
+    QThread serverThread;
+    QUrl url(parser.value(endpoint));
+    if (url.isEmpty()) {
+        MockS3Server *server = new MockS3Server;
+        server->setCredentials(parser.value(accessKey).toLatin1(), parser.value(secretKey).toLatin1());
+        server->addBucket(parser.value(bucket), parser.value(keys).toInt(), parser.value(objectSize).toLongLong());
+        server->setLatency(parser.value(latency).toInt(), parser.value(jitter).toInt());
+        server->setRedirectRate(parser.value(redirects).toDouble());
+        server->setThrottleRate(parser.value(throttle).toDouble());
+        server->moveToThread(&serverThread);
+        QObject::connect(&serverThread, &QThread::finished, server, &QObject::deleteLater);
+        serverThread.start();
+        bool listening = false;
+        QMetaObject::invokeMethod(server, "start", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, listening), Q_ARG(quint16, 0));
+        if (!listening) {
+            out << "mock server failed to listen" << endl;
+            return 1;
+        }
+        url = QUrl(QStringLiteral("http://127.0.0.1:%1/").arg(server->serverPort()));
+    }
+
+    QAccount account;
+    account.setAwsAccessKeyId(parser.value(accessKey).toLatin1());
+    account.setAwsSecretAccessKey(parser.value(secretKey).toLatin1());
+    account.setEndpoint(url);
+
+    QString name = parser.value(bucket);
+    int keyCount = qMax(1, parser.value(keys).toInt());
+    QString mode = parser.value(operation);
+    double targetRate = parser.value(rate).toDouble();
+    qint64 runFor = parser.value(duration).toLongLong() * 1000;
+    int inFlightLimit = parser.value(maxInFlight).toInt();
+
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> pickKey(0, keyCount - 1);
+    std::uniform_int_distribution<int> pickOperation(0, 9);
+
+    Statistics statistics;
+    int inFlight = 0;
+    QElapsedTimer clock;
+    QS3NetworkAccessManager &networkAccessManager = QS3NetworkAccessManager::instance();
+
+    std::function<void(QNetworkRequest, QNetworkAccessManager::Operation, qint64)> send;
+    send = [&](QNetworkRequest request, QNetworkAccessManager::Operation op, qint64 started) {
+        QNetworkReply *reply = networkAccessManager.send(&account, request, op);
+        QObject::connect(reply, &QNetworkReply::readyRead, [&statistics, reply]() {
+            statistics.bytes += reply->readAll().size();
+        });
+        QObject::connect(reply, &QNetworkReply::finished, [&, reply, request, op, started]() {
+            reply->deleteLater();
+            statistics.bytes += reply->readAll().size();
+            int httpStatusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            if (httpStatusCode == 307) {
+                statistics.redirects++;
+                QS3Metrics::instance().increment(QS3Metrics::Redirects);
+                QNetworkRequest redirected(request);
+                redirected.setUrl(reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl());
+                send(redirected, op, started);
+                return;
+            }
+            inFlight--;
+            statistics.completed++;
+            statistics.statuses[httpStatusCode]++;
+            if (httpStatusCode < 200 || httpStatusCode >= 300)
+                statistics.failed++;
+            statistics.latencies.append((clock.nsecsElapsed() - started) / 1000000.0);
+        });
+    };
+
+    auto issue = [&]() {
+        int which = mode == QStringLiteral("get") ? 0 : mode == QStringLiteral("head") ? 1 : mode == QStringLiteral("list") ? 2 : -1;
+        if (which < 0) {
+            // mixed: mostly object reads, some metadata, a few listings
+            int dice = pickOperation(random);
+            which = dice < 6 ? 0 : dice < 9 ? 1 : 2;
+        }
+        int i = pickKey(random);
+        QString key = QStringLiteral("dir%1/object%2").arg(i / 1000, 4, 10, QLatin1Char('0')).arg(i, 8, 10, QLatin1Char('0'));
+        QNetworkRequest request;
+        QNetworkAccessManager::Operation op = QNetworkAccessManager::GetOperation;
+        switch (which) {
+        case 0:
+            request.setUrl(account.url(name, key));
+            break;
+        case 1:
+            request.setUrl(account.url(name, key));
+            op = QNetworkAccessManager::HeadOperation;
+            break;
+        default: {
+            QUrl listing = account.url(name);
+            listing.setQuery(QStringLiteral("delimiter=/&prefix=dir%1/").arg(i / 1000, 4, 10, QLatin1Char('0')));
+            request.setUrl(listing);
+            break; }
+        }
+        inFlight++;
+        statistics.issued++;
+        send(request, op, clock.nsecsElapsed());
+    };
+
+    // open loop, requests go out on schedule whether or not earlier ones came back
+    QTimer ticker;
+    ticker.setTimerType(Qt::PreciseTimer);
+    ticker.setInterval(1);
+    qint64 scheduled = 0;
+    QObject::connect(&ticker, &QTimer::timeout, [&]() {
+        qint64 elapsed = clock.elapsed();
+        if (elapsed >= runFor) {
+            ticker.stop();
+            if (inFlight == 0)
+                app.quit();
+            return;
+        }
+        qint64 due = static_cast<qint64>(elapsed * targetRate / 1000);
+        for (; scheduled < due; scheduled++) {
+            if (inFlight >= inFlightLimit)
+                statistics.skipped++;
+            else
+                issue();
+        }
+    });
+    QTimer drained;
+    drained.setInterval(10);
+    QObject::connect(&drained, &QTimer::timeout, [&]() {
+        if (!ticker.isActive() && (inFlight == 0 || clock.elapsed() > runFor + 30000))
+            app.quit();
+    });
+
+    clock.start();
+    ticker.start();
+    drained.start();
+    app.exec();
+    qint64 elapsed = clock.elapsed();
+
+    std::sort(statistics.latencies.begin(), statistics.latencies.end());
+    double seconds = qMax<qint64>(1, qMin(elapsed, runFor)) / 1000.0;
+    out.setRealNumberPrecision(2);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out << "endpoint    " << url.toString() << endl;
+    out << "requests    " << statistics.issued << " issued, " << statistics.completed << " completed, "
+        << statistics.failed << " failed, " << statistics.skipped << " skipped, " << inFlight << " unfinished" << endl;
+    out << "throughput  " << statistics.completed / seconds << " req/s of " << targetRate << " targeted, "
+        << statistics.bytes / seconds / 1024 / 1024 << " MiB/s" << endl;
+    out << "latency ms  p50 " << percentile(statistics.latencies, 0.5)
+        << "  p90 " << percentile(statistics.latencies, 0.9)
+        << "  p99 " << percentile(statistics.latencies, 0.99)
+        << "  p99.9 " << percentile(statistics.latencies, 0.999)
+        << "  max " << (statistics.latencies.isEmpty() ? 0 : statistics.latencies.last()) << endl;
+    out << "redirects   " << statistics.redirects << endl;
+    out << "statuses   ";
+    for (QMap<int, qint64>::const_iterator i = statistics.statuses.constBegin(); i != statistics.statuses.constEnd(); ++i)
+        out << ' ' << i.key() << ": " << i.value();
+    out << endl;
+
+    if (parser.isSet(metrics))
+        QS3Metrics::instance().dump(parser.value(metrics));
+
+    serverThread.quit();
+    serverThread.wait();
+    return 0;
+}
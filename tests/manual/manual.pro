@@ -0,0 +1,4 @@
+TEMPLATE = subdirs
+SUBDIRS = \
+    mocks3 \
+    loadgen
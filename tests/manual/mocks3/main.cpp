@@ -0,0 +1,71 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTextStream>
+
+#include "mocks3server.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("S3 stand-in for QtAmazonS3, point QAccount::endpoint at it."));
+    parser.addHelpOption();
+    QCommandLineOption port(QStringLiteral("port"), QStringLiteral("Port to listen on."), QStringLiteral("port"), QStringLiteral("9000"));
+    QCommandLineOption bucket(QStringLiteral("bucket"), QStringLiteral("Synthetic bucket as name:keys[:objectSize], repeatable."), QStringLiteral("bucket"));
+    QCommandLineOption accessKey(QStringLiteral("access-key"), QStringLiteral("Access key id, signatures are checked when set."), QStringLiteral("id"));
+    QCommandLineOption secretKey(QStringLiteral("secret-key"), QStringLiteral("Secret access key."), QStringLiteral("secret"));
+    QCommandLineOption latency(QStringLiteral("latency"), QStringLiteral("Added latency in milliseconds."), QStringLiteral("msecs"), QStringLiteral("0"));
+    QCommandLineOption jitter(QStringLiteral("jitter"), QStringLiteral("Random extra latency up to this many milliseconds."), QStringLiteral("msecs"), QStringLiteral("0"));
+    QCommandLineOption redirects(QStringLiteral("redirect-rate"), QStringLiteral("Fraction of requests answered with 307."), QStringLiteral("rate"), QStringLiteral("0"));
+    QCommandLineOption throttle(QStringLiteral("throttle-rate"), QStringLiteral("Fraction of requests answered with 503 SlowDown."), QStringLiteral("rate"), QStringLiteral("0"));
+    parser.addOptions(QList<QCommandLineOption>() << port << bucket << accessKey << secretKey << latency << jitter << redirects << throttle);
+    parser.process(app);
+
+    MockS3Server server;
+    server.setCredentials(parser.value(accessKey).toLatin1(), parser.value(secretKey).toLatin1());
+    server.setLatency(parser.value(latency).toInt(), parser.value(jitter).toInt());
+    server.setRedirectRate(parser.value(redirects).toDouble());
+    server.setThrottleRate(parser.value(throttle).toDouble());
+    QStringList buckets = parser.values(bucket);
+    if (buckets.isEmpty())
+        buckets.append(QStringLiteral("mock:10000"));
+    foreach (const QString &spec, buckets) {
+        QStringList fields = spec.split(QLatin1Char(':'));
+        server.addBucket(fields.value(0), fields.value(1, QStringLiteral("1000")).toInt(), fields.value(2, QStringLiteral("1024")).toLongLong());
+    }
+
+    QTextStream out(stdout);
+    if (!server.start(parser.value(port).toUShort())) {
+        out << server.errorString() << endl;
+        return 1;
+    }
+    out << "listening on http://127.0.0.1:" << server.serverPort() << "/" << endl;
+    return app.exec();
+}
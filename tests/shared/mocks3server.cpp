@@ -0,0 +1,478 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mocks3server.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QMessageAuthenticationCode>
+#include <QtCore/QTimer>
+#include <QtCore/QUrlQuery>
+#include <QtCore/QXmlStreamWriter>
+#include <QtNetwork/QTcpSocket>
+
+#include <QtAmazonS3/QS3EventStreamDecoder>
+#include <QtAmazonS3/QS3NetworkAccessManager>
+
+#include <algorithm>
+
+static const char *lastModified = "2015-06-01T12:00:00.000Z";
+
+MockS3Server::MockS3Server(QObject *parent)
+    : QTcpServer(parent)
+    , latency(0)
+    , jitter(0)
+    , redirectRate(0)
+    , throttleRate(0)
+    , random(0)
+{
+}
+
+void MockS3Server::setCredentials(const QByteArray &awsAccessKeyId, const QByteArray &awsSecretAccessKey)
+{
+    this->awsAccessKeyId = awsAccessKeyId;
+    this->awsSecretAccessKey = awsSecretAccessKey;
+}
+
+void MockS3Server::addBucket(const QString &name, int keys, qint64 objectSize)
+{
+    // zero padded, so that the listing order is the generation order
+    Bucket bucket;
+    bucket.objectSize = objectSize;
+    bucket.keys.reserve(keys);
+    for (int i = 0; i < keys; i++)
+        bucket.keys.append(QStringLiteral("dir%1/object%2").arg(i / 1000, 4, 10, QLatin1Char('0')).arg(i, 8, 10, QLatin1Char('0')));
+    buckets.insert(name, bucket);
+}
+
+void MockS3Server::addKey(const QString &bucket, const QString &key)
+{
+    QStringList &keys = buckets[bucket].keys;
+    QStringList::iterator i = std::lower_bound(keys.begin(), keys.end(), key);
+    if (i == keys.end() || *i != key)
+        keys.insert(i, key);
+}
+
+void MockS3Server::setLatency(int msecs, int jitter)
+{
+    latency = msecs;
+    this->jitter = jitter;
+}
+
+void MockS3Server::setRedirectRate(double rate)
+{
+    redirectRate = rate;
+}
+
+void MockS3Server::setThrottleRate(double rate)
+{
+    throttleRate = rate;
+}
+
+void MockS3Server::setSeed(quint32 seed)
+{
+    random.seed(seed);
+}
+
+bool MockS3Server::start(quint16 port)
+{
+    return listen(QHostAddress::LocalHost, port);
+}
+
+QByteArray MockS3Server::content(const QString &key, qint64 size)
+{
+    QByteArray line = key.toUtf8() + '\n';
+    QByteArray ret;
+    ret.reserve(size);
+    while (ret.size() < size)
+        ret.append(line);
+    ret.truncate(size);
+    return ret;
+}
+
+QByteArray MockS3Server::eTag(const QString &key, qint64 size) const
+{
+    // the MD5 of the content, like S3's for single part uploads, keyed by size as every bucket names its keys alike
+    QByteArray &ret = eTags[key + QLatin1Char('\n') + QString::number(size)];
+    if (ret.isEmpty())
+        ret = '"' + QCryptographicHash::hash(content(key, size), QCryptographicHash::Md5).toHex() + '"';
+    return ret;
+}
+
+void MockS3Server::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    socket->setSocketDescriptor(socketDescriptor);
+    connect(socket, &QTcpSocket::readyRead, [this, socket]() { readRequest(socket); });
+    connect(socket, &QTcpSocket::disconnected, [this, socket]() {
+        buffers.remove(socket);
+        socket->deleteLater();
+    });
+}
+
+void MockS3Server::readRequest(QTcpSocket *socket)
+{
+    QByteArray &buffer = buffers[socket];
+    buffer.append(socket->readAll());
+    forever {
+        int end = buffer.indexOf("\r\n\r\n");
+        if (end < 0) return;
+
+        Request request;
+        QList<QByteArray> lines = buffer.left(end).split('\n');
+        QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+        if (requestLine.count() < 2) {
+            socket->disconnectFromHost();
+            return;
+        }
+        request.method = requestLine.at(0);
+        request.target = requestLine.at(1);
+        foreach (const QByteArray &line, lines) {
+            int colon = line.indexOf(':');
+            if (colon > 0)
+                request.headers.insert(line.left(colon).trimmed().toLower(), line.mid(colon + 1).trimmed());
+        }
+        int length = request.headers.value("content-length").toInt();
+        if (buffer.size() < end + 4 + length) return;
+        request.body = buffer.mid(end + 4, length);
+        buffer.remove(0, end + 4 + length);
+
+        Response response = handle(request);
+        int delay = latency + (jitter > 0 ? std::uniform_int_distribution<int>(0, jitter)(random) : 0);
+        if (delay > 0)
+            QTimer::singleShot(delay, socket, [socket, request, response]() { write(socket, request, response); });
+        else
+            write(socket, request, response);
+    }
+}
+
+MockS3Server::Response MockS3Server::handle(const Request &request)
+{
+    QUrl url = QUrl::fromEncoded("http://" + request.headers.value("host", "localhost") + request.target);
+    QUrlQuery query(url);
+
+    if (!authorized(request, url))
+        return error(403, "SignatureDoesNotMatch", "The request signature we calculated does not match the signature you provided.");
+
+    std::uniform_real_distribution<double> chance(0, 1);
+    if (throttleRate > 0 && chance(random) < throttleRate)
+        return error(503, "SlowDown", "Please reduce your request rate.");
+    if (redirectRate > 0 && !query.hasQueryItem(QStringLiteral("x-mock-redirected")) && chance(random) < redirectRate) {
+        // somewhere the signature is still valid, the marker keeps it from bouncing forever
+        QUrl location(url);
+        QUrlQuery redirected(query);
+        redirected.addQueryItem(QStringLiteral("x-mock-redirected"), QStringLiteral("1"));
+        location.setQuery(redirected);
+        Response response = error(307, "TemporaryRedirect", "Please re-send this request to the specified temporary endpoint.");
+        response.headers.append(qMakePair(QByteArray("Location"), location.toEncoded()));
+        return response;
+    }
+
+    QString path = url.path();
+    QString bucket = path.section(QLatin1Char('/'), 1, 1);
+    QString key = path.section(QLatin1Char('/'), 2);
+
+    if (bucket.isEmpty()) {
+        if (request.method != "GET")
+            return error(405, "MethodNotAllowed", "The specified method is not allowed against this resource.");
+        Response response;
+        QXmlStreamWriter xml(&response.body);
+        xml.writeStartDocument();
+        xml.writeStartElement(QStringLiteral("ListAllMyBucketsResult"));
+        xml.writeDefaultNamespace(QStringLiteral("http://s3.amazonaws.com/doc/2006-03-01/"));
+        xml.writeStartElement(QStringLiteral("Owner"));
+        xml.writeTextElement(QStringLiteral("ID"), QString::fromLatin1(awsAccessKeyId));
+        xml.writeTextElement(QStringLiteral("DisplayName"), QStringLiteral("mock"));
+        xml.writeEndElement();
+        xml.writeStartElement(QStringLiteral("Buckets"));
+        QStringList names = buckets.keys();
+        names.sort();
+        foreach (const QString &name, names) {
+            xml.writeStartElement(QStringLiteral("Bucket"));
+            xml.writeTextElement(QStringLiteral("Name"), name);
+            xml.writeTextElement(QStringLiteral("CreationDate"), QString::fromLatin1(lastModified));
+            xml.writeEndElement();
+        }
+        xml.writeEndElement();
+        xml.writeEndElement();
+        xml.writeEndDocument();
+        response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("application/xml")));
+        return response;
+    }
+
+    if (!buckets.contains(bucket))
+        return error(404, "NoSuchBucket", "The specified bucket does not exist.");
+    if (key.isEmpty()) {
+        if (request.method == "GET")
+            return list(bucket, url);
+        return error(405, "MethodNotAllowed", "The specified method is not allowed against this resource.");
+    }
+    if (request.method == "POST" && query.hasQueryItem(QStringLiteral("select")))
+        return select(bucket, key);
+    return object(request, bucket, key);
+}
+
+bool MockS3Server::authorized(const Request &request, const QUrl &url) const
+{
+    if (awsAccessKeyId.isEmpty()) return true;
+
+    QUrlQuery query(url);
+    QByteArray date = request.headers.value("date");
+    QByteArray id;
+    QByteArray signature;
+    if (query.hasQueryItem(QStringLiteral("Signature"))) {
+        // presigned, the expiry stands in for the date
+        date = query.queryItemValue(QStringLiteral("Expires")).toLatin1();
+        if (date.toLongLong() < QDateTime::currentMSecsSinceEpoch() / 1000) return false;
+        id = query.queryItemValue(QStringLiteral("AWSAccessKeyId"), QUrl::FullyDecoded).toLatin1();
+        signature = query.queryItemValue(QStringLiteral("Signature"), QUrl::FullyDecoded).toLatin1();
+    } else {
+        QByteArray authorization = request.headers.value("authorization");
+        if (!authorization.startsWith("AWS ")) return false;
+        int colon = authorization.indexOf(':');
+        id = authorization.mid(4, colon - 4);
+        signature = authorization.mid(colon + 1);
+    }
+    if (id != awsAccessKeyId) return false;
+
+    QMap<QByteArray, QByteArray> amzHeaders;
+    for (QHash<QByteArray, QByteArray>::const_iterator i = request.headers.constBegin(); i != request.headers.constEnd(); ++i) {
+        if (i.key().startsWith("x-amz-"))
+            amzHeaders.insert(i.key(), i.value());
+    }
+    QByteArray stringToSign = request.method + '\n'
+            + request.headers.value("content-md5") + '\n'
+            + request.headers.value("content-type") + '\n'
+            + date + '\n';
+    for (QMap<QByteArray, QByteArray>::const_iterator i = amzHeaders.constBegin(); i != amzHeaders.constEnd(); ++i)
+        stringToSign.append(i.key() + ':' + i.value() + '\n');
+    stringToSign.append(QS3NetworkAccessManager::canonicalizedResource(url));
+
+    return QMessageAuthenticationCode::hash(stringToSign, awsSecretAccessKey, QCryptographicHash::Sha1).toBase64() == signature;
+}
+
+MockS3Server::Response MockS3Server::list(const QString &name, const QUrl &url) const
+{
+    const Bucket &bucket = buckets[name];
+    QUrlQuery query(url);
+    QString prefix = query.queryItemValue(QStringLiteral("prefix"), QUrl::FullyDecoded);
+    QString marker = query.queryItemValue(QStringLiteral("marker"), QUrl::FullyDecoded);
+    QString delimiter = query.queryItemValue(QStringLiteral("delimiter"), QUrl::FullyDecoded);
+    int maxKeys = 1000;
+    if (query.hasQueryItem(QStringLiteral("max-keys")))
+        maxKeys = qBound(0, query.queryItemValue(QStringLiteral("max-keys")).toInt(), 1000);
+
+    QStringList::const_iterator i = std::upper_bound(bucket.keys.constBegin(), bucket.keys.constEnd(), marker);
+    // a common prefix as the marker means everything below it has been listed
+    if (!delimiter.isEmpty() && marker.endsWith(delimiter))
+        i = std::lower_bound(i, bucket.keys.constEnd(), marker + QChar(0xffff));
+    if (prefix > marker)
+        i = std::lower_bound(bucket.keys.constBegin(), bucket.keys.constEnd(), prefix);
+
+    QStringList contents;
+    QStringList commonPrefixes;
+    QString nextMarker;
+    bool truncated = false;
+    while (i != bucket.keys.constEnd() && i->startsWith(prefix)) {
+        if (contents.count() + commonPrefixes.count() == maxKeys) {
+            truncated = true;
+            break;
+        }
+        int found = delimiter.isEmpty() ? -1 : i->indexOf(delimiter, prefix.length());
+        if (found < 0) {
+            contents.append(*i);
+            nextMarker = *i;
+            ++i;
+        } else {
+            // everything below a common prefix rolls up into it
+            QString commonPrefix = i->left(found + delimiter.length());
+            commonPrefixes.append(commonPrefix);
+            nextMarker = commonPrefix;
+            i = std::lower_bound(i, bucket.keys.constEnd(), commonPrefix + QChar(0xffff));
+        }
+    }
+
+    Response response;
+    QXmlStreamWriter xml(&response.body);
+    xml.writeStartDocument();
+    xml.writeStartElement(QStringLiteral("ListBucketResult"));
+    xml.writeDefaultNamespace(QStringLiteral("http://s3.amazonaws.com/doc/2006-03-01/"));
+    xml.writeTextElement(QStringLiteral("Name"), name);
+    xml.writeTextElement(QStringLiteral("Prefix"), prefix);
+    xml.writeTextElement(QStringLiteral("Marker"), marker);
+    if (truncated && !delimiter.isEmpty())
+        xml.writeTextElement(QStringLiteral("NextMarker"), nextMarker);
+    xml.writeTextElement(QStringLiteral("MaxKeys"), QString::number(maxKeys));
+    if (!delimiter.isEmpty())
+        xml.writeTextElement(QStringLiteral("Delimiter"), delimiter);
+    xml.writeTextElement(QStringLiteral("IsTruncated"), truncated ? QStringLiteral("true") : QStringLiteral("false"));
+    foreach (const QString &key, contents) {
+        xml.writeStartElement(QStringLiteral("Contents"));
+        xml.writeTextElement(QStringLiteral("Key"), key);
+        xml.writeTextElement(QStringLiteral("LastModified"), QString::fromLatin1(lastModified));
+        xml.writeTextElement(QStringLiteral("ETag"), QString::fromLatin1(eTag(key, bucket.objectSize)));
+        xml.writeTextElement(QStringLiteral("Size"), QString::number(bucket.objectSize));
+        xml.writeTextElement(QStringLiteral("StorageClass"), QStringLiteral("STANDARD"));
+        xml.writeEndElement();
+    }
+    foreach (const QString &commonPrefix, commonPrefixes) {
+        xml.writeStartElement(QStringLiteral("CommonPrefixes"));
+        xml.writeTextElement(QStringLiteral("Prefix"), commonPrefix);
+        xml.writeEndElement();
+    }
+    xml.writeEndElement();
+    xml.writeEndDocument();
+    response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("application/xml")));
+    return response;
+}
+
+MockS3Server::Response MockS3Server::object(const Request &request, const QString &name, const QString &key) const
+{
+    const Bucket &bucket = buckets[name];
+    Response response;
+
+    if (request.method == "PUT") {
+        // accepted and dropped, a load test must not grow the server
+        response.headers.append(qMakePair(QByteArray("ETag"), '"' + QCryptographicHash::hash(request.body, QCryptographicHash::Md5).toHex() + '"'));
+        return response;
+    }
+    if (request.method == "DELETE") {
+        response.status = 204;
+        return response;
+    }
+    if (request.method != "GET" && request.method != "HEAD")
+        return error(405, "MethodNotAllowed", "The specified method is not allowed against this resource.");
+
+    if (!std::binary_search(bucket.keys.constBegin(), bucket.keys.constEnd(), key))
+        return error(404, "NoSuchKey", "The specified key does not exist.");
+
+    QByteArray tag = eTag(key, bucket.objectSize);
+    QByteArray ifMatch = request.headers.value("if-match");
+    if (!ifMatch.isEmpty() && ifMatch != tag)
+        return error(412, "PreconditionFailed", "At least one of the preconditions you specified did not hold.");
+
+    response.headers.append(qMakePair(QByteArray("ETag"), tag));
+    response.headers.append(qMakePair(QByteArray("Last-Modified"), QByteArray("Mon, 01 Jun 2015 12:00:00 GMT")));
+    response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("application/octet-stream")));
+    response.headers.append(qMakePair(QByteArray("Accept-Ranges"), QByteArray("bytes")));
+
+    qint64 first = 0;
+    qint64 last = bucket.objectSize - 1;
+    QByteArray range = request.headers.value("range");
+    if (range.startsWith("bytes=")) {
+        QList<QByteArray> bounds = range.mid(6).split('-');
+        first = bounds.value(0).toLongLong();
+        if (!bounds.value(1).isEmpty())
+            last = qMin(last, bounds.value(1).toLongLong());
+        if (first > last) {
+            response = error(416, "InvalidRange", "The requested range is not satisfiable.");
+            response.headers.append(qMakePair(QByteArray("Content-Range"), "bytes */" + QByteArray::number(bucket.objectSize)));
+            return response;
+        }
+        response.status = 206;
+        response.headers.append(qMakePair(QByteArray("Content-Range"), "bytes " + QByteArray::number(first) + '-' + QByteArray::number(last) + '/' + QByteArray::number(bucket.objectSize)));
+    }
+
+    if (request.method == "HEAD")
+        response.headers.append(qMakePair(QByteArray("Content-Length"), QByteArray::number(last - first + 1)));
+    else
+        response.body = content(key, bucket.objectSize).mid(first, last - first + 1);
+    return response;
+}
+
+MockS3Server::Response MockS3Server::select(const QString &name, const QString &key) const
+{
+    // whatever the expression, the records are the first keys of the bucket as CSV
+    const Bucket &bucket = buckets[name];
+    if (!std::binary_search(bucket.keys.constBegin(), bucket.keys.constEnd(), key))
+        return error(404, "NoSuchKey", "The specified key does not exist.");
+
+    QByteArray records;
+    for (int i = 0; i < qMin(100, bucket.keys.count()); i++)
+        records.append(bucket.keys.at(i).toUtf8() + ',' + QByteArray::number(bucket.objectSize) + '\n');
+
+    QVariantMap headers;
+    headers.insert(QStringLiteral(":message-type"), QStringLiteral("event"));
+
+    Response response;
+    headers.insert(QStringLiteral(":event-type"), QStringLiteral("Records"));
+    headers.insert(QStringLiteral(":content-type"), QStringLiteral("application/octet-stream"));
+    response.body.append(QS3EventStreamDecoder::encode(headers, records));
+
+    QByteArray stats = "<Stats><BytesScanned>" + QByteArray::number(bucket.objectSize)
+            + "</BytesScanned><BytesProcessed>" + QByteArray::number(bucket.objectSize)
+            + "</BytesProcessed><BytesReturned>" + QByteArray::number(records.size())
+            + "</BytesReturned></Stats>";
+    headers.insert(QStringLiteral(":event-type"), QStringLiteral("Stats"));
+    headers.insert(QStringLiteral(":content-type"), QStringLiteral("text/xml"));
+    response.body.append(QS3EventStreamDecoder::encode(headers, stats));
+
+    headers.remove(QStringLiteral(":content-type"));
+    headers.insert(QStringLiteral(":event-type"), QStringLiteral("End"));
+    response.body.append(QS3EventStreamDecoder::encode(headers, QByteArray()));
+    response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("application/octet-stream")));
+    return response;
+}
+
+MockS3Server::Response MockS3Server::error(int status, const QByteArray &code, const QByteArray &message)
+{
+    Response response;
+    response.status = status;
+    response.body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Error><Code>" + code + "</Code><Message>" + message + "</Message></Error>";
+    response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("application/xml")));
+    return response;
+}
+
+void MockS3Server::write(QTcpSocket *socket, const Request &request, const Response &response)
+{
+    static QHash<int, QByteArray> reasons;
+    if (reasons.isEmpty()) {
+        reasons.insert(200, "OK");
+        reasons.insert(204, "No Content");
+        reasons.insert(206, "Partial Content");
+        reasons.insert(307, "Temporary Redirect");
+        reasons.insert(403, "Forbidden");
+        reasons.insert(404, "Not Found");
+        reasons.insert(405, "Method Not Allowed");
+        reasons.insert(412, "Precondition Failed");
+        reasons.insert(416, "Requested Range Not Satisfiable");
+        reasons.insert(503, "Slow Down");
+    }
+
+    QByteArray head = "HTTP/1.1 " + QByteArray::number(response.status) + ' ' + reasons.value(response.status, "Unknown") + "\r\n";
+    bool contentLength = false;
+    typedef QPair<QByteArray, QByteArray> Header;
+    foreach (const Header &header, response.headers) {
+        head.append(header.first + ": " + header.second + "\r\n");
+        contentLength = contentLength || header.first == "Content-Length";
+    }
+    if (!contentLength)
+        head.append("Content-Length: " + QByteArray::number(response.body.size()) + "\r\n");
+    head.append("x-amz-request-id: mock\r\n\r\n");
+    socket->write(head);
+    if (request.method != "HEAD")
+        socket->write(response.body);
+}
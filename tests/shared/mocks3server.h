@@ -0,0 +1,107 @@
+/* Copyright (c) 2012 Silk Project.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Silk nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SILK BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MOCKS3SERVER_H
+#define MOCKS3SERVER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtNetwork/QTcpServer>
+
+#include <random>
+
+class QTcpSocket;
+
+// an S3 stand-in speaking just enough of the REST API for QtAmazonS3,
+// path-style only, see QAccount::endpoint
+class MockS3Server : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit MockS3Server(QObject *parent = 0);
+
+    void setCredentials(const QByteArray &awsAccessKeyId, const QByteArray &awsSecretAccessKey);
+    void addBucket(const QString &name, int keys, qint64 objectSize = 1024);
+    // a key by name, sized like the rest of the bucket
+    void addKey(const QString &bucket, const QString &key);
+
+    void setLatency(int msecs, int jitter = 0);
+    void setRedirectRate(double rate);
+    void setThrottleRate(double rate);
+    void setSeed(quint32 seed);
+
+    Q_INVOKABLE bool start(quint16 port = 0);
+
+    // what the server holds for a key, for tests to compare against
+    static QByteArray content(const QString &key, qint64 size);
+    QByteArray eTag(const QString &key, qint64 size) const;
+
+protected:
+    virtual void incomingConnection(qintptr socketDescriptor);
+
+private:
+    struct Request {
+        QByteArray method;
+        QByteArray target;
+        QHash<QByteArray, QByteArray> headers;
+        QByteArray body;
+    };
+
+    struct Response {
+        Response() : status(200) {}
+
+        int status;
+        QList<QPair<QByteArray, QByteArray> > headers;
+        QByteArray body;
+    };
+
+    struct Bucket {
+        QStringList keys;
+        qint64 objectSize;
+    };
+
+    void readRequest(QTcpSocket *socket);
+    Response handle(const Request &request);
+    bool authorized(const Request &request, const QUrl &url) const;
+    Response list(const QString &bucket, const QUrl &url) const;
+    Response object(const Request &request, const QString &bucket, const QString &key) const;
+    Response select(const QString &bucket, const QString &key) const;
+    static Response error(int status, const QByteArray &code, const QByteArray &message);
+    static void write(QTcpSocket *socket, const Request &request, const Response &response);
+
+    QByteArray awsAccessKeyId;
+    QByteArray awsSecretAccessKey;
+    QHash<QString, Bucket> buckets;
+    mutable QHash<QString, QByteArray> eTags;
+    QHash<QTcpSocket *, QByteArray> buffers;
+    int latency;
+    int jitter;
+    double redirectRate;
+    double throttleRate;
+    std::mt19937 random;
+};
+
+#endif // MOCKS3SERVER_H
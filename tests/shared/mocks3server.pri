@@ -0,0 +1,3 @@
+INCLUDEPATH += $$PWD
+HEADERS += $$PWD/mocks3server.h
+SOURCES += $$PWD/mocks3server.cpp